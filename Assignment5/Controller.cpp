@@ -12,11 +12,22 @@ using namespace std;
 
 #include "sgraph/ScenegraphExporter.h"
 #include "sgraph/ScenegraphImporter.h"
+#include "sgraph/BinaryScenegraphImporter.h"
+#include "sgraph/ScenegraphSync.h"
 #include "sgraph/TextScenegraphRenderer.h"
+#include "ourutils/CameraPath.h"
+#include "ourutils/FrameTimings.h"
+#include "tools/PPMWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 
 Controller::Controller(Model& m, View& v, vector<string> &argv) : model(m), view(v) {
     this->initLogger(m, v, argv);
     this->initScenegraph(argv);
+    this->initRecording(argv);
 }
 
 void Controller::initLogger(Model& m, View& v, vector<string> &argv) {
@@ -31,18 +42,34 @@ void Controller::initLogger(Model& m, View& v, vector<string> &argv) {
 
 //edited to use the new text renderer (TextScenegraphRenderer.h)
 void Controller::initScenegraph(vector<string> &argv) {
-    std::string commandFilePath = "scenegraphmodels/courtyard-scene-commands.txt";
+    commandFilePath = "scenegraphmodels/courtyard-scene-commands.txt";
     /** optional arg [ -f <filepath> ] overwrites the hardcoded default */
     auto it = std::find(argv.begin(), argv.end(), "-f");
     if (it != argv.end() && it + 1 != argv.end())
         commandFilePath = *(it + 1);
-    //read in the file of commands
-    ifstream inFile(commandFilePath);
-    sgraph::ScenegraphImporter importer;
+    /** optional arg [ -w ] reloads the scene whenever the command file (or a file it imports) changes */
+    watching = std::find(argv.begin(), argv.end(), "-w") != argv.end();
+    /** optional arg [ -t <directory> ] keeps decoded textures somewhere other than .texture-cache; "-t none" keeps them in memory only */
+    string textureCache = ".texture-cache";
+    it = std::find(argv.begin(), argv.end(), "-t");
+    if (it != argv.end() && it + 1 != argv.end())
+        textureCache = (*(it + 1) == "none") ? "" : *(it + 1);
+    AssetCache::shared().setTextureCacheDirectory(textureCache);
+    /** optional arg [ -c bc1|bc7 ] block compresses textures when they are loaded, and keeps them compressed in the texture cache */
+    it = std::find(argv.begin(), argv.end(), "-c");
+    if (it != argv.end() && it + 1 != argv.end()) {
+        if (*(it + 1) == "bc1")
+            AssetCache::shared().setTextureCompression(ourutils::BlockCompression::BC1);
+        else if (*(it + 1) == "bc7")
+            AssetCache::shared().setTextureCompression(ourutils::BlockCompression::BC7);
+    }
 
-    /** importer, parsing logic, & leafnode all changed to accommodate light */
-    IScenegraph *scenegraph = importer.parse(inFile);
+    vector<string> sourceFiles;
+    IScenegraph *scenegraph = loadScenegraph(sourceFiles);
     model.setScenegraph(scenegraph);
+    meshKeys = meshKeysOf(scenegraph);
+    if (watching)
+        watcher.watch(sourceFiles);
     this->logger.debugPrint({"Scenegraph made"});
 
     //create + use the text renderer
@@ -53,14 +80,124 @@ void Controller::initScenegraph(vector<string> &argv) {
     this->logger.debugPrint({"Finished printing the structure"});
 }
 
+void Controller::initRecording(vector<string> &argv) {
+    /** optional arg [ --frames <n> ] draws n frames without a window, writes them out with a timing report, and exits */
+    auto it = std::find(argv.begin(), argv.end(), "--frames");
+    if (it != argv.end() && it + 1 != argv.end())
+        recordFrames = max(atoi((it + 1)->c_str()), 0);
+    /** optional arg [ --camera-path <filepath> ] moves the camera along keyframes while recording (see ourutils/CameraPath.h) */
+    it = std::find(argv.begin(), argv.end(), "--camera-path");
+    if (it != argv.end() && it + 1 != argv.end())
+        cameraPathFile = *(it + 1);
+    /** optional arg [ --size <width>x<height> ] sets the size of the recorded frames, 800x800 by default */
+    it = std::find(argv.begin(), argv.end(), "--size");
+    if (it != argv.end() && it + 1 != argv.end()) {
+        int width, height;
+        if (sscanf((it + 1)->c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+            recordWidth = width;
+            recordHeight = height;
+        }
+    }
+    /** optional arg [ --out <directory> ] puts the recorded frames and timing.txt in an existing directory; "--out none" only prints the timing */
+    it = std::find(argv.begin(), argv.end(), "--out");
+    if (it != argv.end() && it + 1 != argv.end())
+        recordDirectory = (*(it + 1) == "none") ? "" : *(it + 1);
+}
+
+IScenegraph *Controller::loadScenegraph(vector<string> &sourceFiles) {
+    IScenegraph *scenegraph;
+    /** files compiled by SceneCompiler are loaded without any text parsing */
+    if (commandFilePath.size() > 4 && commandFilePath.compare(commandFilePath.size() - 4, 4, ".sgb") == 0) {
+        sgraph::BinaryScenegraphImporter importer;
+        scenegraph = importer.parseFile(commandFilePath);
+        sourceFiles.push_back(commandFilePath);
+    } else {
+        //read in the file of commands
+        sgraph::ScenegraphImporter importer;
+        importer.setVerbose(!watching);
+
+        /** importer, parsing logic, & leafnode all changed to accommodate light */
+        scenegraph = importer.parseFile(commandFilePath);
+        sourceFiles = importer.getSourceFiles();
+    }
+    return scenegraph;
+}
+
+/**
+ * The key of each mesh file in the asset cache. A mesh whose key changed between
+ * two loads was edited on disk.
+ */
+map<string,string> Controller::meshKeysOf(IScenegraph *scenegraph) {
+    map<string,string> keys;
+    map<string,string> paths = scenegraph->getMeshPaths();
+    for (map<string,string>::iterator it = paths.begin(); it != paths.end(); it++) {
+        string key;
+        if (AssetCache::makeKey(it->second, key))
+            keys[it->first] = key;
+    }
+    return keys;
+}
+
+/**
+ * Parse the command file again and merge the result into the scene on display.
+ * Only the parts that changed are replaced; a file that fails to parse leaves the
+ * scene as it was.
+ */
+void Controller::reloadScenegraph() {
+    IScenegraph *fresh;
+    vector<string> sourceFiles;
+    try {
+        fresh = loadScenegraph(sourceFiles);
+    } catch (exception& e) {
+        cerr << "Could not reload " << commandFilePath << ": " << e.what() << endl;
+        return;
+    }
+    watcher.watch(sourceFiles);
+
+    IScenegraph *scenegraph = model.getScenegraph();
+    sgraph::ScenegraphSync sync;
+    SGNode *root = sync.apply(scenegraph->getRoot(), fresh->getRoot());
+    fresh->makeScenegraph(NULL);
+    scenegraph->makeScenegraph(root);
+
+    map<string,util::PolygonMesh<VertexAttrib>> meshes = fresh->getMeshes();
+    map<string,util::TextureImage> images = fresh->getImages();
+    map<string,sgraph::PixelHandle> imagePixels = fresh->getImagePixels();
+    map<string,string> meshPaths = fresh->getMeshPaths();
+    map<string,string> imagePaths = fresh->getImagePaths();
+    scenegraph->setMeshes(meshes);
+    scenegraph->setImages(images);
+    scenegraph->setImagePixels(imagePixels);
+    scenegraph->setMeshPaths(meshPaths);
+    scenegraph->setImagePaths(imagePaths);
+
+    map<string,string> keys = meshKeysOf(scenegraph);
+    set<string> changedMeshes;
+    for (map<string,string>::iterator it = keys.begin(); it != keys.end(); it++) {
+        if (meshKeys[it->first] != it->second)
+            changedMeshes.insert(it->first);
+    }
+    meshKeys = keys;
+    view.updateAssets(meshes, changedMeshes, imagePixels);
+    delete fresh;
+
+    cout << "Reloaded " << commandFilePath << ": kept " << sync.getKept() << " nodes, added "
+         << sync.getAdded() << ", removed " << sync.getRemoved() << ", " << changedMeshes.size()
+         << " meshes changed" << endl;
+}
+
 Controller::~Controller() {}
 
 void Controller::run() {
+    if (recordFrames > 0)
+        runHeadless();
     sgraph::IScenegraph* scenegraph = model.getScenegraph();
     map<string,util::PolygonMesh<VertexAttrib>> meshes = scenegraph->getMeshes();
-    map<string,util::TextureImage> images = scenegraph->getImages();
-    view.init(this, meshes, images);
+    map<string,sgraph::PixelHandle> imagePixels = scenegraph->getImagePixels();
+    view.init(this, meshes, imagePixels);
     while (!view.shouldWindowClose()) {
+        if (watching && watcher.changed())
+            reloadScenegraph();
         view.display(scenegraph);
         promptAdjustRotation();
     }
@@ -68,6 +205,67 @@ void Controller::run() {
     exit(EXIT_SUCCESS);
 }
 
+/**
+ * Draw the scene into an offscreen framebuffer for the requested number of
+ * frames, moving the camera along its path, and write each frame as a PPM with a
+ * timing report. Each frame is timed twice: up to the end of View::display, which
+ * is the CPU cost of submitting it, and after glFinish, which includes drawing it.
+ * Reading the frames back and writing them out is not timed. The first frame is
+ * reported on its own and left out of the statistics, as it also brings every
+ * world transform and instance buffer up to date. Exits with a failure status if
+ * there is no context to draw with or a frame could not be written.
+ */
+void Controller::runHeadless() {
+    ourutils::CameraPath cameraPath;
+    string error;
+    if (!cameraPathFile.empty() && !cameraPath.load(cameraPathFile, error)) {
+        cerr << "Could not load the camera path: " << error << endl;
+        exit(EXIT_FAILURE);
+    }
+    sgraph::IScenegraph* scenegraph = model.getScenegraph();
+    map<string,util::PolygonMesh<VertexAttrib>> meshes = scenegraph->getMeshes();
+    map<string,sgraph::PixelHandle> imagePixels = scenegraph->getImagePixels();
+    if (!view.initHeadless(recordWidth, recordHeight, meshes, imagePixels, error)) {
+        cerr << "Could not draw headless: " << error << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    ourutils::FrameTimings timings;
+    vector<unsigned char> pixels;
+    bool written = true;
+    for (int frame = 0; frame < recordFrames; frame++) {
+        ourutils::CameraPath::Pose pose = cameraPath.at(frame, recordFrames);
+        view.setCamera(glm::radians(pose.thetaX), glm::radians(pose.thetaY), pose.radius);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        view.display(scenegraph);
+        double submitMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        glFinish();
+        timings.add(submitMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        if (!recordDirectory.empty()) {
+            int width, height;
+            view.readPixels(pixels, &width, &height);
+            char name[32];
+            snprintf(name, sizeof(name), "/frame-%04d.ppm", frame);
+            if (!writePPM(recordDirectory + name, pixels.data(), width, height, true)) {
+                cerr << "Could not write " << recordDirectory + name << endl;
+                written = false;
+                break;
+            }
+        }
+    }
+
+    string report = timings.report((const char *)glGetString(GL_RENDERER), recordWidth, recordHeight);
+    cout << report;
+    if (!recordDirectory.empty()) {
+        ofstream out(recordDirectory + "/timing.txt");
+        out << report;
+        written = written && out.good();
+    }
+
+    view.closeWindow();
+    exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
 void Controller::onkey(int key, int scancode, int action, int mods)
 {
     // cout << (char)key << " pressed" << endl;
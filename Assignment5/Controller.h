@@ -4,6 +4,7 @@
 #include "Callbacks.h"
 #include "Model.h"
 #include "View.h"
+#include "ourutils/FileWatcher.h"
 #include "ourutils/Logger.h"
 
 
@@ -12,6 +13,7 @@ class Controller: public Callbacks {
         Controller(Model& m, View& v, vector<string>& argv);
         ~Controller();
         void run();
+        void runHeadless();
         void promptAdjustRotation();
 
         virtual void reshape(int width, int height);
@@ -23,6 +25,10 @@ class Controller: public Callbacks {
     private:
         void initLogger(Model& m, View& v, vector<string> &argv);
         void initScenegraph(vector<string> &argv);
+        void initRecording(vector<string> &argv);
+        sgraph::IScenegraph *loadScenegraph(vector<string> &sourceFiles);
+        void reloadScenegraph();
+        static map<string,string> meshKeysOf(sgraph::IScenegraph *scenegraph);
 
         View view;
         Model model;
@@ -30,6 +36,19 @@ class Controller: public Callbacks {
         double cursorPosnX;
         double cursorPosnY;
 
+        string commandFilePath;
+        bool watching = false;
+        ourutils::FileWatcher watcher;
+        map<string,string> meshKeys;
+
+        // with --frames, the number of frames to draw headless; 0 opens a window
+        int recordFrames = 0;
+        int recordWidth = 800;
+        int recordHeight = 800;
+        string cameraPathFile;
+        // where the frames and the timing report go, or empty for neither
+        string recordDirectory = ".";
+
         ourutils::Logger logger;
 };
 
@@ -0,0 +1,422 @@
+#ifndef __PNG_IMAGELOADER_H_
+#define __PNG_IMAGELOADER_H_
+
+#include "ImageLoader.h"
+#include "ourutils/Inflate.h"
+#include "ourutils/MappedFile.h"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief This class is used to load an image in the PNG format: greyscale, RGB
+ * or palette, with or without alpha, at any bit depth, interlaced or not. Alpha
+ * is dropped, as textures are RGB.
+ *
+ */
+class PNGImageLoader: public ImageLoader {
+
+    public:
+        PNGImageLoader() {
+
+        }
+
+        /**
+         * \return true if the bytes start with the PNG signature
+         */
+        static bool isPNG(const char *bytes,size_t size) {
+            static const unsigned char signature[8] = {137,80,78,71,13,10,26,10};
+            return (size>=8) && (memcmp(bytes,signature,8)==0);
+        }
+
+        void load(string filename) {
+            ourutils::MappedFile file;
+            if (!file.open(filename))
+                throw std::invalid_argument("File not found!");
+
+            if (!isPNG(file.data(),file.size()))
+                throw std::invalid_argument("Not a PNG file: "+filename);
+
+            // walk the chunks, collecting the compressed image data
+            const unsigned char *p = (const unsigned char *)file.data()+8;
+            const unsigned char *end = (const unsigned char *)file.end();
+            std::vector<unsigned char> compressed;
+            bool header = false;
+            bool ended = false;
+            int depth = 0;
+            int colorType = 0;
+            int interlace = 0;
+            palette.clear();
+            while (!ended && (end-p>=12)) {
+                uint32_t length = readInt(p);
+                const unsigned char *data = p+8;
+                if ((size_t)(end-data) < (size_t)length+4)
+                    break;
+                if (memcmp(p+4,"IHDR",4)==0) {
+                    if (length<13)
+                        break;
+                    width = (int)readInt(data);
+                    height = (int)readInt(data+4);
+                    depth = data[8];
+                    colorType = data[9];
+                    interlace = data[12];
+                    if ((width<=0) || (height<=0) || (data[10]!=0) || (data[11]!=0) || (interlace>1) ||
+                        !isValidFormat(colorType,depth))
+                        throw std::invalid_argument("Unsupported PNG file: "+filename);
+                    header = true;
+                }
+                else if (memcmp(p+4,"PLTE",4)==0) {
+                    palette.assign(data,data+length-length%3);
+                }
+                else if (memcmp(p+4,"IDAT",4)==0) {
+                    compressed.insert(compressed.end(),data,data+length);
+                }
+                else if (memcmp(p+4,"IEND",4)==0) {
+                    ended = true;
+                }
+                p = data+length+4;
+            }
+            if (!header || compressed.empty())
+                throw std::invalid_argument("Malformed PNG file: "+filename);
+            if ((colorType==3) && palette.empty())
+                throw std::invalid_argument("PNG file without a palette: "+filename);
+
+            channels = (colorType==2)?3:(colorType==4)?2:(colorType==6)?4:1;
+            this->depth = depth;
+            this->colorType = colorType;
+            size_t expected = 0;
+            for (int pass=(interlace?0:7);pass<(interlace?7:8);pass++) {
+                // a pass with no columns has no rows either, not even filter bytes
+                if (passColumns(pass)>0)
+                    expected += passRows(pass)*(1+rowBytes(passColumns(pass)));
+            }
+            std::vector<unsigned char> raster;
+            raster.reserve(expected);
+            if (!ourutils::Inflate::zlib(compressed.data(),compressed.size(),raster) || (raster.size()<expected))
+                throw std::invalid_argument("Truncated PNG file: "+filename);
+            std::vector<unsigned char>().swap(compressed);
+
+            image = new GLubyte[3*(size_t)width*height];
+            try {
+                unsigned char *rows = raster.data();
+                for (int pass=(interlace?0:7);pass<(interlace?7:8);pass++) {
+                    size_t columns = passColumns(pass);
+                    size_t rowCount = passRows(pass);
+                    if ((columns==0) || (rowCount==0))
+                        continue;
+                    unfilter(rows,rowCount,rowBytes(columns));
+                    for (size_t r=0;r<rowCount;r++) {
+                        size_t y = adam7(pass)[1]+r*adam7(pass)[3];
+                        GLubyte *out = image+3*((height-1-y)*(size_t)width+adam7(pass)[0]);
+                        convertRow(rows+r*(1+rowBytes(columns))+1,columns,out,3*(size_t)adam7(pass)[2]);
+                    }
+                    rows += rowCount*(1+rowBytes(columns));
+                }
+            }
+            catch (...) {
+                delete [] image;
+                image = NULL;
+                throw;
+            }
+        }
+
+    private:
+        /**
+         * Get an Adam7 pass, as first column, first row, column step and row
+         * step. Pass 7 is the whole image, for files that are not interlaced.
+         */
+        static const int *adam7(int pass) {
+            static const int passes[8][4] = {
+                {0,0,8,8},{4,0,8,8},{0,4,4,8},{2,0,4,4},{0,2,2,4},{1,0,2,2},{0,1,1,2},{0,0,1,1}
+            };
+            return passes[pass];
+        }
+
+        static uint32_t readInt(const unsigned char *p) {
+            return ((uint32_t)p[0]<<24) | ((uint32_t)p[1]<<16) | ((uint32_t)p[2]<<8) | p[3];
+        }
+
+        static bool isValidFormat(int colorType,int depth) {
+            switch (colorType) {
+                case 0: return (depth==1) || (depth==2) || (depth==4) || (depth==8) || (depth==16);
+                case 3: return (depth==1) || (depth==2) || (depth==4) || (depth==8);
+                case 2: case 4: case 6: return (depth==8) || (depth==16);
+                default: return false;
+            }
+        }
+
+        size_t passColumns(int pass) const {
+            int first = adam7(pass)[0];
+            int step = adam7(pass)[2];
+            return (width>first)?(width-first+step-1)/step:0;
+        }
+
+        size_t passRows(int pass) const {
+            int first = adam7(pass)[1];
+            int step = adam7(pass)[3];
+            return (height>first)?(height-first+step-1)/step:0;
+        }
+
+        size_t rowBytes(size_t columns) const {
+            return (columns*channels*depth+7)/8;
+        }
+
+        /**
+         * Undo the filter of each row, in place. Every row is a filter type
+         * byte followed by its bytes, and each filter predicts a byte from the
+         * byte one pixel to the left, the byte above, or both.
+         */
+        void unfilter(unsigned char *rows,size_t rowCount,size_t bytes) {
+            size_t bpp = (channels*depth+7)/8;
+            std::vector<unsigned char> zeros(bytes,0);
+            const unsigned char *prior = zeros.data();
+            for (size_t r=0;r<rowCount;r++) {
+                unsigned char *row = rows+r*(bytes+1);
+                unsigned char filter = row[0];
+                row++;
+                switch (filter) {
+                    case 0:
+                        break;
+                    case 1:
+                        unfilterSub(row,bytes,bpp);
+                        break;
+                    case 2:
+                        unfilterUp(row,prior,bytes);
+                        break;
+                    case 3:
+                        unfilterAverage(row,prior,bytes,bpp);
+                        break;
+                    case 4:
+                        unfilterPaeth(row,prior,bytes,bpp);
+                        break;
+                    default:
+                        throw std::invalid_argument("Malformed PNG row filter");
+                }
+                prior = row;
+            }
+        }
+
+#if defined(__SSE2__) || defined(_M_X64)
+        /**
+         * Pixels of 3 or 4 bytes are filtered one pixel per SSE2 register, as
+         * each depends on the one to its left. Each of these functions filters
+         * whole pixels from the start of the row and returns where it stopped.
+         */
+        template <int BPP>
+        static inline __m128i loadPixel(const unsigned char *p) {
+            int32_t v = 0;
+            memcpy(&v,p,BPP);
+            return _mm_cvtsi32_si128(v);
+        }
+
+        template <int BPP>
+        static inline void storePixel(unsigned char *p,__m128i v) {
+            int32_t bytes = _mm_cvtsi128_si32(v);
+            memcpy(p,&bytes,BPP);
+        }
+
+        template <int BPP>
+        static size_t subPixels(unsigned char *row,size_t bytes) {
+            __m128i a = _mm_setzero_si128();
+            size_t i = 0;
+            for (;i+BPP<=bytes;i+=BPP) {
+                a = _mm_add_epi8(a,loadPixel<BPP>(row+i));
+                storePixel<BPP>(row+i,a);
+            }
+            return i;
+        }
+
+        template <int BPP>
+        static size_t averagePixels(unsigned char *row,const unsigned char *prior,size_t bytes) {
+            const __m128i one = _mm_set1_epi8(1);
+            __m128i a = _mm_setzero_si128();
+            size_t i = 0;
+            for (;i+BPP<=bytes;i+=BPP) {
+                __m128i b = loadPixel<BPP>(prior+i);
+                // floor((a+b)/2), as _mm_avg_epu8 rounds up
+                __m128i average = _mm_sub_epi8(_mm_avg_epu8(a,b),_mm_and_si128(_mm_xor_si128(a,b),one));
+                a = _mm_add_epi8(loadPixel<BPP>(row+i),average);
+                storePixel<BPP>(row+i,a);
+            }
+            return i;
+        }
+
+        template <int BPP>
+        static size_t paethPixels(unsigned char *row,const unsigned char *prior,size_t bytes) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i a = zero;
+            __m128i c = zero;
+            size_t i = 0;
+            for (;i+BPP<=bytes;i+=BPP) {
+                __m128i b = _mm_unpacklo_epi8(loadPixel<BPP>(prior+i),zero);
+                // the distances of a+b-c from a, b and c
+                __m128i pa = _mm_sub_epi16(b,c);
+                __m128i pb = _mm_sub_epi16(a,c);
+                __m128i pc = _mm_add_epi16(pa,pb);
+                pa = _mm_max_epi16(pa,_mm_sub_epi16(zero,pa));
+                pb = _mm_max_epi16(pb,_mm_sub_epi16(zero,pb));
+                pc = _mm_max_epi16(pc,_mm_sub_epi16(zero,pc));
+                __m128i smallest = _mm_min_epi16(pc,_mm_min_epi16(pa,pb));
+                // ties go to a, then b, then c
+                __m128i useB = _mm_cmpeq_epi16(smallest,pb);
+                __m128i nearest = _mm_or_si128(_mm_and_si128(useB,b),_mm_andnot_si128(useB,c));
+                __m128i useA = _mm_cmpeq_epi16(smallest,pa);
+                nearest = _mm_or_si128(_mm_and_si128(useA,a),_mm_andnot_si128(useA,nearest));
+                __m128i x = _mm_add_epi8(loadPixel<BPP>(row+i),_mm_packus_epi16(nearest,nearest));
+                storePixel<BPP>(row+i,x);
+                a = _mm_unpacklo_epi8(x,zero);
+                c = b;
+            }
+            return i;
+        }
+#endif
+
+        static void unfilterSub(unsigned char *row,size_t bytes,size_t bpp) {
+            size_t i = bpp;
+#if defined(__SSE2__) || defined(_M_X64)
+            if (bpp==3)
+                i = subPixels<3>(row,bytes);
+            else if (bpp==4)
+                i = subPixels<4>(row,bytes);
+#endif
+            for (;i<bytes;i++) {
+                row[i] = (unsigned char)(row[i]+row[i-bpp]);
+            }
+        }
+
+        static void unfilterUp(unsigned char *row,const unsigned char *prior,size_t bytes) {
+            size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+            for (;i+16<=bytes;i+=16) {
+                __m128i x = _mm_loadu_si128((const __m128i *)(row+i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(prior+i));
+                _mm_storeu_si128((__m128i *)(row+i),_mm_add_epi8(x,b));
+            }
+#endif
+            for (;i<bytes;i++) {
+                row[i] = (unsigned char)(row[i]+prior[i]);
+            }
+        }
+
+        static void unfilterAverage(unsigned char *row,const unsigned char *prior,size_t bytes,size_t bpp) {
+            size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+            if (bpp==3)
+                i = averagePixels<3>(row,prior,bytes);
+            else if (bpp==4)
+                i = averagePixels<4>(row,prior,bytes);
+#endif
+            for (;i<bpp && i<bytes;i++) {
+                row[i] = (unsigned char)(row[i]+(prior[i]>>1));
+            }
+            for (;i<bytes;i++) {
+                row[i] = (unsigned char)(row[i]+((row[i-bpp]+prior[i])>>1));
+            }
+        }
+
+        static void unfilterPaeth(unsigned char *row,const unsigned char *prior,size_t bytes,size_t bpp) {
+            size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+            if (bpp==3)
+                i = paethPixels<3>(row,prior,bytes);
+            else if (bpp==4)
+                i = paethPixels<4>(row,prior,bytes);
+#endif
+            for (;i<bpp && i<bytes;i++) {
+                row[i] = (unsigned char)(row[i]+prior[i]);
+            }
+            for (;i<bytes;i++) {
+                int a = row[i-bpp];
+                int b = prior[i];
+                int c = prior[i-bpp];
+                int pa = abs(b-c);
+                int pb = abs(a-c);
+                int pc = abs(a+b-2*c);
+                int nearest = ((pa<=pb) && (pa<=pc))?a:(pb<=pc)?b:c;
+                row[i] = (unsigned char)(row[i]+nearest);
+            }
+        }
+
+        /**
+         * Convert a row of unfiltered samples to RGB, writing each pixel step
+         * bytes after the one before
+         */
+        void convertRow(const unsigned char *in,size_t columns,GLubyte *out,size_t step) {
+            if (depth==8) {
+                if (channels==3) {
+                    if (step==3) {
+                        memcpy(out,in,3*columns);
+                        return;
+                    }
+                    for (size_t x=0;x<columns;x++,in+=3,out+=step) {
+                        out[0] = in[0]; out[1] = in[1]; out[2] = in[2];
+                    }
+                }
+                else if (channels==4) {
+                    for (size_t x=0;x<columns;x++,in+=4,out+=step) {
+                        out[0] = in[0]; out[1] = in[1]; out[2] = in[2];
+                    }
+                }
+                else if (colorType==3) {
+                    for (size_t x=0;x<columns;x++,out+=step) {
+                        setPaletteColor(out,in[x]);
+                    }
+                }
+                else {
+                    for (size_t x=0;x<columns;x++,in+=channels,out+=step) {
+                        out[0] = out[1] = out[2] = in[0];
+                    }
+                }
+            }
+            else if (depth==16) {
+                // the most significant byte comes first
+                size_t stride = 2*channels;
+                for (size_t x=0;x<columns;x++,in+=stride,out+=step) {
+                    if (channels>=3) {
+                        out[0] = in[0]; out[1] = in[2]; out[2] = in[4];
+                    }
+                    else {
+                        out[0] = out[1] = out[2] = in[0];
+                    }
+                }
+            }
+            else {
+                // 1, 2 or 4 bit samples, packed from the most significant bit
+                int perByte = 8/depth;
+                int mask = (1<<depth)-1;
+                int scale = 255/mask;
+                for (size_t x=0;x<columns;x++,out+=step) {
+                    int shift = 8-depth*(int)(x%perByte+1);
+                    int value = (in[x/perByte]>>shift) & mask;
+                    if (colorType==3) {
+                        setPaletteColor(out,value);
+                    }
+                    else {
+                        out[0] = out[1] = out[2] = (GLubyte)(value*scale);
+                    }
+                }
+            }
+        }
+
+        inline void setPaletteColor(GLubyte *out,size_t index) {
+            if (3*index+2<palette.size()) {
+                out[0] = palette[3*index];
+                out[1] = palette[3*index+1];
+                out[2] = palette[3*index+2];
+            }
+            else {
+                out[0] = out[1] = out[2] = 0;
+            }
+        }
+
+        int depth;
+        int colorType;
+        int channels;
+        std::vector<unsigned char> palette;
+};
+
+#endif
@@ -2,13 +2,22 @@
 #define __PPM_IMAGELOADER_H_
 
 #include "ImageLoader.h"
+#include "ourutils/MappedFile.h"
+#include "ourutils/ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
-#include <sstream>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 /**
- * @brief This class is used to load an image in the ASCII PPM format 
- * 
+ * @brief This class is used to load an image in the PPM format, either ASCII (P3)
+ * or binary (P6, with 8 or 16 bits per channel)
+ *
  */
 class PPMImageLoader: public ImageLoader {
 
@@ -18,59 +27,274 @@ class PPMImageLoader: public ImageLoader {
         }
 
         void load(string filename) {
-            ifstream fp;
-            string str;
-            int i,j;
-            int r,g,b;
-            int factor;
-
-            fp.open(filename.c_str());
-            
-            if (!fp.is_open())
+            ourutils::MappedFile file;
+            if (!file.open(filename))
                 throw std::invalid_argument("File not found!");
 
             std::cout << "Image file opened" << endl;
 
-            //read line by line and ignore comments
-            std::stringstream input;
-            std::string line;
+            if ((file.size()>=2) && (file.data()[0]=='P') && (file.data()[1]=='6')) {
+                loadBinary(file,filename);
+            }
+            else {
+                loadAscii(file,filename);
+            }
+        }
+
+    private:
+        /**
+         * Read the raster of a P6 file straight out of the mapped file. Rows are
+         * stored top to bottom, so each one is copied to its flipped position; a
+         * file with 8-bit channels and a maximum of 255 needs nothing but memcpy.
+         */
+        void loadBinary(const ourutils::MappedFile& file,const string& filename) {
+            const char *p = file.data()+2;
+            const char *end = file.end();
+            long w = readHeaderNumber(p,end);
+            long h = readHeaderNumber(p,end);
+            long maxval = readHeaderNumber(p,end);
+            // a single whitespace character separates the header from the raster
+            if ((w<=0) || (h<=0) || (maxval<=0) || (maxval>65535) || (p>=end) || !isspace((unsigned char)*p))
+                throw std::invalid_argument("Malformed PPM file: "+filename);
+            p++;
+
+            size_t bytesPerChannel = (maxval<256)?1:2;
+            size_t rowBytes = 3*(size_t)w*bytesPerChannel;
+            if ((size_t)(end-p) < rowBytes*(size_t)h)
+                throw std::invalid_argument("Truncated PPM file: "+filename);
+
+            width = (int)w;
+            height = (int)h;
+            image = new GLubyte[3*(size_t)width*height];
+            const unsigned char *raster = (const unsigned char *)p;
+
+            if (maxval==255) {
+                for (int i=0;i<height;i++) {
+                    memcpy(image+3*(size_t)(height-1-i)*width,raster+i*rowBytes,rowBytes);
+                }
+            }
+            else if (bytesPerChannel==1) {
+                GLubyte scaled[256];
+                for (int v=0;v<256;v++) {
+                    scaled[v] = (GLubyte)((v>maxval)?255:(v*255+maxval/2)/maxval);
+                }
+                for (int i=0;i<height;i++) {
+                    const unsigned char *in = raster+i*rowBytes;
+                    GLubyte *out = image+3*(size_t)(height-1-i)*width;
+                    for (size_t k=0;k<rowBytes;k++) {
+                        out[k] = scaled[in[k]];
+                    }
+                }
+            }
+            else {
+                // 16-bit channels are big-endian
+                for (int i=0;i<height;i++) {
+                    const unsigned char *in = raster+i*rowBytes;
+                    GLubyte *out = image+3*(size_t)(height-1-i)*width;
+                    for (size_t k=0;k<3*(size_t)width;k++) {
+                        long v = (in[2*k]<<8) | in[2*k+1];
+                        out[k] = (GLubyte)((v>maxval)?255:(v*255+maxval/2)/maxval);
+                    }
+                }
+            }
+        }
 
-            while (std::getline(fp,line)) {
-                if ((line.length()>0) && (line[0]!='#')) {
-                    input << line << endl;
+        /**
+         * Read a number in the header, skipping whitespace and comments before it
+         * \return the number, or -1 if there is none
+         */
+        static long readHeaderNumber(const char *&p,const char *end) {
+            while (p<end) {
+                if (*p=='#') {
+                    while ((p<end) && (*p!='\n') && (*p!='\r')) {
+                        p++;
+                    }
+                }
+                else if (isspace((unsigned char)*p)) {
+                    p++;
                 }
+                else {
+                    break;
+                }
+            }
+            if ((p>=end) || !isdigit((unsigned char)*p))
+                return -1;
+            long value = 0;
+            while ((p<end) && isdigit((unsigned char)*p) && (value<=(1L<<24))) {
+                value = 10*value + (*p-'0');
+                p++;
             }
-            fp.close();
+            return value;
+        }
 
+        /**
+         * Decode the raster of a P3 file. The text is split into one chunk per
+         * worker at gaps between numbers; each worker counts the numbers in its
+         * chunk, so that it knows which channel its chunk starts at, and then
+         * writes its values straight to their flipped positions in the image.
+         * The chunks run on the shared thread pool, or one after another when the
+         * image is loaded on a pool worker, as SceneAssetLoader loads it.
+         */
+        void loadAscii(const ourutils::MappedFile& file,const string& filename) {
+            const char *p = file.data()+2;
+            const char *end = file.end();
+            long w = readHeaderNumber(p,end);
+            long h = readHeaderNumber(p,end);
+            long maxval = readHeaderNumber(p,end);
+            if ((w<=0) || (h<=0) || (maxval<=0) || (maxval>65535))
+                throw std::invalid_argument("Malformed PPM file: "+filename);
 
-            //read in the word P3
+            width = (int)w;
+            height = (int)h;
+            size_t channels = 3*(size_t)width*height;
+            image = new GLubyte[channels];
 
-            input >> str;
+            AsciiRaster raster;
+            raster.image = image;
+            raster.rowChannels = 3*(size_t)width;
+            raster.height = height;
+            raster.channels = channels;
+            raster.scaled.resize(maxval+1);
+            for (long v=0;v<=maxval;v++) {
+                raster.scaled[v] = (GLubyte)((maxval==255)?v:(v*255+maxval/2)/maxval);
+            }
 
+            size_t decoded;
+            if (memchr(p,'#',end-p)!=NULL) {
+                // comments can hide numbers from the counting pass, so go in one piece
+                decoded = raster.decode(p,end,0,true);
+            }
+            else {
+                size_t bytes = end-p;
+                unsigned int workers = ourutils::ThreadPool::piecesFor(bytes,1<<20);
 
-            //now read in the width and height
+                vector<const char *> bounds(workers+1,end);
+                bounds[0] = p;
+                for (unsigned int t=1;t<workers;t++) {
+                    const char *b = p+bytes*t/workers;
+                    while ((b<end) && isdigit((unsigned char)*b)) {
+                        b++;
+                    }
+                    bounds[t] = std::max(b,bounds[t-1]);
+                }
 
-            input >> width >> height;
+                vector<size_t> first(workers+1,0);
+                vector<size_t> decodedBy(workers,0);
+                if (workers==1) {
+                    decodedBy[0] = raster.decode(p,end,0,false);
+                }
+                else {
+                    ourutils::ThreadPool::parallelFor(workers,[&](unsigned int t) {
+                        first[t+1] = countNumbers(bounds[t],bounds[t+1]);
+                    });
+                    for (unsigned int t=0;t<workers;t++) {
+                        first[t+1] += first[t];
+                    }
+                    ourutils::ThreadPool::parallelFor(workers,[&](unsigned int t) {
+                        decodedBy[t] = raster.decode(bounds[t],bounds[t+1],first[t],false);
+                    });
+                }
+                decoded = 0;
+                for (unsigned int t=0;t<workers;t++) {
+                    decoded += decodedBy[t];
+                }
+            }
+            if (decoded<channels) {
+                delete [] image;
+                image = NULL;
+                throw std::invalid_argument("Truncated PPM file: "+filename);
+            }
+        }
 
-            //read in the factor
-            input >> factor;
+        /**
+         * Where the values of a P3 raster go, and how they are scaled to 8 bits
+         */
+        struct AsciiRaster {
+            GLubyte *image;
+            size_t rowChannels;
+            int height;
+            size_t channels;
+            vector<GLubyte> scaled;
 
-            image = new GLubyte[3*width*height];
+            /**
+             * Parse the numbers in a piece of the raster, the first of which is
+             * channel number index of the image, and store them
+             * \return the number of channels stored
+             */
+            size_t decode(const char *p,const char *end,size_t index,bool comments) {
+                if (index>=channels)
+                    return 0;
+                size_t row = index/rowChannels;
+                size_t col = index%rowChannels;
+                GLubyte *out = image+(height-1-row)*rowChannels;
+                size_t stored = 0;
+                size_t maxval = scaled.size()-1;
+                while (p<end) {
+                    unsigned int c = (unsigned char)*p-'0';
+                    if (c>9) {
+                        if (comments && (*p=='#')) {
+                            while ((p<end) && (*p!='\n')) {
+                                p++;
+                            }
+                        }
+                        else {
+                            p++;
+                        }
+                        continue;
+                    }
+                    size_t value = c;
+                    p++;
+                    while ((p<end) && ((c=(unsigned char)*p-'0')<=9)) {
+                        value = (value<=maxval)?10*value+c:value;
+                        p++;
+                    }
+                    out[col] = (value<=maxval)?scaled[value]:255;
+                    stored++;
+                    if (++col==rowChannels) {
+                        col = 0;
+                        if (++row==(size_t)height)
+                            break;
+                        out -= rowChannels;
+                    }
+                }
+                return stored;
+            }
+        };
 
-            for (i=0;i<height;i++)
-            {
-                for (j=0;j<width;j++)
-                {
-                    input >> r >> g >> b;
-                    image[3*((height-1-i)*width+j)] = r;
-                    image[3*((height-1-i)*width+j)+1] = g;
-                    image[3*((height-1-i)*width+j)+2] = b;
-                    // << "r=" << (int)r << ", g=" << (int)g << ",b=" << (int)b << endl;
+        /**
+         * Count the runs of digits in a piece of text that does not start in the
+         * middle of one. Sixteen bytes are classified at a time where SSE2 is
+         * available.
+         */
+        static size_t countNumbers(const char *p,const char *end) {
+            size_t count = 0;
+            unsigned int previous = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+            const __m128i belowZero = _mm_set1_epi8('0'-1);
+            const __m128i aboveNine = _mm_set1_epi8('9'+1);
+            while (end-p>=16) {
+                __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+                __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(bytes,belowZero),_mm_cmplt_epi8(bytes,aboveNine));
+                unsigned int mask = (unsigned int)_mm_movemask_epi8(digits);
+                // a number starts at a digit that does not follow a digit
+                unsigned int starts = mask & ~((mask<<1) | previous);
+                while (starts!=0) {
+                    starts &= starts-1;
+                    count++;
                 }
+                previous = (mask>>15) & 1;
+                p += 16;
             }
-            //fp.close();
+#endif
+            for (;p<end;p++) {
+                unsigned int digit = ((unsigned int)((unsigned char)*p-'0')<=9)?1:0;
+                if (digit && !previous)
+                    count++;
+                previous = digit;
+            }
+            return count;
         }
-    
+
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -47,53 +47,65 @@ void View::initCallbacks(Callbacks *callbacks)
                               { reinterpret_cast<Callbacks *>(glfwGetWindowUserPointer(window))->reshape(width, height); });
 }
 
-void View::init(Callbacks *callbacks, map<string, util::PolygonMesh<VertexAttrib>> &meshes, map<string, util::TextureImage> &images)
+void View::init(Callbacks *callbacks, map<string, util::PolygonMesh<VertexAttrib>> &meshes, map<string, sgraph::PixelHandle> &images)
 {
     this->initGlfw();
     this->initCallbacks(callbacks);
 
+    // Get window dimensions for projection matrix
+    int window_width, window_height;
+    glfwGetFramebufferSize(window, &window_width, &window_height);
+    this->initScene(meshes, images, window_width, window_height);
+
+    // Initialize rendering
+    frames = 0;
+    time = glfwGetTime();
+}
+
+/**
+ * Set up to draw without a window, into a framebuffer object of the given size,
+ * for recording frames on machines with no display.
+ * \return false, with the reason in error, if there is no OpenGL context to draw with
+ */
+bool View::initHeadless(int width, int height, map<string, util::PolygonMesh<VertexAttrib>> &meshes, map<string, sgraph::PixelHandle> &images, string &error)
+{
+    if (!headless.create(width, height, error))
+        return false;
+    this->initScene(meshes, images, width, height);
+    return true;
+}
+
+void View::initScene(map<string, util::PolygonMesh<VertexAttrib>> &meshes, map<string, sgraph::PixelHandle> &images, int width, int height)
+{
     // create the shader program with support for lighting and textures
     program.createProgram(string("shaders/phong-multiple.vert"),
                           string("shaders/phong-multiple.frag"));
     program.enable();
     shaderLocations = program.getAllShaderVariables();
 
-    // Associate shader variables with vertex attributes
-    map<string, string> shaderVarsToVertexAttribs;
-    shaderVarsToVertexAttribs["vPosition"] = "position";
-    shaderVarsToVertexAttribs["vNormal"] = "normal";
-    shaderVarsToVertexAttribs["vTexCoord"] = "texcoord";
-
     // Initialize object instances
     for (typename map<string, util::PolygonMesh<VertexAttrib>>::iterator it = meshes.begin();
          it != meshes.end();
          it++)
     {
-        util::ObjectInstance *obj = new util::ObjectInstance(it->first);
-        obj->initPolygonMesh(shaderLocations, shaderVarsToVertexAttribs, it->second);
-        objects[it->first] = obj;
+        initObject(it->first, it->second);
     }
 
-    // Get window dimensions for projection matrix
-    int window_width, window_height;
-    glfwGetFramebufferSize(window, &window_width, &window_height);
-
     // Prepare the projection matrix for perspective projection
     projection = glm::perspective(glm::radians(60.0f),
-                                  (float)window_width / window_height,
+                                  (float)width / height,
                                   0.1f, 10000.0f);
-    glViewport(0, 0, window_width, window_height);
-
-    // Initialize rendering
-    frames = 0;
-    time = glfwGetTime();
+    glViewport(0, 0, width, height);
 
     // Initialize camera position
     this->thetaX = 0.0f;
     this->thetaY = glm::radians(30.0f);
 
     // Create the scene graph renderer with textures
-    renderer = new sgraph::GLScenegraphRenderer(modelview, objects, images, shaderLocations);
+    sgraph::GLScenegraphRenderer *glRenderer = new sgraph::GLScenegraphRenderer(modelview, objects, images, shaderLocations);
+    glRenderer->setRepeatingMeshes(repeatingMeshes);
+    glRenderer->setMeshes(meshes, set<string>());
+    renderer = glRenderer;
 
     // Configure OpenGL for 3D rendering
     glEnable(GL_DEPTH_TEST);
@@ -101,6 +113,75 @@ void View::init(Callbacks *callbacks, map<string, util::PolygonMesh<VertexAttrib
     glCullFace(GL_BACK);
 }
 
+void View::initObject(const string &name, util::PolygonMesh<VertexAttrib> &mesh)
+{
+    // Associate shader variables with vertex attributes
+    map<string, string> shaderVarsToVertexAttribs;
+    shaderVarsToVertexAttribs["vPosition"] = "position";
+    shaderVarsToVertexAttribs["vNormal"] = "normal";
+    shaderVarsToVertexAttribs["vTexCoord"] = "texcoord";
+
+    util::ObjectInstance *obj = new util::ObjectInstance(name);
+    obj->initPolygonMesh(shaderLocations, shaderVarsToVertexAttribs, mesh);
+    objects[name] = obj;
+
+    // A mesh that repeats its texture cannot draw it from an atlas page
+    const float eps = 1e-3f;
+    vector<VertexAttrib> vertices = mesh.getVertexAttributes();
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        if (!vertices[i].hasData("texcoord"))
+            continue;
+        vector<float> texcoord = vertices[i].getData("texcoord");
+        for (size_t j = 0; (j < texcoord.size()) && (j < 2); j++)
+        {
+            if ((texcoord[j] < -eps) || (texcoord[j] > 1 + eps))
+            {
+                repeatingMeshes.insert(name);
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Bring the GPU copies of the meshes and images up to date after the scene was
+ * reloaded. Object instances are rebuilt only for meshes that are new or listed as
+ * changed, and textures are uploaded again only if their pixels changed.
+ */
+void View::updateAssets(map<string, util::PolygonMesh<VertexAttrib>> &meshes, set<string> &changedMeshes, map<string, sgraph::PixelHandle> &images)
+{
+    for (map<string, util::ObjectInstance *>::iterator it = objects.begin(); it != objects.end();)
+    {
+        if ((meshes.find(it->first) == meshes.end()) || (changedMeshes.count(it->first) > 0))
+        {
+            it->second->cleanup();
+            delete it->second;
+            repeatingMeshes.erase(it->first);
+            it = objects.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+    for (typename map<string, util::PolygonMesh<VertexAttrib>>::iterator it = meshes.begin();
+         it != meshes.end();
+         it++)
+    {
+        if (objects.find(it->first) == objects.end())
+            initObject(it->first, it->second);
+    }
+
+    sgraph::GLScenegraphRenderer *glRenderer = dynamic_cast<sgraph::GLScenegraphRenderer *>(renderer);
+    if (glRenderer != nullptr)
+    {
+        glRenderer->setRepeatingMeshes(repeatingMeshes);
+        glRenderer->setMeshes(meshes, changedMeshes);
+        glRenderer->updateTextures(images);
+    }
+}
+
 void View::display(sgraph::IScenegraph *scenegraph)
 {
     program.enable();
@@ -109,7 +190,6 @@ void View::display(sgraph::IScenegraph *scenegraph)
 
     // Set up the view matrix
     modelview.push(glm::mat4(1.0));
-    float radiusView = 500.0f;
 
     // Calculate camera position based on trackball rotation
     glm::vec3 vRotated = {0, 0, 0};
@@ -133,6 +213,9 @@ void View::display(sgraph::IScenegraph *scenegraph)
         GL_FALSE,
         glm::value_ptr(projection));
 
+    // Bring the world transforms of whatever moved up to date
+    scenegraph->updateWorldTransforms();
+
     // Get all lights in view space
     vector<util::Light> lightsInViewSpace = scenegraph->getAllLightsInViewSpace(viewMatrix);
 
@@ -140,17 +223,26 @@ void View::display(sgraph::IScenegraph *scenegraph)
     sgraph::GLScenegraphRenderer *glRenderer = dynamic_cast<sgraph::GLScenegraphRenderer *>(renderer);
     if (glRenderer != nullptr)
     {
+        glRenderer->setProjection(projection);
         glRenderer->setLights(lightsInViewSpace);
     }
 
     // Draw the scene graph
     scenegraph->getRoot()->accept(renderer);
+    if (glRenderer != nullptr)
+    {
+        glRenderer->flush();
+    }
 
     // Clean up
     modelview.pop();
     glFlush();
     program.disable();
 
+    // Without a window the frame stays in the framebuffer object, to be read back
+    if (window == NULL)
+        return;
+
     // Swap buffers and handle events
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -183,6 +275,32 @@ void View::resetRotation()
     this->upVal = 1;
 }
 
+/**
+ * Put the camera at the given trackball angles, in radians, and distance from the
+ * origin, with up flipped past the poles as adjustRotation does
+ */
+void View::setCamera(float thetaX, float thetaY, float radius)
+{
+    this->thetaX = thetaX;
+    this->thetaY = thetaY;
+    this->radiusView = radius;
+    this->upVal = (cos(thetaY) < 0.0f) ? -1 : 1;
+}
+
+/**
+ * Read back the last frame drawn, as RGB rows from the bottom up
+ */
+void View::readPixels(vector<unsigned char> &pixels, int *width, int *height)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    *width = viewport[2];
+    *height = viewport[3];
+    pixels.resize(3 * (size_t)(*width) * (*height));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(viewport[0], viewport[1], *width, *height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+}
+
 void View::adjustRotation(char axis, float delta)
 {
     if (axis == 'x')
@@ -220,6 +338,11 @@ void View::closeWindow()
         it->second->cleanup();
         delete it->second;
     }
+    if (window == NULL)
+    {
+        headless.destroy();
+        return;
+    }
     glfwDestroyWindow(window);
 
     glfwTerminate();
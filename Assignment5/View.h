@@ -15,8 +15,11 @@
 #include "Callbacks.h"
 #include "sgraph/IScenegraph.h"
 #include "ourutils/Logger.h"
+#include "HeadlessContext.h"
 
+#include <set>
 #include <stack>
+#include <vector>
 using namespace std;
 
 
@@ -27,23 +30,33 @@ public:
     ~View();
     void initGlfw();
     void initCallbacks(Callbacks* callbacks);
-    void init(Callbacks* callbacks,map<string,util::PolygonMesh<VertexAttrib>>& meshes,map<string,util::TextureImage>& images);
+    void init(Callbacks* callbacks,map<string,util::PolygonMesh<VertexAttrib>>& meshes,map<string,sgraph::PixelHandle>& images);
+    bool initHeadless(int width,int height,map<string,util::PolygonMesh<VertexAttrib>>& meshes,map<string,sgraph::PixelHandle>& images,string& error);
+    void updateAssets(map<string,util::PolygonMesh<VertexAttrib>>& meshes,set<string>& changedMeshes,map<string,sgraph::PixelHandle>& images);
     void display(sgraph::IScenegraph *scenegraph);
     bool shouldWindowClose();
     void closeWindow();
     void resetRotation();
     void adjustRotation(char axis, float delta);
+    void setCamera(float thetaX, float thetaY, float radius);
+    void readPixels(vector<unsigned char>& pixels, int *width, int *height);
     void getCursorPosn(double *xpos, double *ypos);
     void getWindowScalars(float *scaleX, float *scaleY);
 
     void setLogger(ourutils::Logger& logger);
 
 private: 
+    void initScene(map<string,util::PolygonMesh<VertexAttrib>>& meshes,map<string,sgraph::PixelHandle>& images,int width,int height);
+    void initObject(const string& name,util::PolygonMesh<VertexAttrib>& mesh);
 
-    GLFWwindow* window;
+    // NULL when drawing headless
+    GLFWwindow* window = NULL;
+    HeadlessContext headless;
     util::ShaderProgram program;
     util::ShaderLocationsVault shaderLocations;
     map<string,util::ObjectInstance *> objects;
+    // meshes whose texture coordinates leave [0,1]
+    set<string> repeatingMeshes;
     glm::mat4 projection;
     stack<glm::mat4> modelview;
     sgraph::SGNodeVisitor *renderer;
@@ -51,6 +64,7 @@ private:
     double time;
     float thetaX;
     float thetaY;
+    float radiusView = 500.0f;
     int upVal = 1;
 
     ourutils::Logger logger;
@@ -0,0 +1,510 @@
+#ifndef _BLOCKCOMPRESSION_H_
+#define _BLOCKCOMPRESSION_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "ThreadPool.h"
+
+namespace ourutils {
+
+/**
+ * An encoder and decoder for two GPU block formats, for opaque RGB images:
+ * BC1 (DXT1), 8 bytes for each 4x4 block, and BC7, 16 bytes for each block.
+ * Images are tightly packed RGB, and blocks follow the rows of the image in
+ * order. A block that sticks out past the right or top of the image repeats
+ * its last column or row.
+ *
+ * Both encoders fit a line through the colours of a block along their main
+ * axis, end it at the furthest colours either way, pick the nearest palette
+ * entry for each pixel, and then fit the ends again by least squares and keep
+ * whichever is closer. BC7 is written in mode 6 only: a single pair of ends
+ * with 16 steps between them. The decoder reads all of BC1 but only mode 6 of
+ * BC7, which is enough to check what the encoder writes.
+ */
+class BlockCompression {
+    public:
+        enum Format {
+            NONE = 0,
+            BC1 = 1,
+            BC7 = 2
+        };
+
+        static size_t blockBytes(Format format) {
+            return (format == BC1) ? 8 : 16;
+        }
+
+        /**
+         * \return the bytes of blocks for an image of this size
+         */
+        static size_t compressedSize(Format format, int width, int height) {
+            return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+        }
+
+        /**
+         * Encode an RGB image. Rows of blocks are shared out in bands on the
+         * shared thread pool.
+         */
+        static void encode(Format format, const unsigned char* rgb, int width, int height, unsigned char* blocks) {
+            int across = (width + 3) / 4;
+            size_t bytes = blockBytes(format);
+            ThreadPool::forBands((height + 3) / 4, across, 4096, [=](size_t first, size_t last) {
+                Block block;
+                for (int by = (int)first; by < (int)last; by++) {
+                    for (int bx = 0; bx < across; bx++) {
+                        fetch(rgb, width, height, bx, by, block);
+                        unsigned char* out = blocks + ((size_t)by * across + bx) * bytes;
+                        if (format == BC1)
+                            encodeBC1(block, out);
+                        else
+                            encodeBC7(block, out);
+                    }
+                }
+            });
+        }
+
+        /**
+         * Decode blocks into an RGB image
+         * \return false if a block is in a BC7 mode other than 6; it is decoded
+         * as black
+         */
+        static bool decode(Format format, const unsigned char* blocks, int width, int height, unsigned char* rgb) {
+            int across = (width + 3) / 4;
+            int down = (height + 3) / 4;
+            size_t bytes = blockBytes(format);
+            bool ok = true;
+            for (int by = 0; by < down; by++) {
+                for (int bx = 0; bx < across; bx++) {
+                    unsigned char texels[16][3];
+                    const unsigned char* in = blocks + ((size_t)by * across + bx) * bytes;
+                    if (format == BC1)
+                        decodeBC1(in, texels);
+                    else if (!decodeBC7(in, texels))
+                        ok = false;
+                    for (int y = 0; y < 4; y++) {
+                        for (int x = 0; x < 4; x++) {
+                            int px = 4 * bx + x;
+                            int py = 4 * by + y;
+                            if ((px < width) && (py < height))
+                                memcpy(rgb + 3 * ((size_t)py * width + px), texels[4 * y + x], 3);
+                        }
+                    }
+                }
+            }
+            return ok;
+        }
+
+    private:
+        /**
+         * The 16 pixels of a block, one array per channel
+         */
+        struct Block {
+            float r[16];
+            float g[16];
+            float b[16];
+        };
+
+        static void fetch(const unsigned char* rgb, int width, int height, int bx, int by, Block& block) {
+            for (int y = 0; y < 4; y++) {
+                int py = std::min(4 * by + y, height - 1);
+                for (int x = 0; x < 4; x++) {
+                    int px = std::min(4 * bx + x, width - 1);
+                    const unsigned char* p = rgb + 3 * ((size_t)py * width + px);
+                    block.r[4 * y + x] = p[0];
+                    block.g[4 * y + x] = p[1];
+                    block.b[4 * y + x] = p[2];
+                }
+            }
+        }
+
+        /**
+         * Find the ends of the line through the colours of a block along their
+         * main axis, from the mean and a few rounds of power iteration on the
+         * covariance
+         */
+        static void principalRange(const Block& block, float low[3], float high[3]) {
+            float mean[3] = {0, 0, 0};
+            for (int i = 0; i < 16; i++) {
+                mean[0] += block.r[i];
+                mean[1] += block.g[i];
+                mean[2] += block.b[i];
+            }
+            for (int c = 0; c < 3; c++)
+                mean[c] /= 16;
+            float cov[6] = {0, 0, 0, 0, 0, 0};
+            for (int i = 0; i < 16; i++) {
+                float r = block.r[i] - mean[0];
+                float g = block.g[i] - mean[1];
+                float b = block.b[i] - mean[2];
+                cov[0] += r * r;
+                cov[1] += r * g;
+                cov[2] += r * b;
+                cov[3] += g * g;
+                cov[4] += g * b;
+                cov[5] += b * b;
+            }
+            // start from the covariance column of the channel that varies most
+            static const int columns[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+            int start = ((cov[0] >= cov[3]) && (cov[0] >= cov[5])) ? 0 : ((cov[3] >= cov[5]) ? 1 : 2);
+            float axis[3] = {cov[columns[start][0]], cov[columns[start][1]], cov[columns[start][2]]};
+            for (int round = 0; round < 8; round++) {
+                float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+                float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+                float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+                float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+                if (length < 1e-6f) {
+                    for (int c = 0; c < 3; c++)
+                        low[c] = high[c] = mean[c];
+                    return;
+                }
+                axis[0] = x / length;
+                axis[1] = y / length;
+                axis[2] = z / length;
+            }
+
+            float lowest, highest;
+#ifdef __SSE2__
+            __m128 ax = _mm_set1_ps(axis[0]), ay = _mm_set1_ps(axis[1]), az = _mm_set1_ps(axis[2]);
+            __m128 mr = _mm_set1_ps(mean[0]), mg = _mm_set1_ps(mean[1]), mb = _mm_set1_ps(mean[2]);
+            __m128 least = _mm_set1_ps(1e30f), most = _mm_set1_ps(-1e30f);
+            for (int i = 0; i < 16; i += 4) {
+                __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block.r + i), mr), ax),
+                                                 _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block.g + i), mg), ay)),
+                                      _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(block.b + i), mb), az));
+                least = _mm_min_ps(least, t);
+                most = _mm_max_ps(most, t);
+            }
+            float lows[4], highs[4];
+            _mm_storeu_ps(lows, least);
+            _mm_storeu_ps(highs, most);
+            lowest = std::min(std::min(lows[0], lows[1]), std::min(lows[2], lows[3]));
+            highest = std::max(std::max(highs[0], highs[1]), std::max(highs[2], highs[3]));
+#else
+            lowest = 1e30f;
+            highest = -1e30f;
+            for (int i = 0; i < 16; i++) {
+                float t = (block.r[i] - mean[0]) * axis[0] + (block.g[i] - mean[1]) * axis[1] +
+                          (block.b[i] - mean[2]) * axis[2];
+                lowest = std::min(lowest, t);
+                highest = std::max(highest, t);
+            }
+#endif
+            for (int c = 0; c < 3; c++) {
+                low[c] = clamp(mean[c] + lowest * axis[c]);
+                high[c] = clamp(mean[c] + highest * axis[c]);
+            }
+        }
+
+        /**
+         * Pick the nearest of count palette colours for each pixel, four pixels
+         * at a time where SSE2 is available
+         * \return the summed squared error
+         */
+        static float nearest(const Block& block, const float palette[][3], int count, int indices[16]) {
+            float error = 0;
+#ifdef __SSE2__
+            for (int i = 0; i < 16; i += 4) {
+                __m128 r = _mm_loadu_ps(block.r + i);
+                __m128 g = _mm_loadu_ps(block.g + i);
+                __m128 b = _mm_loadu_ps(block.b + i);
+                __m128 best = _mm_set1_ps(1e30f);
+                __m128i bestIndex = _mm_setzero_si128();
+                for (int p = 0; p < count; p++) {
+                    __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+                    __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+                    __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+                    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+                    __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+                    best = _mm_min_ps(best, d);
+                    bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)),
+                                             _mm_andnot_si128(closer, bestIndex));
+                }
+                float distances[4];
+                _mm_storeu_ps(distances, best);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), bestIndex);
+                error += distances[0] + distances[1] + distances[2] + distances[3];
+            }
+#else
+            for (int i = 0; i < 16; i++) {
+                float best = 1e30f;
+                for (int p = 0; p < count; p++) {
+                    float dr = block.r[i] - palette[p][0];
+                    float dg = block.g[i] - palette[p][1];
+                    float db = block.b[i] - palette[p][2];
+                    float d = dr * dr + dg * dg + db * db;
+                    if (d < best) {
+                        best = d;
+                        indices[i] = p;
+                    }
+                }
+                error += best;
+            }
+#endif
+            return error;
+        }
+
+        /**
+         * Fit the two ends by least squares, given the index of each pixel and
+         * the weight of the second end in each palette entry
+         * \return false if the pixels do not pin the ends down
+         */
+        static bool leastSquares(const Block& block, const int indices[16], const float* weights, float first[3],
+                                 float second[3]) {
+            float aa = 0, ab = 0, bb = 0;
+            float ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+            for (int i = 0; i < 16; i++) {
+                float w = weights[indices[i]];
+                float v = 1 - w;
+                aa += v * v;
+                ab += v * w;
+                bb += w * w;
+                float p[3] = {block.r[i], block.g[i], block.b[i]};
+                for (int c = 0; c < 3; c++) {
+                    ax[c] += v * p[c];
+                    bx[c] += w * p[c];
+                }
+            }
+            float det = aa * bb - ab * ab;
+            if (std::fabs(det) < 1e-6f)
+                return false;
+            for (int c = 0; c < 3; c++) {
+                first[c] = clamp((bb * ax[c] - ab * bx[c]) / det);
+                second[c] = clamp((aa * bx[c] - ab * ax[c]) / det);
+            }
+            return true;
+        }
+
+        static float clamp(float v) {
+            return std::min(255.0f, std::max(0.0f, v));
+        }
+
+        static uint16_t pack565(const float c[3]) {
+            int r = (int)(c[0] * 31 / 255 + 0.5f);
+            int g = (int)(c[1] * 63 / 255 + 0.5f);
+            int b = (int)(c[2] * 31 / 255 + 0.5f);
+            return (uint16_t)((r << 11) | (g << 5) | b);
+        }
+
+        static void unpack565(uint16_t c, int out[3]) {
+            int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+            out[0] = (r << 3) | (r >> 2);
+            out[1] = (g << 2) | (g >> 4);
+            out[2] = (b << 3) | (b >> 2);
+        }
+
+        /**
+         * The four colours of a BC1 block, or three and black if the first end
+         * is not greater than the second
+         */
+        static void paletteBC1(uint16_t c0, uint16_t c1, int palette[4][3]) {
+            unpack565(c0, palette[0]);
+            unpack565(c1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                if (c0 > c1) {
+                    palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+                    palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+                } else {
+                    palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                    palette[3][c] = 0;
+                }
+            }
+        }
+
+        /**
+         * Pick indices for a pair of ends, written greater end first so that the
+         * block has four colours
+         */
+        static float tryBC1(const Block& block, uint16_t c0, uint16_t c1, int indices[16]) {
+            int colours[4][3];
+            paletteBC1(std::max(c0, c1), std::min(c0, c1), colours);
+            float palette[4][3];
+            for (int p = 0; p < 4; p++) {
+                for (int c = 0; c < 3; c++)
+                    palette[p][c] = (float)colours[p][c];
+            }
+            // equal ends make a three colour block, and every pixel takes the first
+            return nearest(block, palette, (c0 == c1) ? 1 : 4, indices);
+        }
+
+        static void encodeBC1(const Block& block, unsigned char* out) {
+            static const float weights[4] = {0, 1, 1.0f / 3, 2.0f / 3};
+            float low[3], high[3];
+            principalRange(block, low, high);
+            uint16_t c0 = pack565(high), c1 = pack565(low);
+            if (c0 < c1)
+                std::swap(c0, c1);
+            int indices[16];
+            float error = tryBC1(block, c0, c1, indices);
+            float first[3], second[3];
+            if ((c0 != c1) && leastSquares(block, indices, weights, first, second)) {
+                uint16_t f0 = pack565(first), f1 = pack565(second);
+                int fitted[16];
+                if ((f0 != f1) && (tryBC1(block, f0, f1, fitted) < error)) {
+                    c0 = std::max(f0, f1);
+                    c1 = std::min(f0, f1);
+                    memcpy(indices, fitted, sizeof(fitted));
+                }
+            }
+            uint32_t bits = 0;
+            for (int i = 0; i < 16; i++)
+                bits |= (uint32_t)indices[i] << (2 * i);
+            out[0] = (unsigned char)c0;
+            out[1] = (unsigned char)(c0 >> 8);
+            out[2] = (unsigned char)c1;
+            out[3] = (unsigned char)(c1 >> 8);
+            for (int i = 0; i < 4; i++)
+                out[4 + i] = (unsigned char)(bits >> (8 * i));
+        }
+
+        static void decodeBC1(const unsigned char* in, unsigned char texels[16][3]) {
+            uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+            uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+            uint32_t bits = (uint32_t)in[4] | ((uint32_t)in[5] << 8) | ((uint32_t)in[6] << 16) | ((uint32_t)in[7] << 24);
+            int palette[4][3];
+            paletteBC1(c0, c1, palette);
+            for (int i = 0; i < 16; i++) {
+                int index = (bits >> (2 * i)) & 3;
+                for (int c = 0; c < 3; c++)
+                    texels[i][c] = (unsigned char)palette[index][c];
+            }
+        }
+
+        static const int* weightsBC7() {
+            static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+            return weights;
+        }
+
+        /**
+         * Mode 6 ends have 7 bits and a shared low bit; with alpha at 255 the low
+         * bit is always 1, so each colour channel is odd
+         */
+        static int quantizeBC7(float v) {
+            return std::min(127, std::max(0, (int)((v - 1) / 2 + 0.5f)));
+        }
+
+        static float tryBC7(const Block& block, const int e0[3], const int e1[3], int indices[16]) {
+            float palette[16][3];
+            for (int p = 0; p < 16; p++) {
+                int w = weightsBC7()[p];
+                for (int c = 0; c < 3; c++)
+                    palette[p][c] = (float)(((64 - w) * (2 * e0[c] + 1) + w * (2 * e1[c] + 1) + 32) >> 6);
+            }
+            return nearest(block, palette, 16, indices);
+        }
+
+        static void encodeBC7(const Block& block, unsigned char* out) {
+            float weights[16];
+            for (int p = 0; p < 16; p++)
+                weights[p] = weightsBC7()[p] / 64.0f;
+            float low[3], high[3];
+            principalRange(block, low, high);
+            int e0[3], e1[3];
+            for (int c = 0; c < 3; c++) {
+                e0[c] = quantizeBC7(low[c]);
+                e1[c] = quantizeBC7(high[c]);
+            }
+            int indices[16];
+            float error = tryBC7(block, e0, e1, indices);
+            float first[3], second[3];
+            if (leastSquares(block, indices, weights, first, second)) {
+                int f0[3], f1[3];
+                for (int c = 0; c < 3; c++) {
+                    f0[c] = quantizeBC7(first[c]);
+                    f1[c] = quantizeBC7(second[c]);
+                }
+                int fitted[16];
+                if (tryBC7(block, f0, f1, fitted) < error) {
+                    memcpy(e0, f0, sizeof(f0));
+                    memcpy(e1, f1, sizeof(f1));
+                    memcpy(indices, fitted, sizeof(fitted));
+                }
+            }
+            // the first index is stored without its top bit
+            if (indices[0] >= 8) {
+                for (int c = 0; c < 3; c++)
+                    std::swap(e0[c], e1[c]);
+                for (int i = 0; i < 16; i++)
+                    indices[i] = 15 - indices[i];
+            }
+
+            BitWriter writer(out);
+            writer.put(1 << 6, 7);
+            for (int c = 0; c < 3; c++) {
+                writer.put(e0[c], 7);
+                writer.put(e1[c], 7);
+            }
+            writer.put(127, 7);
+            writer.put(127, 7);
+            writer.put(1, 1);
+            writer.put(1, 1);
+            writer.put(indices[0], 3);
+            for (int i = 1; i < 16; i++)
+                writer.put(indices[i], 4);
+        }
+
+        static bool decodeBC7(const unsigned char* in, unsigned char texels[16][3]) {
+            if ((in[0] & 0x7F) != 0x40) {
+                memset(texels, 0, 16 * 3);
+                return false;
+            }
+            BitReader reader(in);
+            reader.get(7);
+            int ends[2][4];
+            for (int c = 0; c < 4; c++) {
+                ends[0][c] = reader.get(7) << 1;
+                ends[1][c] = reader.get(7) << 1;
+            }
+            int p0 = reader.get(1), p1 = reader.get(1);
+            for (int c = 0; c < 4; c++) {
+                ends[0][c] |= p0;
+                ends[1][c] |= p1;
+            }
+            for (int i = 0; i < 16; i++) {
+                int w = weightsBC7()[reader.get((i == 0) ? 3 : 4)];
+                for (int c = 0; c < 3; c++)
+                    texels[i][c] = (unsigned char)(((64 - w) * ends[0][c] + w * ends[1][c] + 32) >> 6);
+            }
+            return true;
+        }
+
+        /**
+         * Writes fields into a 16-byte block, from the lowest bit of the first
+         * byte up
+         */
+        struct BitWriter {
+            unsigned char* out;
+            int at;
+
+            explicit BitWriter(unsigned char* out) : out(out), at(0) { memset(out, 0, 16); }
+
+            void put(int value, int bits) {
+                for (int i = 0; i < bits; i++, at++) {
+                    if ((value >> i) & 1)
+                        out[at >> 3] |= (unsigned char)(1 << (at & 7));
+                }
+            }
+        };
+
+        struct BitReader {
+            const unsigned char* in;
+            int at;
+
+            explicit BitReader(const unsigned char* in) : in(in), at(0) {}
+
+            int get(int bits) {
+                int value = 0;
+                for (int i = 0; i < bits; i++, at++)
+                    value |= ((in[at >> 3] >> (at & 7)) & 1) << i;
+                return value;
+            }
+        };
+};
+
+} // namespace ourutils
+
+#endif
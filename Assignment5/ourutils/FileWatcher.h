@@ -0,0 +1,93 @@
+#ifndef _FILEWATCHER_H_
+#define _FILEWATCHER_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+namespace ourutils {
+
+/**
+ * Polls a set of files for changes to their modification time or size. The files
+ * are checked at most once per interval, so it is cheap to poll every frame.
+ */
+class FileWatcher {
+    public:
+        FileWatcher(double intervalSeconds = 0.25) : interval(intervalSeconds) {}
+
+        /**
+         * Start watching these files instead of the ones watched so far
+         */
+        void watch(const std::vector<std::string>& paths) {
+            files.clear();
+            for (size_t i = 0; i < paths.size(); i++) {
+                Watched file;
+                file.path = paths[i];
+                file.stamp = stampOf(paths[i]);
+                files.push_back(file);
+            }
+            lastCheck = std::chrono::steady_clock::now();
+        }
+
+        /**
+         * \return true if any watched file changed since the last time this
+         * returned true (or since watch was called)
+         */
+        bool changed() {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (std::chrono::duration<double>(now - lastCheck).count() < interval)
+                return false;
+            lastCheck = now;
+            bool any = false;
+            for (size_t i = 0; i < files.size(); i++) {
+                Stamp stamp = stampOf(files[i].path);
+                if ((stamp.mtime != files[i].stamp.mtime) || (stamp.size != files[i].stamp.size)) {
+                    files[i].stamp = stamp;
+                    any = true;
+                }
+            }
+            return any;
+        }
+
+    private:
+        struct Stamp {
+            long long mtime;
+            long long size;
+        };
+
+        struct Watched {
+            std::string path;
+            Stamp stamp;
+        };
+
+        /**
+         * A missing file gets an all-zero stamp, so that it reads as changed when
+         * it comes back (editors often save by replacing the file)
+         */
+        static Stamp stampOf(const std::string& path) {
+            Stamp stamp;
+            stamp.mtime = 0;
+            stamp.size = 0;
+            struct stat info;
+            if (stat(path.c_str(), &info) == 0) {
+#if defined(__APPLE__)
+                stamp.mtime = (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+                stamp.mtime = (long long)info.st_mtime * 1000000000LL;
+#else
+                stamp.mtime = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+                stamp.size = (long long)info.st_size;
+            }
+            return stamp;
+        }
+
+        std::vector<Watched> files;
+        double interval;
+        std::chrono::steady_clock::time_point lastCheck;
+};
+
+}
+
+#endif
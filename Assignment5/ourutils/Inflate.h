@@ -0,0 +1,382 @@
+#ifndef _INFLATE_H_
+#define _INFLATE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace ourutils {
+
+/**
+ * A decoder for zlib streams (RFC 1950) holding DEFLATE data (RFC 1951). Bits
+ * are read from a 64-bit buffer that is refilled up to eight bytes at a time,
+ * and Huffman codes of up to 10 bits are decoded with a single table lookup;
+ * longer codes, which are rare, are found by walking the canonical code lengths.
+ * The checksum at the end of the stream is not verified.
+ */
+class Inflate {
+    public:
+        /**
+         * Decompress a zlib stream, appending to out. If the decompressed size
+         * is known, reserving it in out avoids any reallocation.
+         * \return false if the stream is malformed or truncated
+         */
+        static bool zlib(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+            if (size < 2)
+                return false;
+            unsigned int cmf = data[0];
+            unsigned int flg = data[1];
+            // deflate only, no preset dictionary
+            if (((cmf * 256 + flg) % 31 != 0) || ((cmf & 15) != 8) || ((flg & 32) != 0))
+                return false;
+            Inflate inflater(data + 2, data + size, out);
+            return inflater.run();
+        }
+
+    private:
+        /**
+         * A canonical Huffman code
+         */
+        struct Huffman {
+            static const int FAST_BITS = 10;
+            uint16_t fast[1 << FAST_BITS];  // length << 9 | symbol, or 0 for a longer code
+            uint16_t firstCode[16];
+            uint16_t firstSymbol[16];
+            uint32_t maxCode[17];
+            uint8_t lengths[288];
+            uint16_t symbols[288];
+
+            /**
+             * \return false if the lengths do not make a valid code
+             */
+            bool build(const uint8_t* codeLengths, int count) {
+                int sizes[17];
+                int nextCode[16];
+                memset(sizes, 0, sizeof(sizes));
+                memset(fast, 0, sizeof(fast));
+                for (int i = 0; i < count; i++)
+                    sizes[codeLengths[i]]++;
+                sizes[0] = 0;
+                int code = 0;
+                int k = 0;
+                for (int i = 1; i < 16; i++) {
+                    nextCode[i] = code;
+                    firstCode[i] = (uint16_t)code;
+                    firstSymbol[i] = (uint16_t)k;
+                    code += sizes[i];
+                    if ((sizes[i] != 0) && (code - 1 >= (1 << i)))
+                        return false;
+                    maxCode[i] = (uint32_t)code << (16 - i);
+                    code <<= 1;
+                    k += sizes[i];
+                }
+                maxCode[16] = 0x10000;
+                for (int i = 0; i < count; i++) {
+                    int length = codeLengths[i];
+                    if (length == 0)
+                        continue;
+                    int index = nextCode[length] - firstCode[length] + firstSymbol[length];
+                    lengths[index] = (uint8_t)length;
+                    symbols[index] = (uint16_t)i;
+                    if (length <= FAST_BITS) {
+                        uint16_t entry = (uint16_t)((length << 9) | i);
+                        for (int j = reverse(nextCode[length], length); j < (1 << FAST_BITS); j += 1 << length)
+                            fast[j] = entry;
+                    }
+                    nextCode[length]++;
+                }
+                return true;
+            }
+        };
+
+        /**
+         * The position in the compressed stream. The decoding loop keeps a copy
+         * of this in locals, so the compiler need not reload it after every byte
+         * written to the output.
+         */
+        struct BitReader {
+            const unsigned char* in;
+            const unsigned char* end;
+            uint64_t bits;
+            int bitCount;
+            size_t overrun;
+
+            inline void refill() {
+                if (end - in >= 8) {
+                    // as many whole bytes as fit, in the stream's little-endian bit order; the
+                    // first bits of the next byte land above bitCount too, and the next refill
+                    // puts the same bits in the same place
+                    uint64_t word = 0;
+                    for (int i = 0; i < 8; i++)
+                        word |= (uint64_t)in[i] << (8 * i);
+                    bits |= word << bitCount;
+                    in += (63 - bitCount) >> 3;
+                    bitCount |= 56;
+                    return;
+                }
+                while (bitCount <= 56) {
+                    if (in < end) {
+                        bits |= (uint64_t)*in++ << bitCount;
+                    } else {
+                        // past the end the stream reads as zeros, which is an error if used
+                        overrun++;
+                    }
+                    bitCount += 8;
+                }
+            }
+
+            inline unsigned int take(int count) {
+                if (bitCount < count)
+                    refill();
+                unsigned int value = (unsigned int)(bits & ((1ULL << count) - 1));
+                bits >>= count;
+                bitCount -= count;
+                return value;
+            }
+
+            /**
+             * \return the next symbol, or -1 for an invalid code
+             */
+            inline int decode(const Huffman& code) {
+                if (bitCount < 16)
+                    refill();
+                int entry = code.fast[bits & ((1 << Huffman::FAST_BITS) - 1)];
+                if (entry != 0) {
+                    int length = entry >> 9;
+                    bits >>= length;
+                    bitCount -= length;
+                    return entry & 511;
+                }
+                unsigned int k = (unsigned int)(bits & 0xffff);
+                k = ((k & 0xaaaa) >> 1) | ((k & 0x5555) << 1);
+                k = ((k & 0xcccc) >> 2) | ((k & 0x3333) << 2);
+                k = ((k & 0xf0f0) >> 4) | ((k & 0x0f0f) << 4);
+                k = ((k & 0xff00) >> 8) | ((k & 0x00ff) << 8);
+                int length = Huffman::FAST_BITS + 1;
+                while ((length < 16) && (k >= code.maxCode[length]))
+                    length++;
+                if (length >= 16)
+                    return -1;
+                int index = (int)(k >> (16 - length)) - code.firstCode[length] + code.firstSymbol[length];
+                if ((index < 0) || (index >= 288) || (code.lengths[index] != length))
+                    return -1;
+                bits >>= length;
+                bitCount -= length;
+                return code.symbols[index];
+            }
+
+            /**
+             * \return true if bits past the end of the stream were used
+             */
+            inline bool isOverrun() const { return overrun * 8 > (size_t)bitCount; }
+        };
+
+        Inflate(const unsigned char* begin, const unsigned char* end, std::vector<unsigned char>& out)
+            : out(out), position(out.size()) {
+            reader.in = begin;
+            reader.end = end;
+            reader.bits = 0;
+            reader.bitCount = 0;
+            reader.overrun = 0;
+            out.resize(out.capacity());
+        }
+
+        static int reverse(int code, int length) {
+            int reversed = 0;
+            for (int i = 0; i < length; i++) {
+                reversed = (reversed << 1) | (code & 1);
+                code >>= 1;
+            }
+            return reversed;
+        }
+
+        inline unsigned char* reserve(size_t count) {
+            if (position + count > out.size())
+                out.resize(std::max(2 * out.size(), position + count));
+            return out.data() + position;
+        }
+
+        bool run() {
+            bool last = false;
+            while (!last) {
+                last = reader.take(1) != 0;
+                unsigned int type = reader.take(2);
+                bool ok;
+                if (type == 0) {
+                    ok = stored();
+                } else if (type == 1) {
+                    ok = fixedCodes() && compressed();
+                } else if (type == 2) {
+                    ok = dynamicCodes() && compressed();
+                } else {
+                    ok = false;
+                }
+                if (!ok || reader.isOverrun())
+                    return false;
+            }
+            out.resize(position);
+            return true;
+        }
+
+        bool stored() {
+            reader.take(reader.bitCount & 7);
+            unsigned int length = reader.take(16);
+            unsigned int complement = reader.take(16);
+            if ((length ^ 0xffff) != complement)
+                return false;
+            unsigned char* target = reserve(length);
+            // bytes already in the bit buffer come first
+            while ((length > 0) && (reader.bitCount >= 8)) {
+                *target++ = (unsigned char)reader.take(8);
+                position++;
+                length--;
+            }
+            if (reader.isOverrun() || ((size_t)(reader.end - reader.in) < length))
+                return false;
+            if (length > 0) {
+                // the buffer is empty, but may hold stray bits of the byte at in
+                reader.bits = 0;
+                memcpy(target, reader.in, length);
+                reader.in += length;
+                position += length;
+            }
+            return true;
+        }
+
+        bool fixedCodes() {
+            uint8_t codeLengths[288 + 32];
+            for (int i = 0; i < 288; i++)
+                codeLengths[i] = (uint8_t)((i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8);
+            for (int i = 0; i < 32; i++)
+                codeLengths[288 + i] = 5;
+            return literals.build(codeLengths, 288) && distances.build(codeLengths + 288, 32);
+        }
+
+        bool dynamicCodes() {
+            static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            int literalCount = (int)reader.take(5) + 257;
+            int distanceCount = (int)reader.take(5) + 1;
+            int lengthCount = (int)reader.take(4) + 4;
+            if ((literalCount > 286) || (distanceCount > 30))
+                return false;
+            uint8_t lengthLengths[19];
+            memset(lengthLengths, 0, sizeof(lengthLengths));
+            for (int i = 0; i < lengthCount; i++)
+                lengthLengths[order[i]] = (uint8_t)reader.take(3);
+            Huffman lengthCode;
+            if (!lengthCode.build(lengthLengths, 19))
+                return false;
+
+            uint8_t codeLengths[286 + 30];
+            int total = literalCount + distanceCount;
+            int n = 0;
+            while (n < total) {
+                int symbol = reader.decode(lengthCode);
+                if (symbol < 0)
+                    return false;
+                if (symbol < 16) {
+                    codeLengths[n++] = (uint8_t)symbol;
+                    continue;
+                }
+                int repeat;
+                uint8_t value = 0;
+                if (symbol == 16) {
+                    if (n == 0)
+                        return false;
+                    value = codeLengths[n - 1];
+                    repeat = 3 + (int)reader.take(2);
+                } else if (symbol == 17) {
+                    repeat = 3 + (int)reader.take(3);
+                } else {
+                    repeat = 11 + (int)reader.take(7);
+                }
+                if (n + repeat > total)
+                    return false;
+                memset(codeLengths + n, value, repeat);
+                n += repeat;
+            }
+            return literals.build(codeLengths, literalCount) &&
+                   distances.build(codeLengths + literalCount, distanceCount);
+        }
+
+        bool compressed() {
+            static const uint16_t lengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                                    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+            static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+            static const uint16_t distanceBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                                      33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                                      1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+            static const uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                      6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+            BitReader local = reader;
+            unsigned char* base = out.data();
+            size_t capacity = out.size();
+            size_t at = position;
+            bool ok = false;
+            while (true) {
+                int symbol = local.decode(literals);
+                // a truncated stream would otherwise decode its zero padding forever
+                if (local.overrun > 8)
+                    break;
+                if (symbol < 256) {
+                    if (symbol < 0)
+                        break;
+                    if (at == capacity) {
+                        position = at;
+                        base = reserve(1) - at;
+                        capacity = out.size();
+                    }
+                    base[at++] = (unsigned char)symbol;
+                    continue;
+                }
+                if (symbol == 256) {
+                    ok = !local.isOverrun();
+                    break;
+                }
+                symbol -= 257;
+                if (symbol >= 29)
+                    break;
+                size_t length = lengthBase[symbol] + local.take(lengthExtra[symbol]);
+                int distanceSymbol = local.decode(distances);
+                if ((distanceSymbol < 0) || (distanceSymbol >= 30))
+                    break;
+                size_t distance = distanceBase[distanceSymbol] + local.take(distanceExtra[distanceSymbol]);
+                if (distance > at)
+                    break;
+                if (at + length > capacity) {
+                    position = at;
+                    base = reserve(length) - at;
+                    capacity = out.size();
+                }
+                unsigned char* target = base + at;
+                const unsigned char* source = target - distance;
+                if (distance == 1) {
+                    memset(target, *source, length);
+                } else if (distance >= length) {
+                    memcpy(target, source, length);
+                } else {
+                    for (size_t i = 0; i < length; i++)
+                        target[i] = source[i];
+                }
+                at += length;
+            }
+            reader = local;
+            position = at;
+            return ok;
+        }
+
+        Inflate(const Inflate&);
+        Inflate& operator=(const Inflate&);
+
+        BitReader reader;
+        std::vector<unsigned char>& out;
+        size_t position;
+        Huffman literals;
+        Huffman distances;
+};
+
+} // namespace ourutils
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ourutils {
+
+/**
+ * A read-only view of a whole file. On POSIX systems the file is memory-mapped,
+ * so nothing is copied until a page is actually touched. Elsewhere the file is
+ * read into a buffer once, which keeps the same interface.
+ */
+class MappedFile {
+    public:
+        MappedFile() : bytes(NULL), length(0), mapped(false) {}
+        ~MappedFile() { close(); }
+
+        /**
+         * Map the file at the given path, releasing any previously mapped file
+         * \return true if the file could be opened
+         */
+        bool open(const std::string& path) {
+            close();
+#ifndef _WIN32
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat info;
+            if (fstat(fd, &info) != 0) {
+                ::close(fd);
+                return false;
+            }
+            length = (size_t)info.st_size;
+            if (length > 0) {
+                void* region = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (region == MAP_FAILED) {
+                    ::close(fd);
+                    length = 0;
+                    return false;
+                }
+                madvise(region, length, MADV_SEQUENTIAL);
+                bytes = static_cast<const char*>(region);
+                mapped = true;
+            }
+            ::close(fd);
+            return true;
+#else
+            std::ifstream in(path.c_str(), std::ios::binary);
+            if (!in.is_open())
+                return false;
+            buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            bytes = buffer.empty() ? NULL : &buffer[0];
+            length = buffer.size();
+            return true;
+#endif
+        }
+
+        void close() {
+#ifndef _WIN32
+            if (mapped)
+                munmap(const_cast<char*>(bytes), length);
+#endif
+            buffer.clear();
+            bytes = NULL;
+            length = 0;
+            mapped = false;
+        }
+
+        inline const char* data() const { return bytes; }
+        inline const char* end() const { return bytes + length; }
+        inline size_t size() const { return length; }
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+        const char* bytes;
+        size_t length;
+        bool mapped;
+        std::vector<char> buffer;
+};
+
+} // namespace ourutils
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace ourutils {
+
+/**
+ * A fixed set of worker threads that run submitted tasks in the order they were
+ * submitted. Each task's result (or exception) is handed back through a future.
+ *
+ * Besides pools of its own, such as the one SceneAssetLoader loads assets on,
+ * the process has one shared pool that parallelFor splits a single large job
+ * over. A job split from a worker of any pool runs on that worker alone, since
+ * the pool it is on already keeps every hardware thread busy.
+ */
+class ThreadPool {
+    public:
+        /**
+         * \param threads number of workers, or 0 to use one per hardware thread
+         */
+        explicit ThreadPool(unsigned int threads = 0) : stopping(false) {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            try {
+                for (unsigned int i = 0; i < threads; i++)
+                    workers.push_back(std::thread(&ThreadPool::work, this));
+            } catch (std::system_error&) {
+                // make do with the workers that started; with none, submit runs tasks itself
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_all();
+            for (size_t i = 0; i < workers.size(); i++)
+                workers[i].join();
+        }
+
+        template <class F>
+        std::future<typename std::result_of<F()>::type> submit(F task) {
+            typedef typename std::result_of<F()>::type Result;
+            std::shared_ptr<std::packaged_task<Result()> > packaged =
+                std::make_shared<std::packaged_task<Result()> >(task);
+            std::future<Result> result = packaged->get_future();
+            if (workers.empty()) {
+                (*packaged)();
+                return result;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push_back([packaged]() { (*packaged)(); });
+            }
+            wakeup.notify_one();
+            return result;
+        }
+
+        size_t size() const { return workers.size(); }
+
+        /**
+         * The pool that large jobs are split over, with one worker per hardware
+         * thread, started the first time it is needed
+         */
+        static ThreadPool& shared() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        /**
+         * \return true on a worker of any pool
+         */
+        static bool onWorker() { return workerFlag(); }
+
+        /**
+         * \return how many pieces to split a job of this many units into, so that
+         * each piece has at least grain units and the shared pool and the calling
+         * thread each get at most one; 1 on a worker
+         */
+        static unsigned int piecesFor(size_t units, size_t grain) {
+            if (onWorker())
+                return 1;
+            size_t pieces = std::max<size_t>(1, shared().size());
+            return (unsigned int)std::min(pieces, units / std::max<size_t>(grain, 1) + 1);
+        }
+
+        /**
+         * Run body(i) for each i in [0,count), piece 0 on the calling thread and
+         * the rest on the shared pool, and wait for them all. On a worker the
+         * pieces run one after another instead. If any piece throws, the first
+         * exception is rethrown once every piece has finished.
+         */
+        template <class F>
+        static void parallelFor(unsigned int count, F body) {
+            if ((count <= 1) || onWorker()) {
+                for (unsigned int i = 0; i < count; i++)
+                    body(i);
+                return;
+            }
+            ThreadPool& pool = shared();
+            std::vector<std::future<void> > pieces;
+            for (unsigned int i = 1; i < count; i++)
+                pieces.push_back(pool.submit([&body, i]() { body(i); }));
+            std::exception_ptr failure;
+            try {
+                body(0);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            for (size_t i = 0; i < pieces.size(); i++) {
+                try {
+                    pieces[i].get();
+                } catch (...) {
+                    if (!failure)
+                        failure = std::current_exception();
+                }
+            }
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+
+        /**
+         * Run body(first, last) for bands of rows that together cover [0,rows),
+         * as parallelFor runs its pieces, with as many bands as piecesFor gives
+         * for unitsPerRow units in each row
+         */
+        template <class F>
+        static void forBands(size_t rows, size_t unitsPerRow, size_t grain, F body) {
+            unsigned int bands = piecesFor(rows * unitsPerRow, grain);
+            parallelFor(bands, [&](unsigned int t) { body(rows * t / bands, rows * (t + 1) / bands); });
+        }
+
+    private:
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+
+        static bool& workerFlag() {
+            static thread_local bool worker = false;
+            return worker;
+        }
+
+        void work() {
+            workerFlag() = true;
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeup.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                    if (tasks.empty())
+                        return;
+                    task = tasks.front();
+                    tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > tasks;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        bool stopping;
+};
+
+} // namespace ourutils
+
+#endif
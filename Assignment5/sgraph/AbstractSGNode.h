@@ -3,6 +3,7 @@
 
 #include "SGNode.h"
 #include "IScenegraph.h"
+#include "Symbol.h"
 #include "glm/glm.hpp"
 #include <string>
 using namespace std;
@@ -19,7 +20,7 @@ namespace sgraph
      * The name given to this node
      */
   protected:
-    string name;
+    Symbol name;
     /**
      * The parent of this node. Each node except the root has a parent. The root's parent is null
      */
@@ -28,12 +29,16 @@ namespace sgraph
      * A reference to the sgraph::IScenegraph object that this is part of
      */
     sgraph::IScenegraph *scenegraph;
+    /**
+     * The box around this subtree in world coordinates, as of the last update
+     */
+    BoundingBox worldBounds;
 
   public:
-    AbstractSGNode(const string& name,sgraph::IScenegraph *graph) {
+    AbstractSGNode(Symbol name,sgraph::IScenegraph *graph) {
       this->parent = NULL;
       scenegraph = graph;
-      setName(name);
+      this->name = name;
     }
 
     /**
@@ -43,7 +48,7 @@ namespace sgraph
      * \return the node whose name this is, null otherwise
      */
     SGNode *getNode(const string& name) {
-      if (this->name == name)
+      if (this->name.str() == name)
         return this;
 
       return NULL;
@@ -58,6 +63,12 @@ namespace sgraph
       this->parent = parent;
     }
 
+    /**
+     * Gets the parent of this node
+     * \return the parent of this node, or null if it has none
+     */
+    SGNode *getParent() { return parent; }
+
     /**
      * Sets the scene graph object whose part this node is and then adds itself
      * to the scenegraph (in case the scene graph ever needs to directly access this node)
@@ -73,14 +84,33 @@ namespace sgraph
      * \param name the name of this node
      */
     void setName(const string& name) {
-      this->name = name;
+      this->name = Symbol(name);
     }
 
     /**
      * Gets the name of this node
      * \return the name of this node
      */
-    string getName() { return name;}
+    const string& getName() { return name.str();}
+
+    /**
+     * Gets the name of this node as a symbol, which compares and hashes as an int
+     * \return the name of this node
+     */
+    Symbol getNameSymbol() { return name;}
+
+    /**
+     * By default a node has no world transform or bounds of its own, so there is nothing
+     * to update. Nodes that have children or geometry should override this method
+     */
+    void updateWorldTransforms(const glm::mat4 &parentWorld,const glm::mat3 &parentNormal,bool parentMoved,const MeshBounds &meshBounds) {}
+
+    const BoundingBox& getWorldBounds() { return worldBounds;}
+
+    /**
+     * By default a node covers nothing
+     */
+    void addBounds(const glm::mat4 &frame,const MeshBounds &meshBounds,BoundingBox &bounds) {}
 
   };
 }
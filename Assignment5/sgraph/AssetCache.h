@@ -0,0 +1,349 @@
+#ifndef _ASSETCACHE_H_
+#define _ASSETCACHE_H_
+
+#include "ObjImporter.h"
+#include "PolygonMesh.h"
+#include "VertexAttrib.h"
+#include "MipChain.h"
+#include "PixelBuffer.h"
+#include "TextureDiskCache.h"
+#include "../PNGImageLoader.h"
+#include "../PPMImageLoader.h"
+#include "../ourutils/MappedFile.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * A mesh decoded from an OBJ file
+ */
+struct LoadedMesh {
+    bool found;
+    util::PolygonMesh<VertexAttrib> mesh;
+};
+
+/**
+ * An image decoded from an image file, with all its mip levels. The pixels are
+ * shared by everything that loads the same file.
+ */
+struct LoadedImage {
+    PixelHandle pixels;
+};
+
+/**
+ * This class remembers every mesh and image decoded in this process, keyed by the
+ * canonical path of the file and a hash of its contents. However many scene files
+ * (and imports) refer to a file, it is decoded once; a file that changes on disk
+ * gets a new key and is decoded again.
+ *
+ * Images are decoded with their mip levels, which are built here on the thread
+ * that decodes them, and are then block compressed if a format was chosen. They
+ * can also be kept on disk between runs, levels and all, in a TextureDiskCache;
+ * an image found there is mapped rather than decoded, and its source is not
+ * even read unless it looks modified.
+ *
+ * Meshes stay for the life of the process. An image only stays while something
+ * holds its pixels, like a template in TemplateCache, so the pixels of a scene
+ * are freed with the scene; a later load decodes (or maps) the file again.
+ *
+ * The load functions are safe to call from several threads at once. If two
+ * threads ask for the same file, one decodes it and the other waits for it.
+ */
+class AssetCache {
+  public:
+    /**
+     * The cache shared by the whole process
+     */
+    static AssetCache& shared() {
+        static AssetCache cache;
+        return cache;
+    }
+
+    /**
+     * Get the mesh in an OBJ file. A missing file is reported as not found.
+     */
+    LoadedMesh loadMesh(const string& path) {
+        string key;
+        if (!makeKey(path, key)) {
+            LoadedMesh missing;
+            missing.found = false;
+            return missing;
+        }
+        return lookup(meshes, key, [path]() {
+            LoadedMesh loaded;
+            ifstream in(path);
+            loaded.found = in.is_open();
+            if (loaded.found)
+                loaded.mesh = util::ObjImporter<VertexAttrib>::importFile(in, false);
+            return loaded;
+        });
+    }
+
+    /**
+     * Get the image in a file, from the texture cache directory if it has an up
+     * to date copy. A missing or malformed file throws.
+     */
+    LoadedImage loadImage(const string& path) {
+        string canonical = canonicalPath(path);
+        if (canonical.empty())
+            throw std::invalid_argument("File not found!");
+        ourutils::BlockCompression::Format format = getTextureCompression();
+        CachedTexture cached;
+        if (textures.isEnabled() &&
+            textures.find(canonical, format, cached,
+                          [&canonical](uint64_t& hash) { return hashFile(canonical, hash); })) {
+            return lookupImage(makeKey(canonical, cached.sourceHash, format), [this, &canonical, &cached]() {
+                LoadedImage loaded;
+                loaded.pixels = PixelBuffer::mapped(cached.mapping, cached.pixels, cached.width, cached.height,
+                                                    cached.levels, cached.format);
+                if ((cached.format == ourutils::BlockCompression::NONE) &&
+                    (cached.levels < MipChain::fullLevels(cached.width, cached.height))) {
+                    // an RGB entry from before the levels were kept
+                    loaded.pixels = MipChain::build(loaded.pixels);
+                    textures.store(canonical, cached.sourceHash, loaded.pixels->data(), loaded.pixels->getWidth(),
+                                   loaded.pixels->getHeight(), loaded.pixels->getLevels());
+                }
+                return loaded;
+            });
+        }
+
+        uint64_t hash;
+        if (!hashFile(canonical, hash))
+            throw std::invalid_argument("File not found!");
+        return lookupImage(makeKey(canonical, hash, format), [this, canonical, hash, format]() {
+            LoadedImage loaded = decodeImage(canonical);
+            loaded.pixels = MipChain::compress(MipChain::build(loaded.pixels), format);
+            textures.store(canonical, hash, loaded.pixels->data(), loaded.pixels->getWidth(),
+                           loaded.pixels->getHeight(), loaded.pixels->getLevels(), format);
+            return loaded;
+        });
+    }
+
+    /**
+     * Decode an image file with the loader its signature calls for: PNG, or
+     * PPM for anything else. Only the largest level is decoded.
+     */
+    static LoadedImage decodeImage(const string& path) {
+        char signature[8] = {0};
+        ifstream in(path.c_str(), ios::binary);
+        in.read(signature, sizeof(signature));
+        PNGImageLoader png;
+        PPMImageLoader ppm;
+        ImageLoader& loader = PNGImageLoader::isPNG(signature, (size_t)in.gcount())
+                                  ? static_cast<ImageLoader&>(png)
+                                  : static_cast<ImageLoader&>(ppm);
+        loader.load(path);
+        LoadedImage loaded;
+        loaded.pixels = PixelBuffer::adopt(loader.getPixels(), loader.getWidth(), loader.getHeight());
+        return loaded;
+    }
+
+    /**
+     * Keep decoded images in the given directory between runs. An empty path,
+     * the default, keeps them in memory only.
+     */
+    void setTextureCacheDirectory(const string& path) { textures.setDirectory(path); }
+
+    /**
+     * Block compress the images loaded from now on, or keep them as RGB with
+     * NONE, the default
+     */
+    void setTextureCompression(ourutils::BlockCompression::Format format) {
+        lock_guard<mutex> lock(guard);
+        compression = format;
+    }
+
+    ourutils::BlockCompression::Format getTextureCompression() {
+        lock_guard<mutex> lock(guard);
+        return compression;
+    }
+
+    /**
+     * \return the number of distinct meshes decoded so far and images still in
+     * use
+     */
+    size_t size() {
+        lock_guard<mutex> lock(guard);
+        size_t count = meshes.size() + loadingImages.size();
+        for (map<string, weak_ptr<const PixelBuffer> >::iterator it = images.begin(); it != images.end(); it++) {
+            if (!it->second.expired())
+                count++;
+        }
+        return count;
+    }
+
+    static string canonicalPath(const string& path) {
+#ifndef _WIN32
+        char* resolved = realpath(path.c_str(), NULL);
+        if (resolved == NULL)
+            return "";
+        string canonical(resolved);
+        free(resolved);
+        return canonical;
+#else
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved, path.c_str(), _MAX_PATH) == NULL)
+            return "";
+        return string(resolved);
+#endif
+    }
+
+    /**
+     * 64-bit FNV-1a hash of a whole file
+     */
+    static bool hashFile(const string& path, uint64_t& hash) {
+        ourutils::MappedFile file;
+        if (!file.open(path))
+            return false;
+        hash = 14695981039346656037ULL;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(file.data());
+        for (size_t i = 0; i < file.size(); i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return true;
+    }
+
+    /**
+     * Build the key for a file: its canonical path and the hash of its contents
+     * \return false if the file cannot be read
+     */
+    static bool makeKey(const string& path, string& key) {
+        string canonical = canonicalPath(path);
+        uint64_t hash;
+        if (canonical.empty() || !hashFile(canonical, hash))
+            return false;
+        key = makeKey(canonical, hash);
+        return true;
+    }
+
+    static string makeKey(const string& canonical, uint64_t hash) {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        return canonical + "#" + hex;
+    }
+
+    /**
+     * Build the key for an image kept in a block format
+     */
+    static string makeKey(const string& canonical, uint64_t hash, ourutils::BlockCompression::Format format) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "@%d", (int)format);
+        return makeKey(canonical, hash) + ((format == ourutils::BlockCompression::NONE) ? "" : suffix);
+    }
+
+  private:
+    AssetCache() : compression(ourutils::BlockCompression::NONE) {}
+
+    /**
+     * Return the cached value for this key, decoding it first if this is the
+     * first request for it
+     */
+    template <class T, class Decode>
+    T lookup(map<string, shared_future<T> >& entries, const string& key, Decode decode) {
+        shared_future<T> entry;
+        promise<T> result;
+        bool decodeHere = false;
+        {
+            lock_guard<mutex> lock(guard);
+            typename map<string, shared_future<T> >::iterator it = entries.find(key);
+            if (it != entries.end()) {
+                entry = it->second;
+            } else {
+                entry = result.get_future().share();
+                entries[key] = entry;
+                decodeHere = true;
+            }
+        }
+        if (decodeHere) {
+            try {
+                result.set_value(decode());
+            } catch (...) {
+                result.set_exception(current_exception());
+            }
+        }
+        return entry.get();
+    }
+
+    /**
+     * Return the pixels for this key if they are still in use, or wait for a
+     * load already under way, or decode them here. Once decoded they are only
+     * remembered weakly; a failed load is not remembered at all.
+     */
+    template <class Decode>
+    LoadedImage lookupImage(const string& key, Decode decode) {
+        shared_future<LoadedImage> entry;
+        promise<LoadedImage> result;
+        bool decodeHere = false;
+        {
+            lock_guard<mutex> lock(guard);
+            map<string, weak_ptr<const PixelBuffer> >::iterator resident = images.find(key);
+            if (resident != images.end()) {
+                LoadedImage found;
+                found.pixels = resident->second.lock();
+                if (found.pixels)
+                    return found;
+            }
+            map<string, shared_future<LoadedImage> >::iterator it = loadingImages.find(key);
+            if (it != loadingImages.end()) {
+                entry = it->second;
+            } else {
+                entry = result.get_future().share();
+                loadingImages[key] = entry;
+                decodeHere = true;
+            }
+        }
+        if (decodeHere) {
+            LoadedImage loaded;
+            exception_ptr failure;
+            try {
+                loaded = decode();
+            } catch (...) {
+                failure = current_exception();
+            }
+            {
+                lock_guard<mutex> lock(guard);
+                for (map<string, weak_ptr<const PixelBuffer> >::iterator it = images.begin(); it != images.end();) {
+                    if (it->second.expired())
+                        it = images.erase(it);
+                    else
+                        it++;
+                }
+                if (!failure)
+                    images[key] = loaded.pixels;
+                loadingImages.erase(key);
+            }
+            if (failure)
+                result.set_exception(failure);
+            else
+                result.set_value(loaded);
+        }
+        return entry.get();
+    }
+
+    AssetCache(const AssetCache&);
+    AssetCache& operator=(const AssetCache&);
+
+    mutex guard;
+    TextureDiskCache textures;
+    ourutils::BlockCompression::Format compression;
+    map<string, shared_future<LoadedMesh> > meshes;
+    map<string, weak_ptr<const PixelBuffer> > images;
+    map<string, shared_future<LoadedImage> > loadingImages;
+};
+
+} // namespace sgraph
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef _BINARYSCENEGRAPHEXPORTER_H_
+#define _BINARYSCENEGRAPHEXPORTER_H_
+
+#include "SGNodeVisitor.h"
+#include "GroupNode.h"
+#include "LeafNode.h"
+#include "TransformNode.h"
+#include "RotateTransform.h"
+#include "ScaleTransform.h"
+#include "TranslateTransform.h"
+#include "InstanceNode.h"
+#include "BinaryScenegraphFormat.h"
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+    /**
+     * This visitor compiles a scene graph into the binary format described in
+     * BinaryScenegraphFormat.h. Identical materials and lights are stored once.
+     */
+    class BinaryScenegraphExporter: public SGNodeVisitor {
+        public:
+            BinaryScenegraphExporter(map<string,string>& meshPaths,map<string,string>& imagePaths) {
+                lastNode = 0;
+                for (map<string,string>::iterator it=meshPaths.begin(); it!=meshPaths.end();it++) {
+                    binaryformat::AssetRecord record;
+                    record.name = addString(it->first);
+                    record.path = addString(it->second);
+                    meshes.push_back(record);
+                }
+                for (map<string,string>::iterator it=imagePaths.begin(); it!=imagePaths.end();it++) {
+                    binaryformat::AssetRecord record;
+                    record.name = addString(it->first);
+                    record.path = addString(it->second);
+                    images.push_back(record);
+                    imageIndices[it->first] = images.size()-1;
+                }
+            }
+
+            /**
+             * Get the compiled file. The root is the first node visited.
+             */
+            string getOutput() {
+                binaryformat::Header header;
+                memcpy(header.magic,binaryformat::MAGIC,sizeof(header.magic));
+                header.version = binaryformat::VERSION;
+                header.root = 0;
+
+                string output(sizeof(header),'\0');
+                header.strings = appendTable(output,strings.data(),1,strings.size());
+                header.nodes = appendTable(output,nodes.data(),sizeof(binaryformat::NodeRecord),nodes.size());
+                header.children = appendTable(output,children.data(),sizeof(uint32_t),children.size());
+                header.materials = appendTable(output,materials.data(),sizeof(binaryformat::MaterialRecord),materials.size());
+                header.lights = appendTable(output,lights.data(),sizeof(binaryformat::LightRecord),lights.size());
+                header.meshes = appendTable(output,meshes.data(),sizeof(binaryformat::AssetRecord),meshes.size());
+                header.images = appendTable(output,images.data(),sizeof(binaryformat::AssetRecord),images.size());
+                memcpy(&output[0],&header,sizeof(header));
+                return output;
+            }
+
+            void visitGroupNode(GroupNode *groupNode) {
+                uint32_t index = addNode(binaryformat::GROUP,groupNode->getName());
+                visitChildren(groupNode,index);
+            }
+
+            void visitLeafNode(LeafNode *leafNode) {
+                uint32_t index = addNode(binaryformat::LEAF,leafNode->getName());
+                nodes[index].instanceOf = addString(leafNode->getInstanceOf());
+                nodes[index].material = addMaterial(leafNode->getMaterial());
+                nodes[index].light = addLight(leafNode->getLight());
+
+                string texture = leafNode->getTextureSymbol().str();
+                if (imageIndices.find(texture)!=imageIndices.end()) {
+                    nodes[index].image = imageIndices[texture];
+                }
+                lastNode = index;
+            }
+
+            /**
+             * Only the concrete transforms below know their parameters, so a plain
+             * transform node cannot be compiled
+             */
+            void visitTransformNode(TransformNode * transformNode) {
+                throw runtime_error("Cannot compile transform node without a known type: "+transformNode->getName());
+            }
+
+            void visitScaleTransform(ScaleTransform *scaleNode) {
+                uint32_t index = addNode(binaryformat::SCALE,scaleNode->getName());
+                glm::vec3 scale = scaleNode->getScale();
+                setParams(index,scale[0],scale[1],scale[2],0);
+                visitChildren(scaleNode,index);
+            }
+
+            void visitTranslateTransform(TranslateTransform *translateNode) {
+                uint32_t index = addNode(binaryformat::TRANSLATE,translateNode->getName());
+                glm::vec3 translate = translateNode->getTranslate();
+                setParams(index,translate[0],translate[1],translate[2],0);
+                visitChildren(translateNode,index);
+            }
+
+            void visitRotateTransform(RotateTransform *rotateNode) {
+                uint32_t index = addNode(binaryformat::ROTATE,rotateNode->getName());
+                glm::vec3 axis = rotateNode->getRotationAxis();
+                setParams(index,rotateNode->getAngleInRadians(),axis[0],axis[1],axis[2]);
+                visitChildren(rotateNode,index);
+            }
+
+            /**
+             * The format has no shared subtrees, so each instance is written out as
+             * a copy of its template. Only instances without a transformation of
+             * their own can be compiled
+             */
+            void visitInstanceNode(InstanceNode *instanceNode) {
+                if (instanceNode->getTransform()!=glm::mat4(1.0)) {
+                    throw runtime_error("Cannot compile transformed instance node: "+instanceNode->getName());
+                }
+                instanceNode->getChildren()[0]->accept(this);
+            }
+
+        private:
+            uint32_t addString(const string& str) {
+                map<string,uint32_t>::iterator it = stringOffsets.find(str);
+                if (it!=stringOffsets.end()) {
+                    return it->second;
+                }
+                uint32_t offset = strings.size();
+                strings.insert(strings.end(),str.begin(),str.end());
+                strings.push_back('\0');
+                stringOffsets[str] = offset;
+                return offset;
+            }
+
+            uint32_t addNode(binaryformat::NodeType type,const string& name) {
+                binaryformat::NodeRecord record;
+                memset(&record,0,sizeof(record));
+                record.type = type;
+                record.name = addString(name);
+                record.instanceOf = addString("");
+                record.material = binaryformat::NONE;
+                record.light = binaryformat::NONE;
+                record.image = binaryformat::NONE;
+                nodes.push_back(record);
+                return nodes.size()-1;
+            }
+
+            void setParams(uint32_t index,float a,float b,float c,float d) {
+                nodes[index].params[0] = a;
+                nodes[index].params[1] = b;
+                nodes[index].params[2] = c;
+                nodes[index].params[3] = d;
+            }
+
+            void visitChildren(ParentSGNode *node,uint32_t index) {
+                vector<uint32_t> childIndices;
+                vector<SGNode *> nodeChildren = node->getChildren();
+                for (int i=0;i<nodeChildren.size();i++) {
+                    nodeChildren[i]->accept(this);
+                    childIndices.push_back(lastNode);
+                }
+                nodes[index].firstChild = children.size();
+                nodes[index].childCount = childIndices.size();
+                children.insert(children.end(),childIndices.begin(),childIndices.end());
+                lastNode = index;
+            }
+
+            int32_t addMaterial(util::Material material) {
+                binaryformat::MaterialRecord record;
+                memset(&record,0,sizeof(record));
+                copyVector(record.ambient,material.getAmbient());
+                copyVector(record.diffuse,material.getDiffuse());
+                copyVector(record.specular,material.getSpecular());
+                copyVector(record.emission,material.getEmission());
+                record.shininess = material.getShininess();
+                return addRecord(materials,materialIndices,record);
+            }
+
+            int32_t addLight(const util::Light& light) {
+                if ((glm::length(light.getAmbient())==0.0f)
+                    && (glm::length(light.getDiffuse())==0.0f)
+                    && (glm::length(light.getSpecular())==0.0f)) {
+                    return binaryformat::NONE;
+                }
+                binaryformat::LightRecord record;
+                memset(&record,0,sizeof(record));
+                copyVector(record.ambient,light.getAmbient());
+                copyVector(record.diffuse,light.getDiffuse());
+                copyVector(record.specular,light.getSpecular());
+                copyVector(record.position,light.getPosition());
+                copyVector(record.spotDirection,light.getSpotDirection());
+                record.spotCutoff = light.getSpotCutoff();
+                return addRecord(lights,lightIndices,record);
+            }
+
+            template <class R>
+            int32_t addRecord(vector<R>& records,map<string,int32_t>& indices,const R& record) {
+                string key(reinterpret_cast<const char *>(&record),sizeof(record));
+                map<string,int32_t>::iterator it = indices.find(key);
+                if (it!=indices.end()) {
+                    return it->second;
+                }
+                records.push_back(record);
+                indices[key] = records.size()-1;
+                return records.size()-1;
+            }
+
+            static void copyVector(float *out,const glm::vec3& v) {
+                out[0] = v[0]; out[1] = v[1]; out[2] = v[2];
+            }
+
+            static void copyVector(float *out,const glm::vec4& v) {
+                out[0] = v[0]; out[1] = v[1]; out[2] = v[2]; out[3] = v[3];
+            }
+
+            /**
+             * Append a table to the output, padded so that the next table stays 4-byte aligned
+             */
+            static binaryformat::Table appendTable(string& output,const void *data,size_t recordSize,size_t count) {
+                binaryformat::Table table;
+                table.offset = output.size();
+                table.count = count;
+                output.append(static_cast<const char *>(data),recordSize*count);
+                while (output.size()%4!=0) {
+                    output.push_back('\0');
+                }
+                return table;
+            }
+
+            vector<char> strings;
+            map<string,uint32_t> stringOffsets;
+            vector<binaryformat::NodeRecord> nodes;
+            vector<uint32_t> children;
+            vector<binaryformat::MaterialRecord> materials;
+            map<string,int32_t> materialIndices;
+            vector<binaryformat::LightRecord> lights;
+            map<string,int32_t> lightIndices;
+            vector<binaryformat::AssetRecord> meshes;
+            vector<binaryformat::AssetRecord> images;
+            map<string,int32_t> imageIndices;
+            uint32_t lastNode;
+    };
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _BINARYSCENEGRAPHFORMAT_H_
+#define _BINARYSCENEGRAPHFORMAT_H_
+
+#include <cstdint>
+
+namespace sgraph {
+
+/**
+ * The layout of a compiled scene graph file. Everything after the header lives in
+ * flat tables of fixed-size records, which refer to each other by index and to
+ * names and paths by byte offset into a single table of null-terminated strings.
+ * Every record is a multiple of 4 bytes and every table starts on a 4 byte
+ * boundary, so a memory-mapped file can be read in place.
+ *
+ * Node records are written parent first, so every child index is larger than the
+ * index of its parent.
+ */
+namespace binaryformat {
+
+    const char MAGIC[4] = {'S', 'G', 'B', '1'};
+    const uint32_t VERSION = 1;
+    const int32_t NONE = -1;
+
+    enum NodeType {
+        GROUP = 0,
+        LEAF = 1,
+        SCALE = 2,
+        TRANSLATE = 3,
+        ROTATE = 4
+    };
+
+    /**
+     * The location of a table inside the file
+     */
+    struct Table {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t root;
+        Table strings;   // count is in bytes
+        Table nodes;
+        Table children;  // node indices, referenced by NodeRecord::firstChild
+        Table materials;
+        Table lights;
+        Table meshes;
+        Table images;
+    };
+
+    struct NodeRecord {
+        uint32_t type;
+        uint32_t name;
+        uint32_t firstChild;
+        uint32_t childCount;
+        /**
+         * scale and translate use xyz; rotate stores the angle in radians
+         * followed by the axis
+         */
+        float params[4];
+        uint32_t instanceOf;
+        int32_t material;
+        int32_t light;
+        int32_t image;
+    };
+
+    struct MaterialRecord {
+        float ambient[4];
+        float diffuse[4];
+        float specular[4];
+        float emission[4];
+        float shininess;
+    };
+
+    struct LightRecord {
+        float ambient[3];
+        float diffuse[3];
+        float specular[3];
+        float position[4];
+        float spotDirection[4];
+        float spotCutoff;
+    };
+
+    /**
+     * A mesh or texture that the scene refers to by name, and the file it is loaded from
+     */
+    struct AssetRecord {
+        uint32_t name;
+        uint32_t path;
+    };
+
+} // namespace binaryformat
+} // namespace sgraph
+
+#endif
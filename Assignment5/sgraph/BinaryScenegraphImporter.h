@@ -0,0 +1,224 @@
+#ifndef _BINARYSCENEGRAPHIMPORTER_H_
+#define _BINARYSCENEGRAPHIMPORTER_H_
+
+#include "BinaryScenegraphFormat.h"
+#include "GroupNode.h"
+#include "IScenegraph.h"
+#include "LeafNode.h"
+#include "Light.h"
+#include "Material.h"
+#include "RotateTransform.h"
+#include "ScaleTransform.h"
+#include "SceneAssetLoader.h"
+#include "Scenegraph.h"
+#include "TranslateTransform.h"
+#include "../ourutils/MappedFile.h"
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class builds a scene graph from a file compiled by BinaryScenegraphExporter.
+ * The file is memory-mapped and its tables are read in place; only the meshes and
+ * images it refers to are decoded from their own files.
+ */
+class BinaryScenegraphImporter {
+  public:
+    BinaryScenegraphImporter() {}
+
+    IScenegraph* parseFile(const string& filepath) {
+        ourutils::MappedFile file;
+        if (!file.open(filepath))
+            throw runtime_error("Could not open compiled scene graph: " + filepath);
+        return parse(file.data(), file.size());
+    }
+
+    IScenegraph* parse(const char* data, size_t size) {
+        this->data = data;
+        this->size = size;
+        texturedLeaves.clear();
+        if (size < sizeof(binaryformat::Header))
+            throw runtime_error("Compiled scene graph is too short");
+        memcpy(&header, data, sizeof(header));
+        if ((memcmp(header.magic, binaryformat::MAGIC, sizeof(header.magic)) != 0) ||
+            (header.version != binaryformat::VERSION))
+            throw runtime_error("Not a compiled scene graph, or an unsupported version");
+
+        strings = table<char>(header.strings);
+        if ((header.strings.count == 0) || (strings[header.strings.count - 1] != '\0'))
+            throw runtime_error("Compiled scene graph has a malformed string table");
+        nodeRecords = table<binaryformat::NodeRecord>(header.nodes);
+        childIndices = table<uint32_t>(header.children);
+        materialRecords = table<binaryformat::MaterialRecord>(header.materials);
+        lightRecords = table<binaryformat::LightRecord>(header.lights);
+        const binaryformat::AssetRecord* meshRecords = table<binaryformat::AssetRecord>(header.meshes);
+        imageRecords = table<binaryformat::AssetRecord>(header.images);
+
+        map<string, string> meshPaths;
+        for (uint32_t i = 0; i < header.meshes.count; i++) {
+            meshPaths[string(stringAt(meshRecords[i].name))] = stringAt(meshRecords[i].path);
+            assets.declareMesh(stringAt(meshRecords[i].name), stringAt(meshRecords[i].path));
+        }
+        map<string, string> imagePaths;
+        for (uint32_t i = 0; i < header.images.count; i++) {
+            imagePaths[string(stringAt(imageRecords[i].name))] = stringAt(imageRecords[i].path);
+            assets.declareImage(stringAt(imageRecords[i].name), stringAt(imageRecords[i].path));
+        }
+
+        if (header.root >= header.nodes.count)
+            throw runtime_error("Compiled scene graph has no root");
+        hasParent.assign(header.nodes.count, false);
+        SGNode* root = buildNode(header.root);
+
+        assets.resolve();
+        for (size_t i = 0; i < texturedLeaves.size(); i++) {
+            if (assets.hasImage(texturedLeaves[i].second))
+                texturedLeaves[i].first->setTexture(Symbol(texturedLeaves[i].second),
+                                                    assets.getImagePixels(texturedLeaves[i].second));
+        }
+        texturedLeaves.clear();
+
+        IScenegraph* scenegraph = new Scenegraph();
+        scenegraph->makeScenegraph(root);
+        scenegraph->setMeshes(assets.getMeshes());
+        scenegraph->setMeshPaths(meshPaths);
+        scenegraph->setImages(assets.getImages());
+        scenegraph->setImagePixels(assets.getImagePixels());
+        scenegraph->setImagePaths(imagePaths);
+        return scenegraph;
+    }
+
+  private:
+    /**
+     * Get a table inside the file, after checking that it lies within it
+     */
+    template <class R>
+    const R* table(const binaryformat::Table& location) {
+        if ((location.offset % 4 != 0) || (location.offset > size) ||
+            ((size - location.offset) / sizeof(R) < location.count))
+            throw runtime_error("Compiled scene graph has a table outside the file");
+        return reinterpret_cast<const R*>(data + location.offset);
+    }
+
+    const char* stringAt(uint32_t offset) {
+        if (offset >= header.strings.count)
+            throw runtime_error("Compiled scene graph refers to a string outside its table");
+        return strings + offset;
+    }
+
+    template <class R>
+    const R& recordAt(const R* records, uint32_t count, int32_t index) {
+        if ((index < 0) || ((uint32_t)index >= count))
+            throw runtime_error("Compiled scene graph refers to a record outside its table");
+        return records[index];
+    }
+
+    /**
+     * Create the node with this index and, recursively, its children
+     */
+    SGNode* buildNode(uint32_t index) {
+        const binaryformat::NodeRecord& record = nodeRecords[index];
+        string name = stringAt(record.name);
+        SGNode* node = NULL;
+        switch (record.type) {
+        case binaryformat::GROUP:
+            node = new GroupNode(name, NULL);
+            break;
+        case binaryformat::LEAF:
+            node = buildLeaf(record, name);
+            break;
+        case binaryformat::SCALE:
+            node = new ScaleTransform(record.params[0], record.params[1], record.params[2], name, NULL);
+            break;
+        case binaryformat::TRANSLATE:
+            node = new TranslateTransform(record.params[0], record.params[1], record.params[2], name, NULL);
+            break;
+        case binaryformat::ROTATE:
+            node = new RotateTransform(record.params[0], record.params[1], record.params[2], record.params[3], name, NULL);
+            break;
+        default:
+            throw runtime_error("Compiled scene graph has an unknown node type");
+        }
+
+        ParentSGNode* parent = dynamic_cast<ParentSGNode*>(node);
+        if ((parent == NULL) && (record.childCount > 0)) {
+            delete node;
+            throw runtime_error("Compiled scene graph has a leaf with children");
+        }
+        if ((record.firstChild > header.children.count) ||
+            (header.children.count - record.firstChild < record.childCount)) {
+            delete node;
+            throw runtime_error("Compiled scene graph has children outside the child table");
+        }
+        try {
+            for (uint32_t i = 0; i < record.childCount; i++) {
+                uint32_t child = childIndices[record.firstChild + i];
+                // children always come after their parent, so this cannot loop
+                if ((child <= index) || (child >= header.nodes.count) || hasParent[child])
+                    throw runtime_error("Compiled scene graph is not a tree");
+                hasParent[child] = true;
+                parent->addChild(buildNode(child));
+            }
+        } catch (...) {
+            delete node;
+            throw;
+        }
+        return node;
+    }
+
+    LeafNode* buildLeaf(const binaryformat::NodeRecord& record, const string& name) {
+        LeafNode* leaf = new LeafNode(stringAt(record.instanceOf), name, NULL);
+        assets.requestMesh(stringAt(record.instanceOf));
+        if (record.material != binaryformat::NONE) {
+            const binaryformat::MaterialRecord& m = recordAt(materialRecords, header.materials.count, record.material);
+            util::Material material;
+            material.setAmbient(m.ambient[0], m.ambient[1], m.ambient[2]);
+            material.setDiffuse(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
+            material.setSpecular(m.specular[0], m.specular[1], m.specular[2]);
+            material.setEmission(m.emission[0], m.emission[1], m.emission[2]);
+            material.setShininess(m.shininess);
+            leaf->setMaterial(material);
+        }
+        if (record.light != binaryformat::NONE) {
+            const binaryformat::LightRecord& l = recordAt(lightRecords, header.lights.count, record.light);
+            util::Light light;
+            light.setAmbient(l.ambient[0], l.ambient[1], l.ambient[2]);
+            light.setDiffuse(l.diffuse[0], l.diffuse[1], l.diffuse[2]);
+            light.setSpecular(l.specular[0], l.specular[1], l.specular[2]);
+            light.setPosition(glm::vec4(l.position[0], l.position[1], l.position[2], l.position[3]));
+            light.setSpotDirection(l.spotDirection[0], l.spotDirection[1], l.spotDirection[2]);
+            light.setSpotAngle(l.spotCutoff);
+            leaf->setLight(light);
+        }
+        if (record.image != binaryformat::NONE) {
+            const binaryformat::AssetRecord& image = recordAt(imageRecords, header.images.count, record.image);
+            texturedLeaves.push_back(make_pair(leaf, string(stringAt(image.name))));
+            assets.requestImage(stringAt(image.name));
+        }
+        return leaf;
+    }
+
+    const char* data;
+    size_t size;
+    binaryformat::Header header;
+    const char* strings;
+    const binaryformat::NodeRecord* nodeRecords;
+    const uint32_t* childIndices;
+    const binaryformat::MaterialRecord* materialRecords;
+    const binaryformat::LightRecord* lightRecords;
+    const binaryformat::AssetRecord* imageRecords;
+    vector<bool> hasParent;
+    vector<pair<LeafNode*, string> > texturedLeaves;
+    SceneAssetLoader assets;
+};
+
+} // namespace sgraph
+
+#endif
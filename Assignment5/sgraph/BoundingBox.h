@@ -0,0 +1,101 @@
+#ifndef _BOUNDINGBOX_H_
+#define _BOUNDINGBOX_H_
+
+#include "Symbol.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * An axis-aligned box around part of a scene. A box can also be empty, around
+ * nothing, or cover everything, for geometry whose extent is not known; a box
+ * that covers everything is never culled.
+ */
+class BoundingBox {
+  public:
+    /**
+     * An empty box
+     */
+    BoundingBox() : minimum(FLT_MAX), maximum(-FLT_MAX), everything(false) {}
+
+    BoundingBox(const glm::vec3& minimum, const glm::vec3& maximum)
+        : minimum(minimum), maximum(maximum), everything(false) {}
+
+    static BoundingBox unbounded() {
+        BoundingBox box;
+        box.everything = true;
+        return box;
+    }
+
+    bool isEmpty() const { return !everything && (minimum.x > maximum.x); }
+
+    bool isUnbounded() const { return everything; }
+
+    /**
+     * Grow the box to cover a point
+     */
+    void add(const glm::vec3& point) {
+        minimum = glm::vec3(min(minimum.x, point.x), min(minimum.y, point.y), min(minimum.z, point.z));
+        maximum = glm::vec3(max(maximum.x, point.x), max(maximum.y, point.y), max(maximum.z, point.z));
+    }
+
+    /**
+     * Grow the box to cover another
+     */
+    void add(const BoundingBox& other) {
+        if (other.everything) {
+            everything = true;
+        } else if (!other.isEmpty()) {
+            add(other.minimum);
+            add(other.maximum);
+        }
+    }
+
+    glm::vec3 getCenter() const { return 0.5f * (minimum + maximum); }
+
+    /**
+     * \return half the size of the box along each axis
+     */
+    glm::vec3 getExtent() const { return 0.5f * (maximum - minimum); }
+
+    /**
+     * \return the smallest axis-aligned box around this one after it is
+     * transformed. The center is transformed as a point and the extent by the
+     * absolute values of the matrix, so this costs about as much as transforming
+     * two points instead of eight corners.
+     */
+    BoundingBox transformed(const glm::mat4& matrix) const {
+        if (everything || isEmpty())
+            return *this;
+        glm::vec3 center = getCenter();
+        glm::vec3 extent = getExtent();
+        glm::vec3 movedCenter(matrix * glm::vec4(center, 1.0f));
+        glm::vec3 movedExtent;
+        for (int row = 0; row < 3; row++) {
+            movedExtent[row] = fabs(matrix[0][row]) * extent.x + fabs(matrix[1][row]) * extent.y +
+                               fabs(matrix[2][row]) * extent.z;
+        }
+        return BoundingBox(movedCenter - movedExtent, movedCenter + movedExtent);
+    }
+
+  private:
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+    bool everything;
+};
+
+/**
+ * The box around each mesh of a scene, in the mesh's own coordinates, by the
+ * name the leaves use for it
+ */
+typedef unordered_map<Symbol, BoundingBox> MeshBounds;
+
+} // namespace sgraph
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef _COMMANDTOKENIZER_H_
+#define _COMMANDTOKENIZER_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class splits the text of a scene graph command file into whitespace
+ * separated tokens without copying it first. Comments (from '#' to the end of
+ * the line) are skipped while scanning, so the buffer can be a memory-mapped
+ * file used exactly as it is on disk.
+ *
+ * A tokenizer can also read from a stream, one fixed-size chunk at a time, so
+ * that only the chunk being tokenized is ever in memory.
+ *
+ * It offers the same >> extraction that the importer used to do on an istream,
+ * so a failed extraction makes the tokenizer evaluate to false.
+ */
+class CommandTokenizer {
+    public:
+        CommandTokenizer(const char* begin, const char* end)
+            : current(begin), last(end), failed(false), source(NULL), chunkSize(0),
+              inComment(false), count(0), recorded(NULL) {}
+
+        CommandTokenizer(istream& source, size_t chunkSize = 1 << 16)
+            : current(NULL), last(NULL), failed(false), source(&source), chunkSize(chunkSize),
+              inComment(false), count(0), recorded(NULL) {}
+
+        /**
+         * Find the next token. The token points into the underlying buffer. For a
+         * stream it is only valid until the next token is read; otherwise it is
+         * valid as long as the buffer is.
+         * \return false if there are no more tokens
+         */
+        bool next(const char*& token, size_t& length) {
+            skipSpaceAndComments();
+            if (current == last) {
+                failed = true;
+                return false;
+            }
+            token = current;
+            while (true) {
+                while ((current != last) && !isSpace(*current) && (*current != '#'))
+                    current++;
+                // a token cut off by the end of a chunk continues in the next one
+                if ((current != last) || !refill(token))
+                    break;
+            }
+            length = current - token;
+            if (recorded != NULL)
+                recorded->push_back(make_pair(string(token, length), count));
+            count++;
+            return true;
+        }
+
+        /**
+         * \return the number of tokens read so far
+         */
+        size_t getTokenCount() const { return count; }
+
+        /**
+         * Append a copy of every token read from now on, with its position in the
+         * file, to the given list. Pass NULL to stop.
+         */
+        void recordTokens(vector<pair<string, size_t> >* tokens) { recorded = tokens; }
+
+        CommandTokenizer& operator>>(string& out) {
+            const char* token;
+            size_t length;
+            if (next(token, length))
+                out.assign(token, length);
+            return *this;
+        }
+
+        CommandTokenizer& operator>>(float& out) {
+            const char* token;
+            size_t length;
+            if (!next(token, length))
+                return *this;
+
+            // tokens are not null-terminated, so numbers are parsed from a small local copy
+            char number[64];
+            if (length >= sizeof(number)) {
+                failed = true;
+                return *this;
+            }
+            memcpy(number, token, length);
+            number[length] = '\0';
+            char* parsedUpTo;
+            float value = strtof(number, &parsedUpTo);
+            if (parsedUpTo != number + length)
+                failed = true;
+            else
+                out = value;
+            return *this;
+        }
+
+        operator bool() const { return !failed; }
+
+        /**
+         * \return true if the token is exactly the given keyword
+         */
+        static bool matches(const char* token, size_t length, const char* keyword) {
+            return (strlen(keyword) == length) && (memcmp(token, keyword, length) == 0);
+        }
+
+    private:
+        static bool isSpace(char c) {
+            return (c == ' ') || (c == '\n') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f');
+        }
+
+        void skipSpaceAndComments() {
+            do {
+                while (current != last) {
+                    if (inComment || (*current == '#')) {
+                        const char* newline = static_cast<const char*>(memchr(current, '\n', last - current));
+                        inComment = (newline == NULL);
+                        current = inComment ? last : newline;
+                    } else if (isSpace(*current)) {
+                        current++;
+                    } else {
+                        return;
+                    }
+                }
+            } while (refill(current));
+        }
+
+        /**
+         * Read the next chunk of the stream. The bytes from keep onwards have not
+         * been used up yet, so they are moved to the front of the buffer first.
+         * \param keep the first byte to keep; updated to its new address
+         * \return false if there is nothing more to read
+         */
+        bool refill(const char*& keep) {
+            if ((source == NULL) || !source->good())
+                return false;
+            size_t kept = last - keep;
+            size_t scanned = current - keep;
+            if (kept > 0)
+                memmove(&buffer[0], keep, kept);
+            if (buffer.size() < kept + chunkSize)
+                buffer.resize(kept + chunkSize);
+            source->read(&buffer[kept], chunkSize);
+            size_t got = (size_t)source->gcount();
+            keep = &buffer[0];
+            current = keep + scanned;
+            last = keep + kept + got;
+            return got > 0;
+        }
+
+        const char* current;
+        const char* last;
+        bool failed;
+        istream* source;
+        size_t chunkSize;
+        vector<char> buffer;
+        bool inComment;
+        size_t count;
+        vector<pair<string, size_t> >* recorded;
+};
+
+} // namespace sgraph
+
+#endif
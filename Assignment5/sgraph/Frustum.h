@@ -0,0 +1,103 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include "BoundingBox.h"
+#include "glm/glm.hpp"
+
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * The six planes of a view frustum, taken from a projection-view matrix, for
+ * testing bounding boxes against.
+ *
+ * The planes are kept a component to an array, padded to eight with copies of
+ * the first two, so that a box is tested against four planes at once. A box is
+ * outside if it is entirely behind any plane, and inside if it is entirely in
+ * front of every plane. A box that straddles the corner of two planes outside the
+ * frustum is called intersecting, which only means it is not culled.
+ */
+class Frustum {
+  public:
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    Frustum() {
+        for (int i = 0; i < 8; i++)
+            nx[i] = ny[i] = nz[i] = d[i] = ax[i] = ay[i] = az[i] = 0;
+    }
+
+    /**
+     * Take the planes from a matrix that goes from the space the boxes are in to
+     * clip coordinates, as in Gribb and Hartmann. The planes need not be
+     * normalized, as only the sign of the distances is used.
+     */
+    void set(const glm::mat4& clip) {
+        for (int plane = 0; plane < 8; plane++) {
+            // left, right, bottom, top, near, far: row 3 plus or minus rows 0, 1 and 2
+            int row = (plane % 6) / 2;
+            float sign = ((plane % 6) % 2 == 0) ? 1.0f : -1.0f;
+            glm::vec4 p(clip[0][3] + sign * clip[0][row], clip[1][3] + sign * clip[1][row],
+                        clip[2][3] + sign * clip[2][row], clip[3][3] + sign * clip[3][row]);
+            nx[plane] = p.x;
+            ny[plane] = p.y;
+            nz[plane] = p.z;
+            d[plane] = p.w;
+            ax[plane] = fabs(p.x);
+            ay[plane] = fabs(p.y);
+            az[plane] = fabs(p.z);
+        }
+    }
+
+    Result test(const BoundingBox& box) const {
+        if (box.isUnbounded())
+            return INTERSECTS;
+        if (box.isEmpty())
+            return OUTSIDE;
+        glm::vec3 center = box.getCenter();
+        glm::vec3 extent = box.getExtent();
+        // bit i of outside is set if the box is behind plane i, of straddles if part of it is
+        int outside = 0;
+        int straddles = 0;
+        int plane = 0;
+#ifdef __SSE2__
+        __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+        __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+        __m128 zero = _mm_setzero_ps();
+        for (; plane < 8; plane += 4) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(nx + plane), cx),
+                                                    _mm_mul_ps(_mm_loadu_ps(ny + plane), cy)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(nz + plane), cz), _mm_loadu_ps(d + plane)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ax + plane), ex),
+                                                  _mm_mul_ps(_mm_loadu_ps(ay + plane), ey)),
+                                       _mm_mul_ps(_mm_loadu_ps(az + plane), ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) << plane;
+            straddles |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero)) << plane;
+        }
+#endif
+        for (; plane < 8; plane++) {
+            float distance = nx[plane] * center.x + ny[plane] * center.y + nz[plane] * center.z + d[plane];
+            float radius = ax[plane] * extent.x + ay[plane] * extent.y + az[plane] * extent.z;
+            if (distance + radius < 0)
+                outside |= 1 << plane;
+            if (distance - radius < 0)
+                straddles |= 1 << plane;
+        }
+        if (outside != 0)
+            return OUTSIDE;
+        return (straddles != 0) ? INTERSECTS : INSIDE;
+    }
+
+  private:
+    float nx[8], ny[8], nz[8], d[8];
+    // the absolute values of the normals, for the extent of a box along each one
+    float ax[8], ay[8], az[8];
+};
+
+} // namespace sgraph
+
+#endif
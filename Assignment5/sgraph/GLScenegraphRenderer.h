@@ -8,15 +8,33 @@
 #include "RotateTransform.h"
 #include "ScaleTransform.h"
 #include "TranslateTransform.h"
+#include "InstanceNode.h"
+#include "PixelBuffer.h"
+#include "Frustum.h"
+#include "RenderQueue.h"
+#include "InstancedMesh.h"
+#include "Symbol.h"
+#include "TextureAtlas.h"
 #include <ShaderProgram.h>
 #include <ShaderLocationsVault.h>
 #include "ObjectInstance.h"
 #include "glm/gtc/type_ptr.hpp"
+#include <algorithm>
 #include <stack>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <iostream>
 #include <vector>
 using namespace std;
 
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
 namespace sgraph
 {
     /**
@@ -27,62 +45,198 @@ namespace sgraph
     private:
         stack<glm::mat4> &modelview;
         util::ShaderLocationsVault shaderLocations;
-        map<string, util::ObjectInstance *> objects;
-        map<string, util::TextureImage> textures;
-        vector<util::Light> lights;
+        map<string, util::ObjectInstance *> &objects;
+        /**
+         * An object instance, with a small number for it that the render queue sorts by
+         * and the copy of its mesh to draw instanced, if there is one
+         */
+        struct Mesh
+        {
+            util::ObjectInstance *object;
+            uint32_t id;
+            InstancedMesh *instanced;
+        };
+
+        unordered_map<Symbol, Mesh> objectsByName;
+        // the same meshes, by number
+        vector<Mesh> meshesById;
+        map<string, InstancedMesh *> instancedMeshes;
+        // meshes that repeat their textures and so cannot use the atlas
+        unordered_set<Symbol> repeatingMeshes;
+        map<string, PixelHandle> textures;
         int maxLights;
 
         /**
-         * Create and store texture IDs for each texture
+         * The locations of the shader variables set for each leaf, looked up once
+         * instead of by name for every draw
+         */
+        struct UniformLocations
+        {
+            GLint modelview, normalmatrix, texturematrix;
+            GLint ambient, diffuse, specular, shininess;
+            GLint vColor, useTexture, image, instanced;
+            GLuint materials;
+        };
+
+        UniformLocations locations;
+
+        /**
+         * One light as the Lights uniform block in the fragment shader lays it out
+         * under std140: each vec3 takes the room of a vec4, and the struct is
+         * padded to a multiple of 16 bytes
+         */
+        struct LightData
+        {
+            glm::vec4 ambient, diffuse, specular, position, spotDirection;
+            GLfloat spotCutoff;
+            GLint type;
+            GLint padding[2];
+        };
+
+        /**
+         * The start of the Lights uniform block: the light count, padded to 16
+         * bytes. The lights follow it
+         */
+        struct LightBlockHeader
+        {
+            GLint numLights;
+            GLint padding[3];
+        };
+        static_assert(sizeof(LightData) == 96 && sizeof(LightBlockHeader) == 16, "Lights must match std140");
+
+        // the binding point the Lights block is attached to
+        static const GLuint LIGHTS_BINDING = 0;
+        GLuint lightBuffer;
+        vector<GLubyte> lightData;
+
+        /**
+         * One material as the Materials uniform block lays it out under std140:
+         * the shininess fills out the last vec3
+         */
+        struct MaterialData
+        {
+            glm::vec4 ambient, diffuse;
+            glm::vec3 specular;
+            GLfloat shininess;
+        };
+        static_assert(sizeof(MaterialData) == 48, "Materials must match std140");
+
+        // the binding point of the Materials block, and how many it holds; must match MAXMATERIALS in the shader
+        static const GLuint MATERIALS_BINDING = 1;
+        static const uint32_t MAX_MATERIALS = 128;
+        GLuint materialBuffer;
+        vector<GLubyte> materialData;
+
+        /**
+         * Create and store texture IDs for each texture. Small textures are packed
+         * into the pages of a TextureAtlas and share their page's texture ID; one of
+         * them gets a texture of its own only if a mesh that repeats it is drawn
          */
         class TextureManager
         {
         public:
-            TextureManager() {}
+            TextureManager() : bound(0) {}
 
-            // Create texture IDs for all textures in the map
-            void createTextureIDs(map<string, util::TextureImage> &textures)
+            // Create texture IDs for all textures in the map. A texture that is already
+            // known is uploaded again, into the same texture object, only if its pixels changed.
+            // The atlas is packed again if any of its images changed
+            void createTextureIDs(map<string, PixelHandle> &textures)
             {
+                map<string, PixelHandle> small;
                 for (auto it = textures.begin(); it != textures.end(); ++it)
                 {
-                    if (textureIDs.find(it->first) == textureIDs.end())
-                    {
-                        GLuint textureID;
-                        glGenTextures(1, &textureID);
-                        glBindTexture(GL_TEXTURE_2D, textureID);
-
-                        // Set texture parameters for mipmapping
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-                        // Upload texture data
-                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, it->second.getWidth(), it->second.getHeight(),
-                                     0, GL_RGB, GL_UNSIGNED_BYTE, it->second.getImage());
+                    if (atlas.accepts(it->second))
+                        small[it->first] = it->second;
+                }
+                if (small != atlasImages)
+                    packAtlas(small);
 
-                        // Generate mipmaps
-                        glGenerateMipmap(GL_TEXTURE_2D);
+                for (auto it = textures.begin(); it != textures.end(); ++it)
+                {
+                    Symbol name(it->first);
+                    if (textureIDs.find(name) != textureIDs.end())
+                    {
+                        if (uploadedPixels[name] != it->second)
+                        {
+                            bindTexture(textureIDs[name]);
+                            upload(it->second);
+                        }
+                    }
+                    else if (small.find(it->first) == small.end())
+                    {
+                        textureIDs[name] = createTexture(it->second, GL_REPEAT);
+                    }
+                    uploadedPixels[name] = it->second;
+                }
+            }
 
-                        textureIDs[it->first] = textureID;
+            // Delete the textures that are no longer in the map, and create or update the rest
+            void updateTextureIDs(map<string, PixelHandle> &textures)
+            {
+                for (auto it = uploadedPixels.begin(); it != uploadedPixels.end();)
+                {
+                    if (textures.find(it->first.str()) == textures.end())
+                    {
+                        unordered_map<Symbol, GLuint>::iterator own = textureIDs.find(it->first);
+                        if (own != textureIDs.end())
+                        {
+                            deleteTexture(own->second);
+                            textureIDs.erase(own);
+                        }
+                        it = uploadedPixels.erase(it);
+                    }
+                    else
+                    {
+                        ++it;
                     }
                 }
+                createTextureIDs(textures);
             }
 
-            // Bind a texture by name
-            void bindTexture(const string &textureName, GLenum textureUnit = GL_TEXTURE0)
+            // Find the texture to draw a leaf with, and the texture matrix that finds
+            // the image in it: its atlas page, unless the mesh repeats the texture
+            // \return false if there is no such texture
+            bool findTexture(Symbol textureName, bool repeats, GLuint &textureID, glm::mat4 &textureMatrix)
             {
-                if (textureIDs.find(textureName) != textureIDs.end())
+                if (!repeats)
+                {
+                    unordered_map<Symbol, AtlasPlacement>::iterator placed = atlasPlacements.find(textureName);
+                    if (placed != atlasPlacements.end())
+                    {
+                        textureID = placed->second.page;
+                        textureMatrix = placed->second.textureMatrix;
+                        return true;
+                    }
+                }
+                unordered_map<Symbol, GLuint>::iterator own = textureIDs.find(textureName);
+                if (own == textureIDs.end())
                 {
-                    glActiveTexture(textureUnit);
-                    glBindTexture(GL_TEXTURE_2D, textureIDs[textureName]);
+                    unordered_map<Symbol, PixelHandle>::iterator pixels = uploadedPixels.find(textureName);
+                    if (pixels == uploadedPixels.end())
+                        return false;
+                    own = textureIDs.insert(make_pair(textureName, createTexture(pixels->second, GL_REPEAT))).first;
                 }
+                textureID = own->second;
+                textureMatrix = glm::mat4(1.0f);
+                return true;
+            }
+
+            // Bind a texture to unit 0, unless it is bound there already
+            // \return true if it was bound
+            bool bindTexture(GLuint textureID)
+            {
+                if (textureID == bound)
+                    return false;
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, textureID);
+                bound = textureID;
+                return true;
             }
 
             // Check if a texture exists
-            bool hasTexture(const string &textureName)
+            bool hasTexture(Symbol textureName)
             {
-                return textureIDs.find(textureName) != textureIDs.end();
+                return uploadedPixels.find(textureName) != uploadedPixels.end();
             }
 
             // Clean up textures
@@ -90,13 +244,158 @@ namespace sgraph
             {
                 for (auto it = textureIDs.begin(); it != textureIDs.end(); ++it)
                 {
-                    glDeleteTextures(1, &it->second);
+                    deleteTexture(it->second);
+                }
+                for (size_t i = 0; i < atlasPages.size(); i++)
+                {
+                    deleteTexture(atlasPages[i]);
                 }
                 textureIDs.clear();
+                uploadedPixels.clear();
+                atlasPages.clear();
+                atlasPlacements.clear();
+                atlasImages.clear();
             }
 
         private:
-            map<string, GLuint> textureIDs;
+            struct AtlasPlacement
+            {
+                GLuint page;
+                glm::mat4 textureMatrix;
+            };
+
+            // Pack the small textures into new atlas pages, in place of the old ones
+            void packAtlas(map<string, PixelHandle> &small)
+            {
+                for (size_t i = 0; i < atlasPages.size(); i++)
+                {
+                    deleteTexture(atlasPages[i]);
+                }
+                atlasPages.clear();
+                atlasPlacements.clear();
+                atlasImages = small;
+                atlas.build(small);
+                for (size_t i = 0; i < atlas.getPages().size(); i++)
+                {
+                    atlasPages.push_back(createTexture(atlas.getPages()[i], GL_CLAMP_TO_EDGE));
+                }
+                for (auto it = small.begin(); it != small.end(); ++it)
+                {
+                    const TextureAtlas::Placement *placement = atlas.find(it->first);
+                    if (placement != NULL)
+                    {
+                        AtlasPlacement placed;
+                        placed.page = atlasPages[placement->page];
+                        placed.textureMatrix = placement->textureMatrix;
+                        atlasPlacements[Symbol(it->first)] = placed;
+                    }
+                }
+            }
+
+            GLuint createTexture(const PixelHandle &image, GLint wrap)
+            {
+                GLuint textureID;
+                glGenTextures(1, &textureID);
+                bindTexture(textureID);
+
+                // Set texture parameters for mipmapping
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+                upload(image);
+                return textureID;
+            }
+
+            void deleteTexture(GLuint textureID)
+            {
+                glDeleteTextures(1, &textureID);
+                if (textureID == bound)
+                    bound = 0;
+            }
+
+            // Upload each mip level of a texture to the bound texture. Only an image
+            // without its levels has them generated here. Block compressed levels are
+            // uploaded as they are if the driver takes the format, and decoded first if not
+            void upload(const PixelHandle &image)
+            {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                ourutils::BlockCompression::Format format = image->getFormat();
+                bool compressed = (format != ourutils::BlockCompression::NONE) && supports(format);
+                vector<GLubyte> decoded;
+                const GLubyte *level = image->data();
+                int width = image->getWidth();
+                int height = image->getHeight();
+                for (int l = 0; l < image->getLevels(); l++)
+                {
+                    GLsizei size = (GLsizei)PixelBuffer::levelSize(width, height, format);
+                    if (compressed)
+                    {
+                        glCompressedTexImage2D(GL_TEXTURE_2D, l, glFormat(format), width, height, 0, size, level);
+                    }
+                    else if (format != ourutils::BlockCompression::NONE)
+                    {
+                        decoded.resize(3 * (size_t)width * height);
+                        ourutils::BlockCompression::decode(format, level, width, height, decoded.data());
+                        glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, width, height,
+                                     0, GL_RGB, GL_UNSIGNED_BYTE, decoded.data());
+                    }
+                    else
+                    {
+                        glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, width, height,
+                                     0, GL_RGB, GL_UNSIGNED_BYTE, level);
+                    }
+                    level += size;
+                    width = (width > 1) ? width / 2 : 1;
+                    height = (height > 1) ? height / 2 : 1;
+                }
+                if (image->getLevels() > 1)
+                {
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image->getLevels() - 1);
+                }
+                else
+                {
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+                    glGenerateMipmap(GL_TEXTURE_2D);
+                }
+            }
+
+            static GLenum glFormat(ourutils::BlockCompression::Format format)
+            {
+                return (format == ourutils::BlockCompression::BC1) ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                                                   : GL_COMPRESSED_RGBA_BPTC_UNORM;
+            }
+
+            // Check, once, whether the driver lists a block format among the ones it takes
+            bool supports(ourutils::BlockCompression::Format format)
+            {
+                if (compressedFormats.empty())
+                {
+                    GLint count = 0;
+                    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+                    compressedFormats.assign(count + 1, 0);
+                    if (count > 0)
+                        glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, compressedFormats.data());
+                }
+                return find(compressedFormats.begin(), compressedFormats.end(), (GLint)glFormat(format)) !=
+                       compressedFormats.end();
+            }
+
+            // the textures uploaded on their own
+            unordered_map<Symbol, GLuint> textureIDs;
+            // the pixels each texture was uploaded from, held so they cannot be
+            // freed and their address reused by a different image
+            unordered_map<Symbol, PixelHandle> uploadedPixels;
+            TextureAtlas atlas;
+            // the images packed into the atlas, and where each one went
+            map<string, PixelHandle> atlasImages;
+            vector<GLuint> atlasPages;
+            unordered_map<Symbol, AtlasPlacement> atlasPlacements;
+            // the texture bound to unit 0 by this manager
+            GLuint bound;
+            // the block formats the driver takes, and a 0 so that the list is not empty once looked up
+            vector<GLint> compressedFormats;
         };
 
         TextureManager textureManager;
@@ -108,13 +407,26 @@ namespace sgraph
         GLScenegraphRenderer(
             stack<glm::mat4> &mv,
             map<string, util::ObjectInstance *> &os,
-            map<string, util::TextureImage> &txs,
+            map<string, PixelHandle> &txs,
             util::ShaderLocationsVault &shaderLocations) : modelview(mv), objects(os), textures(txs), shaderLocations(shaderLocations)
         {
-            this->maxLights = 10; // Must match MAXLIGHTS in the shader
+            this->maxLights = 64; // Must match MAXLIGHTS in the shader
+            this->queued = true;
+            this->instancing = true;
+            this->worldNode = NULL;
+            this->viewKnown = false;
+            this->uncached = 0;
+            this->hasProjection = false;
+            this->culling = true;
+            this->insideFrustum = 0;
+
+            findUniformLocations();
+            createLightBuffer();
+            createMaterialBuffer();
 
             // Create texture IDs
             textureManager.createTextureIDs(textures);
+            updateObjects();
 
             for (map<string, util::ObjectInstance *>::iterator it = objects.begin(); it != objects.end(); it++)
             {
@@ -123,131 +435,341 @@ namespace sgraph
         }
 
         /**
-         * @brief Set the lights to use for rendering
+         * @brief Bring the GL textures up to date with a reloaded set of images.
+         * Textures whose pixels did not change are left as they are
          */
-        void setLights(const vector<util::Light> &lights)
+        void updateTextures(map<string, PixelHandle> &txs)
         {
-            this->lights = lights;
+            textures = txs;
+            textureManager.updateTextureIDs(textures);
         }
 
         /**
-         * @brief Recur to the children for drawing
+         * @brief Look up the object instances again after they were added to or
+         * removed from the map this renderer was given
          */
-        void visitGroupNode(GroupNode *groupNode)
+        void updateObjects()
         {
-            for (int i = 0; i < groupNode->getChildren().size(); i = i + 1)
+            objectsByName.clear();
+            meshesById.clear();
+            for (map<string, util::ObjectInstance *>::iterator it = objects.begin(); it != objects.end(); it++)
             {
-                groupNode->getChildren()[i]->accept(this);
+                Mesh mesh;
+                mesh.object = it->second;
+                mesh.id = (uint32_t)meshesById.size();
+                map<string, InstancedMesh *>::iterator instanced = instancedMeshes.find(it->first);
+                mesh.instanced = (instanced != instancedMeshes.end()) ? instanced->second : NULL;
+                objectsByName[Symbol(it->first)] = mesh;
+                meshesById.push_back(mesh);
             }
         }
 
         /**
-         * @brief Draw the instance for the leaf
+         * @brief Make the copies of the meshes that leaves sharing a mesh and a texture
+         * are drawn from with one instanced call. Copies are made again for the meshes
+         * listed as changed, and for none if the shader cannot draw instances. The
+         * object instances are then looked up again, as updateObjects does
          */
-        void visitLeafNode(LeafNode *leafNode)
+        void setMeshes(map<string, util::PolygonMesh<VertexAttrib>> &meshes, const set<string> &changedMeshes)
         {
-            // send modelview matrix to GPU
-            glUniformMatrix4fv(
-                shaderLocations.getLocation("modelview"),
-                1,
-                GL_FALSE,
-                glm::value_ptr(modelview.top()));
+            for (map<string, InstancedMesh *>::iterator it = instancedMeshes.begin(); it != instancedMeshes.end();)
+            {
+                if ((meshes.find(it->first) == meshes.end()) || (changedMeshes.count(it->first) > 0))
+                {
+                    it->second->cleanup();
+                    delete it->second;
+                    it = instancedMeshes.erase(it);
+                }
+                else
+                {
+                    it++;
+                }
+            }
+            if (locations.instanced >= 0)
+            {
+                for (map<string, util::PolygonMesh<VertexAttrib>>::iterator it = meshes.begin(); it != meshes.end(); it++)
+                {
+                    if (instancedMeshes.find(it->first) == instancedMeshes.end())
+                        instancedMeshes[it->first] = new InstancedMesh(it->second, shaderLocations);
+                }
+            }
+            updateObjects();
+        }
 
-            // Calculate normal matrix
-            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelview.top())));
-            glUniformMatrix4fv(
-                shaderLocations.getLocation("normalmatrix"),
-                1,
-                GL_FALSE,
-                glm::value_ptr(glm::mat4(normalMatrix)));
+        /**
+         * @brief Set the meshes whose texture coordinates leave [0,1]. They repeat
+         * their textures, so they are drawn with textures of their own rather than
+         * with atlas pages
+         */
+        void setRepeatingMeshes(const set<string> &meshes)
+        {
+            repeatingMeshes.clear();
+            for (set<string>::const_iterator it = meshes.begin(); it != meshes.end(); it++)
+            {
+                repeatingMeshes.insert(Symbol(*it));
+            }
+        }
 
-            // Texture matrix (identity by default)
-            glm::mat4 texMatrix(1.0f);
-            glUniformMatrix4fv(
-                shaderLocations.getLocation("texturematrix"),
-                1,
-                GL_FALSE,
-                glm::value_ptr(texMatrix));
+        /**
+         * @brief Set the lights to use for rendering. They are written to the
+         * Lights uniform block here, once for the frame, rather than for each leaf
+         */
+        void setLights(const vector<util::Light> &lights)
+        {
+            int count = min((int)lights.size(), maxLights);
+            reinterpret_cast<LightBlockHeader *>(&lightData[0])->numLights = count;
+            LightData *block = reinterpret_cast<LightData *>(&lightData[sizeof(LightBlockHeader)]);
+            for (int i = 0; i < count; i++)
+            {
+                LightData &light = block[i];
+                light.ambient = glm::vec4(lights[i].getAmbient(), 0);
+                light.diffuse = glm::vec4(lights[i].getDiffuse(), 0);
+                light.specular = glm::vec4(lights[i].getSpecular(), 0);
+                light.position = lights[i].getPosition();
+                light.spotDirection = lights[i].getSpotDirection();
+                light.spotCutoff = 0;
+                if (lights[i].getSpotCutoff() > 0.0f)
+                {
+                    light.spotCutoff = cos(glm::radians(lights[i].getSpotCutoff()));
+                    light.type = 2; // 2 = SPOT
+                }
+                else if (lights[i].getPosition().w == 0.0f)
+                {
+                    light.type = 1; // 1 = DIRECTIONAL
+                }
+                else
+                {
+                    light.type = 0; // 0 = POINT
+                }
+            }
 
-            // Get the material
-            util::Material mat = leafNode->getMaterial();
+            // only the lights in use are sent
+            glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlockHeader) + count * sizeof(LightData), &lightData[0]);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
 
-            // Send material to shader
-            if (shaderLocations.getLocation("material.ambient") >= 0)
+        /**
+         * @brief Recur to the children for drawing
+         */
+        void visitGroupNode(GroupNode *groupNode)
+        {
+            Frustum::Result result = testFrustum(groupNode, groupNode->isBoundsCurrent());
+            if (result == Frustum::OUTSIDE)
             {
-                glUniform3fv(shaderLocations.getLocation("material.ambient"), 1, glm::value_ptr(glm::vec3(mat.getAmbient())));
-                glUniform3fv(shaderLocations.getLocation("material.diffuse"), 1, glm::value_ptr(glm::vec3(mat.getDiffuse())));
-                glUniform3fv(shaderLocations.getLocation("material.specular"), 1, glm::value_ptr(glm::vec3(mat.getSpecular())));
-                glUniform1f(shaderLocations.getLocation("material.shininess"), mat.getShininess());
+                return;
             }
+            enterFrustum(result);
+            // a group that moved since the world transforms were updated has stale ones below it
+            bool stale = (uncached == 0) && !groupNode->isWorldCurrent();
+            if (stale)
+            {
+                pushTransform(glm::mat4(1.0f), glm::mat3(1.0f));
+            }
+            const vector<SGNode *> &children = groupNode->getChildren();
+            for (int i = 0; i < children.size(); i = i + 1)
+            {
+                visitChild(groupNode, children[i]);
+            }
+            if (stale)
+            {
+                popTransform();
+            }
+            leaveFrustum(result);
+        }
 
-            // For backward compatibility
-            glUniform4fv(shaderLocations.getLocation("vColor"), 1, glm::value_ptr(mat.getAmbient()));
-
-            // Send light information
-            if (shaderLocations.getLocation("numLights") >= 0)
+        /**
+         * @brief Draw the instance for the leaf, or queue it to be drawn at the
+         * next flush
+         */
+        void visitLeafNode(LeafNode *leafNode)
+        {
+            // a leaf's bounds are current whenever the transforms above it are
+            if (testFrustum(leafNode, true) == Frustum::OUTSIDE)
+            {
+                return;
+            }
+            unordered_map<Symbol, Mesh>::iterator object = objectsByName.find(leafNode->getInstanceSymbol());
+            if (object == objectsByName.end())
             {
-                glUniform1i(shaderLocations.getLocation("numLights"), min((int)lights.size(), maxLights));
+                return;
+            }
 
-                for (int i = 0; i < min((int)lights.size(), maxLights); i++)
-                {
-                    string prefix = "light[" + to_string(i) + "].";
+            DrawPacket packet;
+            // below a template or a child shared with a later parent, both matrices come from the stacks
+            if (uncached > 0)
+            {
+                packet.modelview = modelview.top();
+                packet.normalMatrix = normals.back();
+            }
+            else if (worldNode != NULL)
+            {
+                refreshView();
+                packet.modelview = modelview.top() * worldNode->getWorldTransform();
+                packet.normalMatrix = viewNormal * worldNode->getWorldNormalMatrix();
+            }
+            else
+            {
+                refreshView();
+                packet.modelview = modelview.top();
+                packet.normalMatrix = viewNormal;
+            }
+            packet.object = object->second.object;
+            packet.mesh = object->second.id;
+            packet.material = queue.addMaterial(MaterialValues(leafNode->getMaterial()));
+            packet.depth = -packet.modelview[3][2];
 
-                    glUniform3fv(shaderLocations.getLocation(prefix + "ambient"), 1, glm::value_ptr(lights[i].getAmbient()));
-                    glUniform3fv(shaderLocations.getLocation(prefix + "diffuse"), 1, glm::value_ptr(lights[i].getDiffuse()));
-                    glUniform3fv(shaderLocations.getLocation(prefix + "specular"), 1, glm::value_ptr(lights[i].getSpecular()));
-                    glUniform4fv(shaderLocations.getLocation(prefix + "position"), 1, glm::value_ptr(lights[i].getPosition()));
+            // Find the texture, and the part of it the leaf uses
+            packet.texture = 0;
+            glm::mat4 texMatrix(1.0f);
+            Symbol texName = leafNode->getTextureSymbol();
+            if ((locations.useTexture >= 0) && !texName.empty() && textureManager.hasTexture(texName))
+            {
+                textureManager.findTexture(texName, repeatingMeshes.count(leafNode->getInstanceSymbol()) > 0, packet.texture, texMatrix);
+            }
+            packet.textureTransform = glm::vec4(texMatrix[0][0], texMatrix[1][1], texMatrix[3][0], texMatrix[3][1]);
 
-                    // For spotlights
-                    if (lights[i].getSpotCutoff() > 0.0f)
-                    {
-                        glUniform4fv(shaderLocations.getLocation(prefix + "spotDirection"), 1, glm::value_ptr(lights[i].getSpotDirection()));
-                        glUniform1f(shaderLocations.getLocation(prefix + "spotCutoff"), cos(glm::radians(lights[i].getSpotCutoff())));
-                        glUniform1i(shaderLocations.getLocation(prefix + "type"), 2); // 2 = SPOT
-                    }
-                    else if (lights[i].getPosition().w == 0.0f)
-                    {
-                        glUniform1i(shaderLocations.getLocation(prefix + "type"), 1); // 1 = DIRECTIONAL
-                    }
-                    else
-                    {
-                        glUniform1i(shaderLocations.getLocation(prefix + "type"), 0); // 0 = POINT
-                    }
-                }
+            if (queued)
+            {
+                queue.add(packet);
+            }
+            else
+            {
+                draw(packet);
             }
+        }
 
-            // Handle texture
-            if (shaderLocations.getLocation("useTexture") >= 0)
+        /**
+         * @brief Draw the queued leaves, sorted to change as little state as possible,
+         * and empty the queue. Call this after each walk of the scene graph, whether
+         * leaves are queued or not
+         */
+        void flush()
+        {
+            const vector<uint32_t> &order = queue.sort();
+            materialsSent = false;
+            size_t first = 0;
+            while (first < order.size())
             {
-                string texName = leafNode->getTexture().getName();
-                if (texName != "" && textureManager.hasTexture(texName))
+                // the sort brings leaves with the same mesh and texture together
+                const DrawPacket &packet = queue.getPacket(order[first]);
+                size_t last = first + 1;
+                while ((last < order.size()) && (queue.getPacket(order[last]).mesh == packet.mesh) && (queue.getPacket(order[last]).texture == packet.texture))
                 {
-                    glUniform1i(shaderLocations.getLocation("useTexture"), 1);
-                    glUniform1i(shaderLocations.getLocation("image"), 0); // Use texture unit 0
-                    textureManager.bindTexture(texName, GL_TEXTURE0);
+                    last++;
                 }
-                else
+                if (!instancing || (last - first < 2) || !drawInstanced(order, first, last))
                 {
-                    glUniform1i(shaderLocations.getLocation("useTexture"), 0);
+                    for (size_t i = first; i < last; i++)
+                    {
+                        draw(queue.getPacket(order[i]));
+                    }
                 }
+                first = last;
             }
+            queue.clear();
+            // the instanced uniform keeps its value into the next walk, unlike the bound mesh
+            bool instanced = submitted.instanced;
+            submitted = SubmittedState();
+            submitted.instanced = instanced;
+            // the next walk may be with a different view
+            viewKnown = false;
+        }
 
-            // Draw the object
-            objects[leafNode->getInstanceOf()]->draw();
+        /**
+         * @brief Choose between drawing each leaf as it is visited, in scene order,
+         * and queueing the leaves until flush. Leaves are queued by default
+         */
+        void setQueued(bool queued)
+        {
+            this->queued = queued;
         }
 
         /**
-         * @brief Multiply the transform to the modelview and recur to child
+         * @brief Choose whether queued leaves that share a mesh and a texture are drawn
+         * with one instanced call. They are by default, if the shader can draw instances
+         */
+        void setInstancing(bool instancing)
+        {
+            this->instancing = instancing;
+        }
+
+        /**
+         * @brief Set the projection the scene is drawn with. Subtrees whose bounds lie
+         * outside the view frustum are then skipped, if culling is on
+         */
+        void setProjection(const glm::mat4 &projection)
+        {
+            this->projection = projection;
+            hasProjection = true;
+            viewKnown = false;
+        }
+
+        /**
+         * @brief Choose whether subtrees outside the view frustum are skipped. They are
+         * by default, once the projection is known
+         */
+        void setCulling(bool culling)
+        {
+            this->culling = culling;
+        }
+
+        /**
+         * @brief Counts of what was drawn, of the GL draw calls it took, of the
+         * state that changed for it and of what was culled
+         */
+        struct RenderStats
+        {
+            long long draws, drawCalls, textureBinds, meshChanges, materialChanges;
+            // the nodes found to be outside the view frustum, each skipped with everything below it
+            long long culled;
+
+            RenderStats() : draws(0), drawCalls(0), textureBinds(0), meshChanges(0), materialChanges(0), culled(0) {}
+        };
+
+        const RenderStats &getStats() const
+        {
+            return stats;
+        }
+
+        void resetStats()
+        {
+            stats = RenderStats();
+        }
+
+        /**
+         * @brief Recur to the child with the world transform cached at this node, if
+         * it is up to date, or else with the transform multiplied to the modelview
          */
         void visitTransformNode(TransformNode *transformNode)
         {
-            modelview.push(modelview.top());
-            modelview.top() = modelview.top() * transformNode->getTransform();
-            if (transformNode->getChildren().size() > 0)
+            Frustum::Result result = testFrustum(transformNode, transformNode->isBoundsCurrent());
+            if (result == Frustum::OUTSIDE)
             {
-                transformNode->getChildren()[0]->accept(this);
+                return;
             }
-            modelview.pop();
+            enterFrustum(result);
+            const vector<SGNode *> &children = transformNode->getChildren();
+            if ((uncached == 0) && transformNode->isWorldCurrent())
+            {
+                TransformNode *above = worldNode;
+                worldNode = transformNode;
+                if (children.size() > 0)
+                {
+                    visitChild(transformNode, children[0]);
+                }
+                worldNode = above;
+            }
+            else
+            {
+                pushTransform(transformNode->getTransform(), transformNode->getNormalMatrix());
+                if (children.size() > 0)
+                {
+                    children[0]->accept(this);
+                }
+                popTransform();
+            }
+            leaveFrustum(result);
         }
 
         void visitScaleTransform(ScaleTransform *scaleNode)
@@ -265,9 +787,414 @@ namespace sgraph
             visitTransformNode(rotateNode);
         }
 
+        /**
+         * @brief The nodes of an imported template are shared by every instance of it,
+         * so they have no world transforms of their own: they are drawn with the
+         * modelview stack
+         */
+        void visitInstanceNode(InstanceNode *instanceNode)
+        {
+            // the instance has bounds of its own, though the nodes of its template do not
+            if (testFrustum(instanceNode, instanceNode->isBoundsCurrent()) == Frustum::OUTSIDE)
+            {
+                return;
+            }
+            pushTransform(instanceNode->getTransform(), instanceNode->getNormalMatrix());
+            const vector<SGNode *> &children = instanceNode->getChildren();
+            if (children.size() > 0)
+            {
+                children[0]->accept(this);
+            }
+            popTransform();
+        }
+
         ~GLScenegraphRenderer()
         {
             textureManager.cleanup();
+            glDeleteBuffers(1, &lightBuffer);
+            glDeleteBuffers(1, &materialBuffer);
+            for (map<string, InstancedMesh *>::iterator it = instancedMeshes.begin(); it != instancedMeshes.end(); it++)
+            {
+                it->second->cleanup();
+                delete it->second;
+            }
+        }
+
+    private:
+        /**
+         * The state the last draw left behind, so that the next one sets only what
+         * differs
+         */
+        struct SubmittedState
+        {
+            util::ObjectInstance *object;
+            bool hasMaterial;
+            MaterialValues material;
+            bool textured;
+            glm::vec4 textureTransform;
+
+            bool instanced;
+
+            SubmittedState() : object(NULL), hasMaterial(false), textured(false), textureTransform(0, 0, 0, 0), instanced(false) {}
+        };
+
+        /**
+         * The nearest transform node above, for its cached world transform and normal
+         * matrix, while those can be used, or NULL if there is none. The modelview stack
+         * then holds only the view.
+         */
+        TransformNode *worldNode;
+        /**
+         * How deep the walk is below the first node whose cached world transforms
+         * could not be used. Below it, every transform is multiplied on the modelview
+         * stack as it is visited.
+         */
+        int uncached;
+        // the normal matrix of each modelview pushed below that node
+        vector<glm::mat3> normals;
+        // whether the normal matrix and the frustum of the view were taken in this walk
+        bool viewKnown;
+        glm::mat3 viewNormal;
+        glm::mat4 projection;
+        bool hasProjection;
+        bool culling;
+        Frustum frustum;
+        /**
+         * How deep the walk is below a node entirely inside the frustum, where
+         * nothing more needs to be tested
+         */
+        int insideFrustum;
+        // the leaves waiting to be drawn, when they are queued
+        RenderQueue queue;
+        bool queued;
+        bool instancing;
+        vector<InstanceData> instances;
+        // whether this frame's materials are in the Materials block yet
+        bool materialsSent;
+        SubmittedState submitted;
+        RenderStats stats;
+
+        /**
+         * Push the modelview for a node whose cached world transform cannot be used:
+         * the world transform of the cached part above it, if this is the first such
+         * node, then its own transform. Its normal matrix is pushed alongside, made
+         * the same way from the normal matrices, so that no inverse is needed.
+         */
+        void pushTransform(const glm::mat4 &transform, const glm::mat3 &normal)
+        {
+            if (uncached > 0)
+            {
+                modelview.push(modelview.top() * transform);
+                normals.push_back(normals.back() * normal);
+            }
+            else if (worldNode != NULL)
+            {
+                refreshView();
+                modelview.push(modelview.top() * worldNode->getWorldTransform() * transform);
+                normals.push_back(viewNormal * worldNode->getWorldNormalMatrix() * normal);
+            }
+            else
+            {
+                refreshView();
+                modelview.push(modelview.top() * transform);
+                normals.push_back(viewNormal * normal);
+            }
+            uncached++;
+        }
+
+        void popTransform()
+        {
+            modelview.pop();
+            normals.pop_back();
+            uncached--;
+        }
+
+        /**
+         * Visit a child of a node. A child that was added to another parent after this
+         * one has the cached world transforms of that parent, so it is drawn with the
+         * modelview stack here, as the nodes of a template are.
+         */
+        void visitChild(ParentSGNode *parent, SGNode *child)
+        {
+            if (!parent->isSharedChild(child))
+            {
+                child->accept(this);
+                return;
+            }
+            pushTransform(glm::mat4(1.0f), glm::mat3(1.0f));
+            child->accept(this);
+            popTransform();
+        }
+
+        /**
+         * Take the normal matrix and the frustum of the view from the top of the
+         * modelview stack, once a walk. Only call this while the cached world
+         * transforms are in use, when the stack holds only the view.
+         */
+        void refreshView()
+        {
+            if (viewKnown)
+            {
+                return;
+            }
+            viewNormal = TransformNode::normalMatrixOf(modelview.top(), false);
+            if (hasProjection)
+            {
+                frustum.set(projection * modelview.top());
+            }
+            viewKnown = true;
+        }
+
+        /**
+         * Test the world bounds of a node against the view frustum. The test is
+         * skipped, and the node treated as intersecting, if culling is off, if the
+         * bounds are not current, if the walk is below a node whose cached world
+         * transforms could not be used, or if it is below one entirely inside
+         */
+        Frustum::Result testFrustum(SGNode *node, bool boundsCurrent)
+        {
+            if (!culling || !hasProjection || !boundsCurrent || (uncached > 0) || (insideFrustum > 0))
+            {
+                return Frustum::INTERSECTS;
+            }
+            refreshView();
+            Frustum::Result result = frustum.test(node->getWorldBounds());
+            if (result == Frustum::OUTSIDE)
+            {
+                stats.culled++;
+            }
+            return result;
+        }
+
+        void enterFrustum(Frustum::Result result)
+        {
+            if (result == Frustum::INSIDE)
+            {
+                insideFrustum++;
+            }
+        }
+
+        void leaveFrustum(Frustum::Result result)
+        {
+            if (result == Frustum::INSIDE)
+            {
+                insideFrustum--;
+            }
+        }
+
+        void draw(const DrawPacket &packet)
+        {
+            if (submitted.instanced)
+            {
+                glUniform1i(locations.instanced, 0);
+                submitted.instanced = false;
+            }
+
+            // send modelview matrix to GPU
+            glUniformMatrix4fv(
+                locations.modelview,
+                1,
+                GL_FALSE,
+                glm::value_ptr(packet.modelview));
+
+            // send the normal matrix, worked out as the leaf was visited
+            glUniformMatrix3fv(
+                locations.normalmatrix,
+                1,
+                GL_FALSE,
+                glm::value_ptr(packet.normalMatrix));
+
+            // Send material to shader
+            const MaterialValues &mat = queue.getMaterial(packet.material);
+            if (!submitted.hasMaterial || !(submitted.material == mat))
+            {
+                if (locations.ambient >= 0)
+                {
+                    glUniform3fv(locations.ambient, 1, glm::value_ptr(mat.ambient));
+                    glUniform3fv(locations.diffuse, 1, glm::value_ptr(mat.diffuse));
+                    glUniform3fv(locations.specular, 1, glm::value_ptr(mat.specular));
+                    glUniform1f(locations.shininess, mat.shininess);
+                }
+
+                // For backward compatibility
+                glUniform4fv(locations.vColor, 1, glm::value_ptr(mat.color));
+                stats.materialChanges++;
+            }
+            submitted.hasMaterial = true;
+            submitted.material = mat;
+
+            // Handle texture
+            bool textured = packet.texture != 0;
+            if (textured)
+            {
+                if (textureManager.bindTexture(packet.texture))
+                    stats.textureBinds++;
+                if (packet.textureTransform != submitted.textureTransform)
+                {
+                    glm::mat4 texMatrix(1.0f);
+                    texMatrix[0][0] = packet.textureTransform.x;
+                    texMatrix[1][1] = packet.textureTransform.y;
+                    texMatrix[3][0] = packet.textureTransform.z;
+                    texMatrix[3][1] = packet.textureTransform.w;
+                    glUniformMatrix4fv(
+                        locations.texturematrix,
+                        1,
+                        GL_FALSE,
+                        glm::value_ptr(texMatrix));
+                    submitted.textureTransform = packet.textureTransform;
+                }
+            }
+            if ((locations.useTexture >= 0) && ((textured != submitted.textured) || (submitted.object == NULL)))
+            {
+                glUniform1i(locations.useTexture, textured ? 1 : 0);
+                glUniform1i(locations.image, 0); // Use texture unit 0
+            }
+            submitted.textured = textured;
+
+            // Draw the object
+            if (packet.object != submitted.object)
+                stats.meshChanges++;
+            submitted.object = packet.object;
+            packet.object->draw();
+            stats.draws++;
+            stats.drawCalls++;
+        }
+
+        /**
+         * Draw the packets order[first] to order[last - 1], which share a mesh and a
+         * texture, with one instanced call
+         * \return false if they cannot be drawn that way
+         */
+        bool drawInstanced(const vector<uint32_t> &order, size_t first, size_t last)
+        {
+            const DrawPacket &packet = queue.getPacket(order[first]);
+            InstancedMesh *mesh = meshesById[packet.mesh].instanced;
+            if ((mesh == NULL) || (locations.materials == GL_INVALID_INDEX))
+                return false;
+            instances.resize(last - first);
+            for (size_t i = first; i < last; i++)
+            {
+                const DrawPacket &instance = queue.getPacket(order[i]);
+                if (instance.material >= MAX_MATERIALS)
+                    return false;
+                InstanceData &data = instances[i - first];
+                data.modelview = instance.modelview;
+                data.normalMatrix = instance.normalMatrix;
+                data.textureTransform = instance.textureTransform;
+                data.material = (GLfloat)instance.material;
+            }
+            if (!materialsSent)
+            {
+                sendMaterials();
+            }
+
+            if (!submitted.instanced)
+            {
+                glUniform1i(locations.instanced, 1);
+                submitted.instanced = true;
+            }
+            bool textured = packet.texture != 0;
+            if (textured && textureManager.bindTexture(packet.texture))
+                stats.textureBinds++;
+            if ((locations.useTexture >= 0) && ((textured != submitted.textured) || (submitted.object == NULL)))
+            {
+                glUniform1i(locations.useTexture, textured ? 1 : 0);
+                glUniform1i(locations.image, 0); // Use texture unit 0
+            }
+            submitted.textured = textured;
+            if (packet.object != submitted.object)
+                stats.meshChanges++;
+            submitted.object = packet.object;
+
+            mesh->draw(&instances[0], (GLsizei)instances.size());
+            stats.draws += instances.size();
+            stats.drawCalls++;
+            return true;
+        }
+
+        /**
+         * Write the materials of this frame to the Materials uniform block: the
+         * material properties, then the colors
+         */
+        void sendMaterials()
+        {
+            size_t count = min(queue.getMaterialCount(), (size_t)MAX_MATERIALS);
+            MaterialData *properties = reinterpret_cast<MaterialData *>(&materialData[0]);
+            glm::vec4 *colors = reinterpret_cast<glm::vec4 *>(&materialData[MAX_MATERIALS * sizeof(MaterialData)]);
+            for (size_t i = 0; i < count; i++)
+            {
+                const MaterialValues &material = queue.getMaterial((uint32_t)i);
+                properties[i].ambient = glm::vec4(material.ambient, 0);
+                properties[i].diffuse = glm::vec4(material.diffuse, 0);
+                properties[i].specular = material.specular;
+                properties[i].shininess = material.shininess;
+                colors[i] = material.color;
+            }
+            glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(MaterialData), &materialData[0]);
+            glBufferSubData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialData), count * sizeof(glm::vec4), colors);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            materialsSent = true;
+            stats.materialChanges++;
+        }
+
+        void findUniformLocations()
+        {
+            locations.modelview = shaderLocations.getLocation("modelview");
+            locations.normalmatrix = shaderLocations.getLocation("normalmatrix");
+            locations.texturematrix = shaderLocations.getLocation("texturematrix");
+            locations.ambient = shaderLocations.getLocation("material.ambient");
+            locations.diffuse = shaderLocations.getLocation("material.diffuse");
+            locations.specular = shaderLocations.getLocation("material.specular");
+            locations.shininess = shaderLocations.getLocation("material.shininess");
+            locations.vColor = shaderLocations.getLocation("vColor");
+            locations.useTexture = shaderLocations.getLocation("useTexture");
+            locations.image = shaderLocations.getLocation("image");
+            locations.instanced = shaderLocations.getLocation("instanced");
+        }
+
+        /**
+         * Make the buffer behind the Lights uniform block of the current program,
+         * with room for every light, and attach it to the block
+         */
+        void createLightBuffer()
+        {
+            lightData.assign(sizeof(LightBlockHeader) + maxLights * sizeof(LightData), 0);
+            glGenBuffers(1, &lightBuffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, lightData.size(), &lightData[0], GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BINDING, lightBuffer);
+
+            GLint program = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+            GLuint block = glGetUniformBlockIndex(program, "Lights");
+            if (block != GL_INVALID_INDEX)
+            {
+                glUniformBlockBinding(program, block, LIGHTS_BINDING);
+            }
+        }
+
+        /**
+         * Make the buffer behind the Materials uniform block of the current program
+         * and attach it to the block. Without the block, nothing is drawn instanced
+         */
+        void createMaterialBuffer()
+        {
+            materialData.assign(MAX_MATERIALS * (sizeof(MaterialData) + sizeof(glm::vec4)), 0);
+            glGenBuffers(1, &materialBuffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, materialData.size(), &materialData[0], GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, MATERIALS_BINDING, materialBuffer);
+
+            GLint program = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+            locations.materials = glGetUniformBlockIndex(program, "Materials");
+            if (locations.materials != GL_INVALID_INDEX)
+            {
+                glUniformBlockBinding(program, locations.materials, MATERIALS_BINDING);
+            }
         }
     };
 }
@@ -25,7 +25,7 @@ namespace sgraph
     
 
   public:
-    GroupNode(const string& name,sgraph::IScenegraph *graph)
+    GroupNode(Symbol name,sgraph::IScenegraph *graph)
       :ParentSGNode(name,graph) {      
     }
 	
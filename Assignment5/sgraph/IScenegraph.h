@@ -3,9 +3,11 @@
 
 #include <glm/glm.hpp>
 #include "IVertexData.h"
+#include "PixelBuffer.h"
 #include "../../include/TextureImage.h"
 #include "PolygonMesh.h"
 #include "SGNode.h"
+#include "Symbol.h"
 #include "VertexAttrib.h"
 #include "Light.h"
 #include <vector>
@@ -45,7 +47,7 @@ namespace sgraph
      * \param name (hopefully unique) name given to this node
      * \param node the node object
      */
-    virtual void addNode(const string &name, SGNode *node) = 0;
+    virtual void addNode(Symbol name, SGNode *node) = 0;
 
     /**
      * Get the root of this scene graph
@@ -68,6 +70,13 @@ namespace sgraph
      */
     virtual vector<util::Light> getAllLightsInViewSpace(const glm::mat4 &viewMatrix) = 0;
 
+    /**
+     * Bring the cached world transforms and bounds of the nodes up to date. Only the
+     * subtrees that moved since the last update are visited, so this costs next to
+     * nothing when nothing moved. Call it once a frame, before the scene is drawn.
+     */
+    virtual void updateWorldTransforms() = 0;
+
     /**
      * Set the meshes used by this scene graph
      *
@@ -79,6 +88,14 @@ namespace sgraph
      */
     virtual void setImages(map<string, util::TextureImage> &images) = 0;
 
+    /**
+     * Set the pixels that the images of this scene graph point into. The scene
+     * graph holds them for as long as it lives.
+     *
+     * @param imagePixels
+     */
+    virtual void setImagePixels(map<string, PixelHandle> &imagePixels) = 0;
+
     /**
      * Set the mesh name ->mesh path for all meshes used by this scene graph
      *
@@ -99,6 +116,8 @@ namespace sgraph
 
     virtual map<string, util::TextureImage> getImages() = 0;
 
+    virtual map<string, PixelHandle> getImagePixels() = 0;
+
     /**
      * Get a map of each mesh name (as the leaves refer to it) and the path to the mesh file
      *
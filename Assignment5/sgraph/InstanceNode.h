@@ -0,0 +1,218 @@
+#ifndef _INSTANCENODE_H_
+#define _INSTANCENODE_H_
+
+#include "AssetCache.h"
+#include "ParentSGNode.h"
+#include "SGNodeVisitor.h"
+#include "TransformNode.h"
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+    /**
+     * This class holds the nodes parsed from an imported command file. Every
+     * import of the file refers to this one copy through an InstanceNode, so it
+     * must not be changed once it is built.
+     *
+     * It also remembers the files it was built from (the command file, the files
+     * that one imports, and its images) so that a changed file can be detected.
+     */
+    class SubtreeTemplate {
+        public:
+            SubtreeTemplate(SGNode *root,const map<string,string>& meshPaths,const map<string,string>& imagePaths,const vector<string>& sourceFiles)
+                :root(root),meshPaths(meshPaths),imagePaths(imagePaths),sourceFiles(sourceFiles),boundsKnown(false) {
+                for (int i=0;i<sourceFiles.size();i++) {
+                    addDependency(sourceFiles[i]);
+                }
+                for (map<string,string>::const_iterator it=imagePaths.begin();it!=imagePaths.end();it++) {
+                    addDependency(it->second);
+                }
+            }
+
+            ~SubtreeTemplate();
+
+            SGNode *getRoot() {
+                return root;
+            }
+
+            map<string,string>& getMeshPaths() {
+                return meshPaths;
+            }
+
+            map<string,string>& getImagePaths() {
+                return imagePaths;
+            }
+
+            /**
+             * Get the command files this template was parsed from
+             */
+            vector<string> getSourceFiles() {
+                return sourceFiles;
+            }
+
+            /**
+             * Get the box around the template in the coordinates of its root. It is
+             * worked out the first time it is asked for, as the template never changes.
+             * \param meshBounds the box around each mesh the leaves may refer to
+             */
+            const BoundingBox& getBounds(const MeshBounds &meshBounds) {
+                if (!boundsKnown) {
+                    bounds = BoundingBox();
+                    root->addBounds(glm::mat4(1.0),meshBounds,bounds);
+                    boundsKnown = true;
+                }
+                return bounds;
+            }
+
+            /**
+             * Forget the box around the template, for when the meshes it uses changed
+             */
+            void resetBounds() {
+                boundsKnown = false;
+            }
+
+            /**
+             * \return true if none of the files this template was built from has changed
+             */
+            bool isCurrent() {
+                for (int i=0;i<dependencies.size();i++) {
+                    string key;
+                    AssetCache::makeKey(dependencies[i].first,key);
+                    if (key!=dependencies[i].second) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        private:
+            void addDependency(const string& path) {
+                string key;
+                AssetCache::makeKey(path,key);
+                dependencies.push_back(make_pair(path,key));
+            }
+
+            SubtreeTemplate(const SubtreeTemplate&);
+            SubtreeTemplate& operator=(const SubtreeTemplate&);
+
+            SGNode *root;
+            map<string,string> meshPaths;
+            map<string,string> imagePaths;
+            vector<string> sourceFiles;
+            vector<pair<string,string> > dependencies;
+            BoundingBox bounds;
+            bool boundsKnown;
+    };
+
+    /**
+     * This node places a shared SubtreeTemplate in the scene graph. Its only child
+     * is the root of the template, which it does not own: deleting or cloning an
+     * instance leaves the template alone, so copies cost a single node.
+     *
+     * Like any transform it can also carry its own transformation, which is the
+     * identity unless one is given.
+     */
+    class InstanceNode: public TransformNode {
+        protected:
+            shared_ptr<SubtreeTemplate> subtree;
+
+            ParentSGNode *copyNode() {
+                return new InstanceNode(subtree,name,scenegraph,transform);
+            }
+
+        public:
+            InstanceNode(shared_ptr<SubtreeTemplate> subtree,Symbol name,sgraph::IScenegraph *graph,glm::mat4 transform=glm::mat4(1.0))
+                :TransformNode(name,graph),subtree(subtree) {
+                setTransform(transform);
+                // the template root is shared, so its parent is left unset
+                this->children.push_back(subtree->getRoot());
+            }
+
+            ~InstanceNode() {
+                // the template outlives this node
+                this->children.clear();
+            }
+
+            SGNode *clone() {
+                return copyNode();
+            }
+
+            /**
+             * The template is shared by every instance, so nothing can be added to it
+             * \throws runtime_error always
+             */
+            void addChild(SGNode *child) {
+                throw runtime_error("Cannot add a child to the imported node "+name.str());
+            }
+
+            /**
+             * Only this node is added to the scene graph, not the nodes of the
+             * template, so that the cost of an instance does not depend on its size
+             */
+            void setScenegraph(sgraph::IScenegraph *graph) {
+                AbstractSGNode::setScenegraph(graph);
+            }
+
+            shared_ptr<SubtreeTemplate> getTemplate() {
+                return subtree;
+            }
+
+            /**
+             * The nodes of the template are shared by every instance, so they have no
+             * single world transform. Only the world transform of this node is kept,
+             * with the box around the template moved to where this instance puts it.
+             */
+            void updateWorldTransforms(const glm::mat4 &parentWorld,const glm::mat3 &parentNormal,bool parentMoved,const MeshBounds &meshBounds) {
+                if (parentMoved || worldMoved) {
+                    world = parentWorld * transform;
+                    worldNormal = parentNormal * normal;
+                    worldBounds = subtree->getBounds(meshBounds).transformed(world);
+                }
+                worldMoved = movedBelow = false;
+            }
+
+            /**
+             * Visit this node.
+             *
+             */
+            void accept(SGNodeVisitor* visitor) {
+                visitor->visitInstanceNode(this);
+            }
+    };
+
+    /**
+     * Delete every node of the template once, even one that was added to two
+     * parents. Instances of other templates inside it only delete themselves.
+     */
+    inline SubtreeTemplate::~SubtreeTemplate() {
+        set<SGNode *> found;
+        vector<SGNode *> pending(1,root);
+        while (!pending.empty()) {
+            SGNode *node = pending.back();
+            pending.pop_back();
+            if ((node==NULL) || !found.insert(node).second) {
+                continue;
+            }
+            ParentSGNode *parent = dynamic_cast<ParentSGNode *>(node);
+            if ((parent!=NULL) && (dynamic_cast<InstanceNode *>(node)==NULL)) {
+                vector<SGNode *> children = parent->getChildren();
+                pending.insert(pending.end(),children.begin(),children.end());
+            }
+        }
+        for (set<SGNode *>::iterator it=found.begin();it!=found.end();it++) {
+            ParentSGNode *parent = dynamic_cast<ParentSGNode *>(*it);
+            if (parent!=NULL) {
+                parent->releaseChildren();
+            }
+            delete *it;
+        }
+    }
+}
+
+#endif
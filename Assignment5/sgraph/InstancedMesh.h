@@ -0,0 +1,134 @@
+#ifndef _INSTANCEDMESH_H_
+#define _INSTANCEDMESH_H_
+
+#include "PolygonMesh.h"
+#include "ShaderLocationsVault.h"
+#include "VertexAttrib.h"
+#include "glm/glm.hpp"
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * What changes from one instance of a mesh to the next, as the vertex shader
+ * reads it
+ */
+struct InstanceData {
+    glm::mat4 modelview;
+    glm::mat3 normalMatrix;
+    // the scale in x and y, then the offset, of the texture coordinates
+    glm::vec4 textureTransform;
+    // an index into the Materials uniform block, as a float attribute
+    GLfloat material;
+};
+
+/**
+ * A copy of a mesh on the GPU that is drawn many times with one call. The vertex
+ * array holds the mesh's positions, normals and texture coordinates as the
+ * object instances do, and a second buffer with an InstanceData for each copy,
+ * which advances once per instance.
+ */
+class InstancedMesh {
+  public:
+    /**
+     * Upload the mesh
+     * \param shaderLocations the locations of the vertex and instance
+     * attributes of the program it will be drawn with
+     */
+    InstancedMesh(util::PolygonMesh<VertexAttrib>& mesh, util::ShaderLocationsVault& shaderLocations) {
+        vector<VertexAttrib> vertices = mesh.getVertexAttributes();
+        vector<GLfloat> data;
+        data.reserve(12 * vertices.size());
+        const char* names[] = {"position", "normal", "texcoord"};
+        for (size_t i = 0; i < vertices.size(); i++) {
+            for (int a = 0; a < 3; a++) {
+                vector<float> values = vertices[i].getData(names[a]);
+                data.insert(data.end(), values.begin(), values.end());
+            }
+        }
+        vector<unsigned int> indices = mesh.getPrimitives();
+        indexCount = (GLsizei)indices.size();
+        primitiveType = mesh.getPrimitiveType();
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(3, buffers);
+        glBindVertexArray(vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[VERTICES]);
+        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), data.empty() ? NULL : &data[0], GL_STATIC_DRAW);
+        const char* attributes[] = {"vPosition", "vNormal", "vTexCoord"};
+        for (int a = 0; a < 3; a++) {
+            GLint location = shaderLocations.getLocation(attributes[a]);
+            if (location < 0)
+                continue;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 12 * sizeof(GLfloat),
+                                  reinterpret_cast<void*>(4 * a * sizeof(GLfloat)));
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[INDICES]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+                     indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+
+        // a mat4 takes four attribute locations and a mat3 three, a column in each
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[INSTANCES]);
+        instanceAttribute(shaderLocations.getLocation("instanceModelview"), 4, 4, offsetof(InstanceData, modelview));
+        instanceAttribute(shaderLocations.getLocation("instanceNormalMatrix"), 3, 3,
+                          offsetof(InstanceData, normalMatrix));
+        instanceAttribute(shaderLocations.getLocation("instanceTextureTransform"), 1, 4,
+                          offsetof(InstanceData, textureTransform));
+        instanceAttribute(shaderLocations.getLocation("instanceMaterial"), 1, 1, offsetof(InstanceData, material));
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    /**
+     * Draw one copy of the mesh for each instance, with a single call
+     */
+    void draw(const InstanceData* instances, GLsizei count) {
+        // new storage each time, so that the driver need not wait for the last draw to read the old
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[INSTANCES]);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), instances, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindVertexArray(vao);
+        glDrawElementsInstanced(primitiveType, indexCount, GL_UNSIGNED_INT, 0, count);
+        glBindVertexArray(0);
+    }
+
+    void cleanup() {
+        glDeleteBuffers(3, buffers);
+        glDeleteVertexArrays(1, &vao);
+    }
+
+  private:
+    enum Buffer { VERTICES, INDICES, INSTANCES };
+
+    /**
+     * Point the columns of an instance attribute at the instance buffer
+     */
+    static void instanceAttribute(GLint location, int columns, int size, size_t offset) {
+        if (location < 0)
+            return;
+        for (int c = 0; c < columns; c++) {
+            glEnableVertexAttribArray(location + c);
+            glVertexAttribPointer(location + c, size, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  reinterpret_cast<void*>(offset + c * size * sizeof(GLfloat)));
+            glVertexAttribDivisor(location + c, 1);
+        }
+    }
+
+    GLuint vao;
+    GLuint buffers[3];
+    GLsizei indexCount;
+    GLenum primitiveType;
+};
+
+} // namespace sgraph
+
+#endif
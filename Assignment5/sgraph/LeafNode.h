@@ -2,10 +2,11 @@
 #define _LEAFNODE_H_
 
 #include "AbstractSGNode.h"
+#include "ParentSGNode.h"
 #include "glm/glm.hpp"
 #include "Light.h"
 #include "Material.h"
-#include "../../include/TextureImage.h"
+#include "PixelBuffer.h"
 #include "SGNodeVisitor.h"
 
 #include <map>
@@ -26,7 +27,7 @@ class LeafNode : public AbstractSGNode {
      * in the scene graph itself, so that an instance can be reused in several leaves
      */
   protected:
-    string objInstanceName;
+    Symbol objInstanceName;
     /**
      * The material associated with the object instance at this leaf
      */
@@ -36,18 +37,32 @@ class LeafNode : public AbstractSGNode {
      */
     util::Light light;
     /**
-     * The image/texture associated with the object instance at this leaf
+     * The name of the image/texture associated with the object instance at this leaf
      */
-    util::TextureImage image;
+    Symbol textureName;
+    /**
+     * The pixels of the image above, shared with every other leaf that uses it
+     */
+    PixelHandle texturePixels;
+
+    /**
+     * \return the box around the mesh of this leaf, or one that covers everything if
+     * the mesh is not known, so that the leaf is never culled
+     */
+    BoundingBox getMeshBounds(const MeshBounds& meshBounds) {
+        MeshBounds::const_iterator it = meshBounds.find(objInstanceName);
+        return (it != meshBounds.end()) ? it->second : BoundingBox::unbounded();
+    }
 
   public:
     LeafNode(
-        const string& instanceOf, util::Material& material, util::Light& light, util::TextureImage& image, const string& name,
-        sgraph::IScenegraph* graph
+        Symbol instanceOf, util::Material& material, util::Light& light, Symbol textureName,
+        const PixelHandle& texturePixels, Symbol name, sgraph::IScenegraph* graph
     )
-        : AbstractSGNode(name, graph), objInstanceName(instanceOf), material(material), light(light), image(image) {}
+        : AbstractSGNode(name, graph), objInstanceName(instanceOf), material(material), light(light),
+          textureName(textureName), texturePixels(texturePixels) {}
 
-    LeafNode(const string& instanceOf, const string& name, sgraph::IScenegraph* graph)
+    LeafNode(Symbol instanceOf, Symbol name, sgraph::IScenegraph* graph)
         : AbstractSGNode(name, graph), objInstanceName(instanceOf) {}
 
     ~LeafNode() {}
@@ -65,7 +80,10 @@ class LeafNode : public AbstractSGNode {
     /*
      *Set the image/texture of each vertex in this object
      */
-    void setTexture(const util::TextureImage& img) { this->image = img; }
+    void setTexture(Symbol name, const PixelHandle& pixels) {
+        textureName = name;
+        texturePixels = pixels;
+    }
 
     /*
      * gets the material
@@ -78,16 +96,26 @@ class LeafNode : public AbstractSGNode {
     util::Light getLight() { return this->light; }
 
     /*
-     * gets the image/texture
+     * gets the pixels of the image/texture
      */
-    util::TextureImage getTexture() { return this-> image; }
+    PixelHandle getTexturePixels() { return this->texturePixels; }
 
     /**
      * Get the name of the instance this leaf contains
      *
      * @return string
      */
-    string getInstanceOf() { return this->objInstanceName; }
+    const string& getInstanceOf() { return this->objInstanceName.str(); }
+
+    /**
+     * Get the name of the instance this leaf contains as a symbol
+     */
+    Symbol getInstanceSymbol() { return this->objInstanceName; }
+
+    /**
+     * Get the name of the image/texture as a symbol
+     */
+    Symbol getTextureSymbol() { return textureName; }
 
     /**
      * Get a copy of this node.
@@ -96,10 +124,40 @@ class LeafNode : public AbstractSGNode {
      */
 
     SGNode* clone() {
-        LeafNode* newclone = new LeafNode(this->objInstanceName, material, light, image, name, scenegraph);
+        LeafNode* newclone =
+            new LeafNode(this->objInstanceName, material, light, textureName, texturePixels, name, scenegraph);
         return newclone;
     }
 
+    /**
+     * Sets the parent of this node. The parent's bounds must then be worked out again
+     * to cover this leaf, and so must those of a parent it already had, which now
+     * shares it
+     */
+    void setParent(SGNode* parent) {
+        ParentSGNode* before = dynamic_cast<ParentSGNode*>(this->parent);
+        AbstractSGNode::setParent(parent);
+        ParentSGNode* above = dynamic_cast<ParentSGNode*>(parent);
+        if (above != NULL)
+            above->invalidateWorld();
+        if ((before != NULL) && (before != above))
+            before->invalidateWorld();
+    }
+
+    /**
+     * A leaf has no transform, so its bounds only change when the world transform
+     * above it does
+     */
+    void updateWorldTransforms(const glm::mat4& parentWorld, const glm::mat3& parentNormal, bool parentMoved,
+                               const MeshBounds& meshBounds) {
+        if (parentMoved)
+            worldBounds = getMeshBounds(meshBounds).transformed(parentWorld);
+    }
+
+    void addBounds(const glm::mat4& frame, const MeshBounds& meshBounds, BoundingBox& bounds) {
+        bounds.add(getMeshBounds(meshBounds).transformed(frame));
+    }
+
     /**
      * Visit this node.
      *
@@ -0,0 +1,145 @@
+#ifndef _MIPCHAIN_H_
+#define _MIPCHAIN_H_
+
+#include "PixelBuffer.h"
+#include "TextureDiskCache.h"
+#include "../ourutils/ThreadPool.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class builds the mip levels of a texture on the CPU, so that the
+ * renderer can upload them as they are instead of generating them on the GL
+ * thread. The levels are laid out as textureformat describes, which lets the
+ * texture cache keep them with the image. Each level is a 2x2 box filter of the
+ * one before it; a level with an odd width or height drops the last column or
+ * row, as glGenerateMipmap does. The finished chain can then be compressed, one
+ * level at a time.
+ */
+class MipChain {
+  public:
+    /**
+     * \return the number of levels down to 1x1 for an image of this size
+     */
+    static int fullLevels(int width, int height) {
+        int levels = 1;
+        while ((width > 1) || (height > 1)) {
+            width = (width > 1) ? width / 2 : 1;
+            height = (height > 1) ? height / 2 : 1;
+            levels++;
+        }
+        return levels;
+    }
+
+    /**
+     * Get an image with every mip level, or with the given number of levels if
+     * that is fewer. An image that has them already is returned as it is;
+     * otherwise the largest level is copied and the rest are built from it.
+     */
+    static PixelHandle build(const PixelHandle& image, int levels = 0) {
+        int width = image->getWidth();
+        int height = image->getHeight();
+        if ((levels <= 0) || (levels > fullLevels(width, height)))
+            levels = fullLevels(width, height);
+        if (image->getLevels() >= levels)
+            return image;
+
+        GLubyte* pixels = new GLubyte[(size_t)textureformat::pixelBytes(width, height, levels)];
+        memcpy(pixels, image->data(), image->size());
+        GLubyte* level = pixels;
+        for (int l = 1; l < levels; l++) {
+            GLubyte* next = level + 3 * (size_t)width * height;
+            int nextWidth = (width > 1) ? width / 2 : 1;
+            int nextHeight = (height > 1) ? height / 2 : 1;
+            downsample(level, width, height, next, nextWidth, nextHeight);
+            level = next;
+            width = nextWidth;
+            height = nextHeight;
+        }
+        return PixelBuffer::adopt(pixels, image->getWidth(), image->getHeight(), levels);
+    }
+
+    /**
+     * Encode every level of an RGB image in a block format
+     */
+    static PixelHandle compress(const PixelHandle& image, ourutils::BlockCompression::Format format) {
+        if ((format == ourutils::BlockCompression::NONE) || (image->getFormat() != ourutils::BlockCompression::NONE))
+            return image;
+        int width = image->getWidth();
+        int height = image->getHeight();
+        GLubyte* blocks = new GLubyte[(size_t)textureformat::pixelBytes(width, height, image->getLevels(), format)];
+        const GLubyte* level = image->data();
+        GLubyte* out = blocks;
+        for (int l = 0; l < image->getLevels(); l++) {
+            ourutils::BlockCompression::encode(format, level, width, height, out);
+            level += PixelBuffer::levelSize(width, height, ourutils::BlockCompression::NONE);
+            out += PixelBuffer::levelSize(width, height, format);
+            width = (width > 1) ? width / 2 : 1;
+            height = (height > 1) ? height / 2 : 1;
+        }
+        return PixelBuffer::adopt(blocks, image->getWidth(), image->getHeight(), image->getLevels(), format);
+    }
+
+  private:
+    /**
+     * Filter one level into the next. Large levels are split into bands of rows
+     * on the shared thread pool.
+     */
+    static void downsample(const GLubyte* source, int width, int height, GLubyte* target, int targetWidth,
+                           int targetHeight) {
+        ourutils::ThreadPool::forBands(targetHeight, targetWidth, 1 << 18, [=](size_t first, size_t last) {
+            filterRows(source, width, height, target, targetWidth, (int)first, (int)last);
+        });
+    }
+
+    /**
+     * Filter rows [first,last) of the next level. The two source rows are summed
+     * into 16-bit channels first, 16 at a time where SSE2 is available, and then
+     * neighbouring pixels are summed and rounded.
+     */
+    static void filterRows(const GLubyte* source, int width, int height, GLubyte* target, int targetWidth,
+                           int first, int last) {
+        size_t channels = 3 * (size_t)width;
+        vector<unsigned short> sums(channels);
+        for (int y = first; y < last; y++) {
+            const GLubyte* top = source + channels * min(2 * y, height - 1);
+            const GLubyte* bottom = source + channels * min(2 * y + 1, height - 1);
+            size_t i = 0;
+#ifdef __SSE2__
+            __m128i zero = _mm_setzero_si128();
+            for (; i + 16 <= channels; i += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+                __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&sums[i]), low);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&sums[i + 8]), high);
+            }
+#endif
+            for (; i < channels; i++)
+                sums[i] = (unsigned short)(top[i] + bottom[i]);
+
+            GLubyte* out = target + 3 * (size_t)targetWidth * y;
+            for (int x = 0; x < targetWidth; x++) {
+                const unsigned short* left = &sums[6 * (size_t)x];
+                const unsigned short* right = &sums[3 * (size_t)min(2 * x + 1, width - 1)];
+                out[3 * x] = (GLubyte)((left[0] + right[0] + 2) >> 2);
+                out[3 * x + 1] = (GLubyte)((left[1] + right[1] + 2) >> 2);
+                out[3 * x + 2] = (GLubyte)((left[2] + right[2] + 2) >> 2);
+            }
+        }
+    }
+};
+
+} // namespace sgraph
+
+#endif
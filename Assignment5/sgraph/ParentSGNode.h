@@ -6,12 +6,21 @@
 namespace sgraph {
     /**
      * This class represents an SGNode that can have children
-     * 
+     *
+     * It also keeps the flags that let the cached world transforms of the transform
+     * nodes below it be updated without visiting the whole tree: one for a subtree
+     * that moved as a whole, because a transform in it changed or it was given a new
+     * parent, and one for a subtree that has a moved subtree somewhere below it.
+     * A new node has moved, as it has no world transforms yet.
+     *
+     * A node added to several parents has a parent pointer only to the last of them,
+     * and keeps the world transforms of that one alone. The other parents leave it
+     * out of their updates, and it is drawn below them with the modelview stack.
      */
     class ParentSGNode: public AbstractSGNode {
         public:
-        ParentSGNode(const string& name,IScenegraph *scenegraph)
-        :AbstractSGNode(name,scenegraph) {}
+        ParentSGNode(Symbol name,IScenegraph *scenegraph)
+        :AbstractSGNode(name,scenegraph),worldMoved(true),movedBelow(false) {}
 
         ~ParentSGNode() {
             for (int i=0;i<children.size();i++) {
@@ -19,10 +28,20 @@ namespace sgraph {
             }
         }
         virtual void addChild(SGNode *child)=0;
-        vector<SGNode *> getChildren() {
+        const vector<SGNode *>& getChildren() {
             return children;
         }
 
+        /**
+         * Detach all the children of this node without deleting them
+         * \return the children that were detached
+         */
+        vector<SGNode *> releaseChildren() {
+            vector<SGNode *> released;
+            released.swap(children);
+            return released;
+        }
+
         /**
          * Searches recursively into its subtree to look for node with specified name.
          * \param name name of node to be searched
@@ -44,6 +63,82 @@ namespace sgraph {
             return answer;
         }
 
+        /**
+         * Sets the parent of this node. The world transforms below it are then relative
+         * to a different parent, so they must be updated, and a parent it already had
+         * now shares it, so that parent must be updated too
+         * \param parent the node that is to be the parent of this node
+         */
+        void setParent(SGNode *parent) {
+            ParentSGNode *before = dynamic_cast<ParentSGNode *>(this->parent);
+            AbstractSGNode::setParent(parent);
+            invalidateWorld();
+            if ((before!=NULL) && (before!=parent)) {
+                before->invalidateWorld();
+            }
+        }
+
+        /**
+         * \return true if a child of this node was added to another parent after this
+         * one, or has no parent as the root of a template does. Its cached world
+         * transforms are then relative to that parent, if any, and not to this one.
+         */
+        bool isSharedChild(SGNode *child) {
+            return child->getParent()!=this;
+        }
+
+        /**
+         * \return true if the world transforms in this subtree were brought up to date
+         * after it last moved. A subtree inside a moved one can be out of date even so.
+         */
+        bool isWorldCurrent() {
+            return !worldMoved;
+        }
+
+        /**
+         * \return true if the world bounds of this node are up to date, which also
+         * needs nothing below it to have moved since the last update
+         */
+        bool isBoundsCurrent() {
+            return !worldMoved && !movedBelow;
+        }
+
+        /**
+         * Mark this subtree as moved, and every node above it as having a moved subtree.
+         * The marks above stop at the first node that has one already, because the
+         * nodes above that one have it too.
+         */
+        void invalidateWorld() {
+            worldMoved = true;
+            for (SGNode *node=parent;node!=NULL;node=node->getParent()) {
+                ParentSGNode *above = dynamic_cast<ParentSGNode *>(node);
+                if ((above==NULL) || above->movedBelow) {
+                    break;
+                }
+                above->movedBelow = true;
+            }
+        }
+
+        /**
+         * A node without a transform passes the world transform from above down to
+         * its children. Only the children whose subtrees changed are visited, unless
+         * this subtree moved as a whole.
+         */
+        void updateWorldTransforms(const glm::mat4 &parentWorld,const glm::mat3 &parentNormal,bool parentMoved,const MeshBounds &meshBounds) {
+            bool moved = parentMoved || worldMoved;
+            if (!moved && !movedBelow) {
+                return;
+            }
+            worldMoved = movedBelow = false;
+            updateChildren(parentWorld,parentNormal,moved,meshBounds);
+        }
+
+        void addBounds(const glm::mat4 &frame,const MeshBounds &meshBounds,BoundingBox &bounds) {
+            for (int i=0;i<children.size();i++) {
+                children[i]->addBounds(frame,meshBounds,bounds);
+            }
+        }
+
         /**
              * Creates a deep copy of the subtree rooted at this node
              * \return a deep copy of the subtree rooted at this node
@@ -60,6 +155,27 @@ namespace sgraph {
             }
         protected:
         vector<SGNode *> children;
+        bool worldMoved;
+        bool movedBelow;
+
+        /**
+         * Update the children, then take the union of their bounds as this node's.
+         * A child shared with a later parent is updated by that parent only, and has
+         * the bounds of where that parent puts it, which may change without this node
+         * hearing of it. This node then covers everything, so that neither it nor a
+         * node above it is culled on a box that is not its own.
+         */
+        void updateChildren(const glm::mat4 &world,const glm::mat3 &normal,bool moved,const MeshBounds &meshBounds) {
+            worldBounds = BoundingBox();
+            for (int i=0;i<children.size();i++) {
+                if (isSharedChild(children[i])) {
+                    worldBounds.add(BoundingBox::unbounded());
+                    continue;
+                }
+                children[i]->updateWorldTransforms(world,normal,moved,meshBounds);
+                worldBounds.add(children[i]->getWorldBounds());
+            }
+        }
 
         virtual ParentSGNode *copyNode()=0;
     };
@@ -0,0 +1,113 @@
+#ifndef _PIXELBUFFER_H_
+#define _PIXELBUFFER_H_
+
+#include "../ourutils/BlockCompression.h"
+#include "../ourutils/MappedFile.h"
+
+#include <glad/glad.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+using namespace std;
+
+namespace sgraph {
+
+class PixelBuffer;
+
+/**
+ * A shared, read-only reference to the pixels of a texture. The pixels are freed
+ * with the last handle.
+ */
+typedef shared_ptr<const PixelBuffer> PixelHandle;
+
+/**
+ * The RGB pixels of one decoded texture, bottom row first, followed by any mip
+ * levels; or the same levels encoded in a BlockCompression format. A buffer
+ * never changes once made, so every scene, leaf and import that uses a texture
+ * shares one buffer by handle rather than copying it. The pixels are either an
+ * array from an image loader or part of a memory-mapped file.
+ */
+class PixelBuffer {
+  public:
+    /**
+     * Take ownership of pixels allocated with new[], as the image loaders return
+     * them
+     */
+    static PixelHandle adopt(GLubyte* pixels, int width, int height, int levels = 1,
+                             ourutils::BlockCompression::Format format = ourutils::BlockCompression::NONE) {
+        return PixelHandle(
+            new PixelBuffer(pixels, width, height, levels, format, shared_ptr<ourutils::MappedFile>()));
+    }
+
+    /**
+     * Share pixels that lie inside a mapped file, which stays mapped while the
+     * buffer lives
+     */
+    static PixelHandle mapped(const shared_ptr<ourutils::MappedFile>& file, const GLubyte* pixels, int width,
+                              int height, int levels = 1,
+                              ourutils::BlockCompression::Format format = ourutils::BlockCompression::NONE) {
+        return PixelHandle(new PixelBuffer(const_cast<GLubyte*>(pixels), width, height, levels, format, file));
+    }
+
+    ~PixelBuffer() {
+        if (!mapping)
+            delete[] pixels;
+        live()--;
+    }
+
+    const GLubyte* data() const { return pixels; }
+
+    int getWidth() const { return width; }
+
+    int getHeight() const { return height; }
+
+    int getLevels() const { return levels; }
+
+    ourutils::BlockCompression::Format getFormat() const { return format; }
+
+    /**
+     * \return the bytes in the largest level
+     */
+    size_t size() const { return levelSize(width, height, format); }
+
+    /**
+     * \return the bytes in a level of this size
+     */
+    static size_t levelSize(int width, int height, ourutils::BlockCompression::Format format) {
+        if (format == ourutils::BlockCompression::NONE)
+            return 3 * (size_t)width * height;
+        return ourutils::BlockCompression::compressedSize(format, width, height);
+    }
+
+    /**
+     * \return the number of buffers alive in this process, to check that
+     * textures are freed with the scenes that use them
+     */
+    static long liveCount() { return live(); }
+
+  private:
+    PixelBuffer(GLubyte* pixels, int width, int height, int levels, ourutils::BlockCompression::Format format,
+                const shared_ptr<ourutils::MappedFile>& mapping)
+        : pixels(pixels), width(width), height(height), levels(levels), format(format), mapping(mapping) {
+        live()++;
+    }
+
+    static atomic<long>& live() {
+        static atomic<long> count(0);
+        return count;
+    }
+
+    PixelBuffer(const PixelBuffer&);
+    PixelBuffer& operator=(const PixelBuffer&);
+
+    GLubyte* pixels;
+    int width;
+    int height;
+    int levels;
+    ourutils::BlockCompression::Format format;
+    shared_ptr<ourutils::MappedFile> mapping;
+};
+
+} // namespace sgraph
+
+#endif
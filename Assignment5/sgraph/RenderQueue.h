@@ -0,0 +1,197 @@
+#ifndef _RENDERQUEUE_H_
+#define _RENDERQUEUE_H_
+
+#include "Material.h"
+#include "ObjectInstance.h"
+#include "glm/glm.hpp"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * The material values the shader takes for a leaf
+ */
+struct MaterialValues {
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float shininess;
+    // the ambient color with its alpha, drawn when there are no lights
+    glm::vec4 color;
+
+    MaterialValues() : shininess(0) {}
+
+    explicit MaterialValues(util::Material material)
+        : ambient(material.getAmbient()), diffuse(material.getDiffuse()), specular(material.getSpecular()),
+          shininess(material.getShininess()), color(material.getAmbient()) {}
+
+    bool operator==(const MaterialValues& other) const {
+        return (ambient == other.ambient) && (diffuse == other.diffuse) && (specular == other.specular) &&
+               (shininess == other.shininess) && (color == other.color);
+    }
+
+    struct Hash {
+        size_t operator()(const MaterialValues& material) const {
+            const float* values[] = {&material.ambient.x, &material.diffuse.x, &material.specular.x, &material.color.x};
+            const int counts[] = {3, 3, 3, 4};
+            size_t hash = std::hash<float>()(material.shininess);
+            for (int v = 0; v < 4; v++) {
+                for (int i = 0; i < counts[v]; i++)
+                    hash = hash * 31 + std::hash<float>()(values[v][i]);
+            }
+            return hash;
+        }
+    };
+};
+
+/**
+ * Everything needed to draw one leaf, gathered while the scene graph is walked
+ */
+struct DrawPacket {
+    glm::mat4 modelview;
+    // the inverse transpose of the modelview, for the normals
+    glm::mat3 normalMatrix;
+    util::ObjectInstance* object;
+    // a small number for the mesh, to sort by
+    uint32_t mesh;
+    // an index into the queue's materials
+    uint32_t material;
+    // the GL texture to bind, or 0 if the leaf is not textured
+    GLuint texture;
+    // the scale in x and y, then the offset, of the texture coordinates
+    glm::vec4 textureTransform;
+    // the distance from the eye along the view direction
+    float depth;
+};
+
+/**
+ * This class collects the draws of a frame so that they can be made in an order
+ * that changes as little GL state as possible: grouped by texture, then by
+ * mesh, and front to back within a group so that the depth test rejects more
+ * fragments. The order comes from a radix sort on a 64-bit key per packet:
+ *
+ *   bits 52-63  texture
+ *   bits 40-51  mesh
+ *   bits  0-31  depth, as the bits of a non-negative float, which sort as the
+ *               floats do
+ *
+ * Texture names and mesh numbers past 4095 share the last value, which only
+ * makes their grouping less tight.
+ */
+class RenderQueue {
+  public:
+    /**
+     * Remove every packet and material
+     */
+    void clear() {
+        packets.clear();
+        materials.clear();
+        materialIndices.clear();
+        order.clear();
+    }
+
+    /**
+     * Store a material for packets to refer to. A material equal to one stored
+     * already is not stored again, so that the materials of a frame are few
+     * enough to send to the shader together.
+     * \return the index of the material
+     */
+    uint32_t addMaterial(const MaterialValues& material) {
+        // neighbouring leaves usually share a material
+        if (!materials.empty() && (materials.back() == material))
+            return (uint32_t)materials.size() - 1;
+        unordered_map<MaterialValues, uint32_t, MaterialValues::Hash>::iterator found = materialIndices.find(material);
+        if (found != materialIndices.end())
+            return found->second;
+        materials.push_back(material);
+        materialIndices[material] = (uint32_t)materials.size() - 1;
+        return (uint32_t)materials.size() - 1;
+    }
+
+    void add(const DrawPacket& packet) { packets.push_back(packet); }
+
+    size_t size() const { return packets.size(); }
+
+    const DrawPacket& getPacket(size_t index) const { return packets[index]; }
+
+    const MaterialValues& getMaterial(uint32_t index) const { return materials[index]; }
+
+    size_t getMaterialCount() const { return materials.size(); }
+
+    /**
+     * Sort the packets
+     * \return the indices of the packets in the order to draw them
+     */
+    const vector<uint32_t>& sort() {
+        keys.resize(packets.size());
+        for (size_t i = 0; i < packets.size(); i++) {
+            keys[i].key = makeKey(packets[i]);
+            keys[i].index = (uint32_t)i;
+        }
+        radixSort();
+        order.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++)
+            order[i] = keys[i].index;
+        return order;
+    }
+
+  private:
+    struct SortKey {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    static uint64_t makeKey(const DrawPacket& packet) {
+        float depth = max(packet.depth, 0.0f);
+        uint32_t depthBits;
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+        return ((uint64_t)min<GLuint>(packet.texture, 4095) << 52) | ((uint64_t)min<uint32_t>(packet.mesh, 4095) << 40) |
+               depthBits;
+    }
+
+    /**
+     * Sort the keys a byte at a time, least significant first. A byte that is the
+     * same in every key is skipped, which leaves out the unused bits and, in most
+     * scenes, most of the texture and mesh bytes.
+     */
+    void radixSort() {
+        if (keys.size() < 2)
+            return;
+        buffer.resize(keys.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {0};
+            for (size_t i = 0; i < keys.size(); i++)
+                counts[(keys[i].key >> shift) & 0xff]++;
+            if (counts[(keys[0].key >> shift) & 0xff] == keys.size())
+                continue;
+            size_t offsets[256];
+            size_t total = 0;
+            for (int b = 0; b < 256; b++) {
+                offsets[b] = total;
+                total += counts[b];
+            }
+            for (size_t i = 0; i < keys.size(); i++)
+                buffer[offsets[(keys[i].key >> shift) & 0xff]++] = keys[i];
+            keys.swap(buffer);
+        }
+    }
+
+    vector<DrawPacket> packets;
+    vector<MaterialValues> materials;
+    unordered_map<MaterialValues, uint32_t, MaterialValues::Hash> materialIndices;
+    vector<SortKey> keys;
+    vector<SortKey> buffer;
+    vector<uint32_t> order;
+};
+
+} // namespace sgraph
+
+#endif
@@ -20,12 +20,12 @@ namespace sgraph {
             }
 
         public:
-            RotateTransform(float angleInRadians,float ax,float ay,float az,const string& name,sgraph::IScenegraph *graph) 
+            RotateTransform(float angleInRadians,float ax,float ay,float az,Symbol name,sgraph::IScenegraph *graph) 
                 :TransformNode(name,graph) {
                     this->angleInRadians = angleInRadians;
                     this->axis = glm::vec3(ax,ay,az);
                     glm::mat4 transform = glm::rotate(glm::mat4(1.0),this->angleInRadians,this->axis);
-                    setTransform(transform);
+                    setTransform(transform,true);
             }
 
 
@@ -45,6 +45,15 @@ namespace sgraph {
                 return angleInRadians;
             }
 
+            /**
+             * Change the rotation, which moves this subtree
+             */
+            void setRotation(float angleInRadians,float ax,float ay,float az) {
+                this->angleInRadians = angleInRadians;
+                this->axis = glm::vec3(ax,ay,az);
+                setTransform(glm::rotate(glm::mat4(1.0),this->angleInRadians,this->axis),true);
+            }
+
     };
 }
 
@@ -5,6 +5,8 @@
 #include <vector>
 #include <stack>
 #include <string>
+#include "BoundingBox.h"
+#include "Symbol.h"
 using namespace std;
 
 namespace sgraph {
@@ -43,6 +45,12 @@ namespace sgraph {
      */
     virtual void setParent(SGNode *parent)=0;
 
+    /**
+     * Get the parent of this node
+     * \return the parent of this node, or null if it has not been added to a parent
+     */
+    virtual SGNode *getParent()=0;
+
     /**
      * Traverse the scene graph rooted at this node, and store references to the scenegraph object
      * \param graph a reference to the scenegraph object of which this tree is a part
@@ -61,7 +69,13 @@ namespace sgraph {
      * Get the name of this node
      * \return the name of this node
      */
-    virtual string getName()=0;
+    virtual const string& getName()=0;
+
+    /**
+     * Get the name of this node as a symbol, for lookups that should not compare text
+     * \return the name of this node
+     */
+    virtual Symbol getNameSymbol()=0;
 
     /**
      * Accept a visitor to visit this node
@@ -69,6 +83,31 @@ namespace sgraph {
      */
     
     virtual void accept(SGNodeVisitor *visitor)=0;
+
+    /**
+     * Bring the cached world transforms, normal matrices and world bounds in the subtree rooted at this
+     * node up to date, visiting only the parts of it that changed since the last update
+     * \param parentWorld the world transform of the transform node nearest above this one
+     * \param parentNormal the matrix that transforms normals as parentWorld transforms points
+     * \param parentMoved true if parentWorld changed since the last update
+     * \param meshBounds the box around each mesh the leaves may refer to
+     */
+    virtual void updateWorldTransforms(const glm::mat4 &parentWorld,const glm::mat3 &parentNormal,bool parentMoved,const MeshBounds &meshBounds)=0;
+
+    /**
+     * Get the box around the subtree rooted at this node, in world coordinates, as of
+     * the last update
+     */
+    virtual const BoundingBox& getWorldBounds()=0;
+
+    /**
+     * Grow a box to cover the subtree rooted at this node, without using or changing
+     * anything cached
+     * \param frame the transform from the coordinates of this node to those of the box
+     * \param meshBounds the box around each mesh the leaves may refer to
+     * \param bounds the box to grow
+     */
+    virtual void addBounds(const glm::mat4 &frame,const MeshBounds &meshBounds,BoundingBox &bounds)=0;
 };
 }
 
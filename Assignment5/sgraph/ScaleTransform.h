@@ -5,6 +5,7 @@
 #include "TransformNode.h"
 #include "IScenegraph.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
 
 namespace sgraph {
     /**
@@ -20,13 +21,13 @@ namespace sgraph {
         }    
 
     public:
-        ScaleTransform(float sx,float sy,float sz,const string& name,sgraph::IScenegraph *graph) 
+        ScaleTransform(float sx,float sy,float sz,Symbol name,sgraph::IScenegraph *graph) 
             :TransformNode(name,graph) {
                 this->sx = sx;
                 this->sy = sy;
                 this->sz = sz;
                 glm::mat4 transform = glm::scale(glm::mat4(1.0),glm::vec3(sx,sy,sz));
-                setTransform(transform);
+                setTransform(transform,isUniform());
         }
 
         
@@ -39,10 +40,28 @@ namespace sgraph {
         return visitor->visitScaleTransform(this);
         }
 
+        /**
+         * \return true if the scale is the same along every axis, up to sign, which
+         * keeps angles, so that normals need no inverse
+         */
+        bool isUniform() {
+            return (fabs(sx)==fabs(sy)) && (fabs(sy)==fabs(sz));
+        }
+
         glm::vec3 getScale() {
             return glm::vec3(sx,sy,sz);
         }
 
+        /**
+         * Change the scale, which moves this subtree
+         */
+        void setScale(float sx,float sy,float sz) {
+            this->sx = sx;
+            this->sy = sy;
+            this->sz = sz;
+            setTransform(glm::scale(glm::mat4(1.0),glm::vec3(sx,sy,sz)),isUniform());
+        }
+
     };
 }
 
@@ -0,0 +1,253 @@
+#ifndef _SCENEASSETLOADER_H_
+#define _SCENEASSETLOADER_H_
+
+#include "AssetCache.h"
+#include "PixelBuffer.h"
+#include "PolygonMesh.h"
+#include "VertexAttrib.h"
+#include "../../include/TextureImage.h"
+#include "../ourutils/ThreadPool.h"
+
+#include <exception>
+#include <future>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class loads the meshes and images that a scene uses. Declaring an asset
+ * only records its path; it is decoded once something asks for it, on a pool of
+ * worker threads, so that an asset no leaf refers to costs nothing. The results
+ * are collected later, in the order they were asked for, so that they do not
+ * depend on which worker finished first. Files are decoded through the
+ * process-wide AssetCache, so a file used by several scenes or imports is only
+ * decoded once. The pixels of an image are shared by handle; the TextureImage
+ * for it only refers to them.
+ */
+class SceneAssetLoader {
+  public:
+    SceneAssetLoader() {}
+
+    /**
+     * Record the OBJ file for a mesh. If the mesh was already asked for, the new
+     * file is loaded in its place.
+     */
+    void declareMesh(const string& name, const string& path) {
+        meshPaths[name] = path;
+        if (requestedMeshes.erase(name) > 0)
+            requestMesh(name);
+    }
+
+    /**
+     * Record the image file for a texture. If the image was already asked for,
+     * the new file is loaded in its place.
+     */
+    void declareImage(const string& name, const string& path) {
+        imagePaths[name] = path;
+        if (requestedImages.erase(name) > 0)
+            requestImage(name);
+    }
+
+    /**
+     * Start decoding a declared mesh, unless that was done already. A missing
+     * file is skipped.
+     * \return true if a mesh with this name was declared
+     */
+    bool requestMesh(const string& name) {
+        map<string, string>::iterator declared = meshPaths.find(name);
+        if (declared == meshPaths.end())
+            return false;
+        if (!requestedMeshes.insert(name).second)
+            return true;
+        string path = declared->second;
+        PendingMesh pending;
+        pending.name = name;
+        pending.result = workers.submit([path]() {
+            return AssetCache::shared().loadMesh(path);
+        });
+        pendingMeshes.push_back(std::move(pending));
+        return true;
+    }
+
+    /**
+     * Start decoding a declared image, unless that was done already. A missing
+     * or malformed file is reported when the image is resolved.
+     * \return true if an image with this name was declared
+     */
+    bool requestImage(const string& name) {
+        map<string, string>::iterator declared = imagePaths.find(name);
+        if (declared == imagePaths.end())
+            return false;
+        if (!requestedImages.insert(name).second)
+            return true;
+        string path = declared->second;
+        PendingImage pending;
+        pending.name = name;
+        pending.path = path;
+        pending.result = workers.submit([path]() {
+            return AssetCache::shared().loadImage(path);
+        });
+        pendingImages.push_back(std::move(pending));
+        return true;
+    }
+
+    /**
+     * Wait for the latest request of the named image, if it is still pending.
+     * \return true if an image with this name is available
+     */
+    bool hasImage(const string& name) {
+        for (int i = (int)pendingImages.size() - 1; i >= 0; i--) {
+            if (pendingImages[i].name == name) {
+                storeImage(pendingImages[i]);
+                break;
+            }
+        }
+        return imagePixels.find(name) != imagePixels.end();
+    }
+
+    /**
+     * Get the shared pixels of a loaded image, or nothing if it is not loaded
+     */
+    PixelHandle getImagePixels(const string& name) {
+        map<string, PixelHandle>::iterator it = imagePixels.find(name);
+        return (it != imagePixels.end()) ? it->second : PixelHandle();
+    }
+
+    /**
+     * Wait for every pending request and store the results in request order
+     */
+    void resolve() {
+        for (size_t i = 0; i < pendingMeshes.size(); i++) {
+            LoadedMesh loaded = pendingMeshes[i].result.get();
+            if (loaded.found)
+                meshes[pendingMeshes[i].name] = loaded.mesh;
+        }
+        pendingMeshes.clear();
+        for (size_t i = 0; i < pendingImages.size(); i++) {
+            storeImage(pendingImages[i]);
+        }
+        pendingImages.clear();
+    }
+
+    /**
+     * Declare a mesh used by an imported scene, unless a mesh with the same name
+     * was already declared, and ask for it. A later declaration by this scene
+     * still replaces it.
+     * \return true if the mesh was declared
+     */
+    bool declareImportedMesh(const string& name, const string& path) {
+        bool declared = meshPaths.find(name) == meshPaths.end();
+        if (declared)
+            declareMesh(name, path);
+        // the imported leaves use the name, whichever declaration it has
+        requestMesh(name);
+        return declared;
+    }
+
+    /**
+     * Declare an image used by an imported scene, unless an image with the same
+     * name was already declared, and ask for it. A later declaration by this scene
+     * still replaces it.
+     * \return true if the image was declared
+     */
+    bool declareImportedImage(const string& name, const string& path) {
+        bool declared = imagePaths.find(name) == imagePaths.end();
+        if (declared)
+            declareImage(name, path);
+        // the imported leaves use the name, whichever declaration it has
+        requestImage(name);
+        return declared;
+    }
+
+    map<string, util::PolygonMesh<VertexAttrib>>& getMeshes() { return meshes; }
+
+    map<string, util::TextureImage>& getImages() { return images; }
+
+    /**
+     * Get the pixels of every loaded image, which the TextureImages from
+     * getImages() point into. A block compressed image has no TextureImage.
+     */
+    map<string, PixelHandle>& getImagePixels() { return imagePixels; }
+
+    /**
+     * Forget a loaded image
+     */
+    void dropImage(const string& name) {
+        images.erase(name);
+        imagePixels.erase(name);
+    }
+
+    /**
+     * Get the path each mesh was declared with, whether or not it was loaded
+     */
+    map<string, string>& getMeshPaths() { return meshPaths; }
+
+    /**
+     * Get the path each image was declared with, whether or not it was loaded
+     */
+    map<string, string>& getImagePaths() { return imagePaths; }
+
+    /**
+     * \return true if the named mesh was asked for
+     */
+    bool isMeshRequested(const string& name) { return requestedMeshes.find(name) != requestedMeshes.end(); }
+
+    /**
+     * \return true if the named image was asked for
+     */
+    bool isImageRequested(const string& name) { return requestedImages.find(name) != requestedImages.end(); }
+
+  private:
+    struct PendingMesh {
+        string name;
+        future<LoadedMesh> result;
+    };
+
+    struct PendingImage {
+        string name;
+        string path;
+        future<LoadedImage> result;
+        bool stored = false;
+    };
+
+    /**
+     * An image that cannot be loaded leaves its texture unset, like a missing mesh
+     */
+    void storeImage(PendingImage& pending) {
+        if (pending.stored)
+            return;
+        pending.stored = true;
+        try {
+            LoadedImage loaded = pending.result.get();
+            imagePixels[pending.name] = loaded.pixels;
+            if (loaded.pixels->getFormat() == ourutils::BlockCompression::NONE)
+                images[pending.name] = util::TextureImage(const_cast<GLubyte*>(loaded.pixels->data()),
+                                                          loaded.pixels->getWidth(), loaded.pixels->getHeight(),
+                                                          pending.name);
+        } catch (exception& e) {
+            dropImage(pending.name);
+            cerr << "Warning: image " << pending.name << " could not be loaded from " << pending.path << ": "
+                 << e.what() << endl;
+        }
+    }
+
+    map<string, util::PolygonMesh<VertexAttrib>> meshes;
+    map<string, util::TextureImage> images;
+    map<string, PixelHandle> imagePixels;
+    map<string, string> meshPaths;
+    map<string, string> imagePaths;
+    set<string> requestedMeshes;
+    set<string> requestedImages;
+    vector<PendingMesh> pendingMeshes;
+    vector<PendingImage> pendingImages;
+    ourutils::ThreadPool workers;
+};
+
+} // namespace sgraph
+
+#endif
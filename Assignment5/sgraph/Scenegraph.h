@@ -6,12 +6,14 @@
 #include "LeafNode.h"
 #include "GroupNode.h"
 #include "TransformNode.h"
+#include "InstanceNode.h"
 #include "glm/glm.hpp"
 #include "IVertexData.h"
 #include "../../include/TextureImage.h"
 #include "PolygonMesh.h"
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -33,18 +35,32 @@ namespace sgraph
     SGNode *root;
     map<string, util::PolygonMesh<VertexAttrib>> meshes;
     map<string, util::TextureImage> images;
+    map<string, PixelHandle> imagePixels;
     map<string, string> meshPaths;
     map<string, string> imagePaths;
 
     /**
-     * A map to store the (name,node) pairs. A map is chosen for efficient search
+     * A map to store the (name,node) pairs. A map is chosen for efficient search,
+     * and keyed by symbol so that a lookup neither allocates nor compares text
      */
-    map<string, SGNode *> nodes;
+    unordered_map<Symbol, SGNode *> nodes;
+
+    /**
+     * The box around each mesh, for the bounds of the leaves
+     */
+    MeshBounds meshBounds;
+
+    /**
+     * True if the whole tree must have its world transforms and bounds worked out
+     * again at the next update, because the root or the meshes changed
+     */
+    bool rootMoved;
 
   public:
     Scenegraph()
     {
       root = NULL;
+      rootMoved = true;
     }
 
     ~Scenegraph()
@@ -68,14 +84,16 @@ namespace sgraph
      */
     void makeScenegraph(SGNode *root)
     {
+      nodes.clear();
       this->root = root;
+      rootMoved = true;
       if (root != NULL)
       {
         this->root->setScenegraph(this);
       }
     }
 
-    void addNode(const string &name, SGNode *node)
+    void addNode(Symbol name, SGNode *node)
     {
       nodes[name] = node;
     }
@@ -87,12 +105,42 @@ namespace sgraph
 
     map<string, SGNode *> getNodes()
     {
-      return nodes;
+      map<string, SGNode *> named;
+      for (unordered_map<Symbol, SGNode *>::iterator it = nodes.begin(); it != nodes.end(); it++)
+      {
+        named[it->first.str()] = it->second;
+      }
+      return named;
     }
 
     void setMeshes(map<string, util::PolygonMesh<VertexAttrib>> &meshes)
     {
       this->meshes = meshes;
+
+      // the bounds of everything that uses a mesh may change with it
+      meshBounds.clear();
+      for (map<string, util::PolygonMesh<VertexAttrib>>::iterator it = this->meshes.begin(); it != this->meshes.end(); it++)
+      {
+        BoundingBox &bounds = meshBounds[Symbol(it->first)];
+        vector<VertexAttrib> vertices = it->second.getVertexAttributes();
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+          vector<float> position = vertices[i].getData("position");
+          if (position.size() >= 3)
+          {
+            bounds.add(glm::vec3(position[0], position[1], position[2]));
+          }
+        }
+      }
+      for (unordered_map<Symbol, SGNode *>::iterator it = nodes.begin(); it != nodes.end(); it++)
+      {
+        InstanceNode *instance = dynamic_cast<InstanceNode *>(it->second);
+        if (instance != NULL)
+        {
+          instance->getTemplate()->resetBounds();
+        }
+      }
+      rootMoved = true;
     }
 
     void setImages(map<string, util::TextureImage> &images)
@@ -100,6 +148,11 @@ namespace sgraph
       this->images = images;
     }
 
+    void setImagePixels(map<string, PixelHandle> &imagePixels)
+    {
+      this->imagePixels = imagePixels;
+    }
+
     map<string, util::PolygonMesh<VertexAttrib>> getMeshes()
     {
       return this->meshes;
@@ -110,6 +163,11 @@ namespace sgraph
       return this->images;
     }
 
+    map<string, PixelHandle> getImagePixels()
+    {
+      return this->imagePixels;
+    }
+
     void setMeshPaths(map<string, string> &meshPaths)
     {
       this->meshPaths = meshPaths;
@@ -140,11 +198,20 @@ namespace sgraph
       vector<util::Light> lightsInViewSpace;
 
       // Collect lights from all nodes
-      collectLightsFromNode(root, glm::mat4(1.0f), viewMatrix, lightsInViewSpace);
+      collectLightsFromNode(root, glm::mat4(1.0f), true, viewMatrix, lightsInViewSpace);
 
       return lightsInViewSpace;
     }
 
+    void updateWorldTransforms()
+    {
+      if (root != NULL)
+      {
+        root->updateWorldTransforms(glm::mat4(1.0f), glm::mat3(1.0f), rootMoved, meshBounds);
+      }
+      rootMoved = false;
+    }
+
   private:
     /**
      * Helper method to transform a light to a new coordinate system
@@ -186,9 +253,13 @@ namespace sgraph
     }
 
     /**
-     * Helper method to collect lights recursively from the scene graph
+     * Helper method to collect lights recursively from the scene graph. While cached
+     * is true, the world transforms cached at the transform nodes are up to date and
+     * are used as they are; below an instance node, a child shared with a later
+     * parent or a subtree that moved since the last update, the transforms are
+     * multiplied as the tree is walked.
      */
-    void collectLightsFromNode(SGNode *node, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, vector<util::Light> &lights)
+    void collectLightsFromNode(SGNode *node, const glm::mat4 &modelMatrix, bool cached, const glm::mat4 &viewMatrix, vector<util::Light> &lights)
     {
       if (!node)
         return;
@@ -215,9 +286,10 @@ namespace sgraph
       GroupNode *groupNode = dynamic_cast<GroupNode *>(node);
       if (groupNode)
       {
+        bool current = cached && groupNode->isWorldCurrent();
         for (SGNode *child : groupNode->getChildren())
         {
-          collectLightsFromNode(child, modelMatrix, viewMatrix, lights);
+          collectLightsFromNode(child, modelMatrix, current && !groupNode->isSharedChild(child), viewMatrix, lights);
         }
       }
 
@@ -225,10 +297,13 @@ namespace sgraph
       TransformNode *transformNode = dynamic_cast<TransformNode *>(node);
       if (transformNode)
       {
-        glm::mat4 newModelMatrix = modelMatrix * transformNode->getTransform();
+        // the nodes below an instance are shared, and have no world transform of their own
+        bool current = cached && transformNode->isWorldCurrent() && (dynamic_cast<InstanceNode *>(node) == NULL);
+        glm::mat4 newModelMatrix = current ? transformNode->getWorldTransform() : modelMatrix * transformNode->getTransform();
         if (!transformNode->getChildren().empty())
         {
-          collectLightsFromNode(transformNode->getChildren()[0], newModelMatrix, viewMatrix, lights);
+          SGNode *child = transformNode->getChildren()[0];
+          collectLightsFromNode(child, newModelMatrix, current && !transformNode->isSharedChild(child), viewMatrix, lights);
         }
       }
     }
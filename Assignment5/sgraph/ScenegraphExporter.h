@@ -8,6 +8,7 @@
 #include "RotateTransform.h"
 #include "ScaleTransform.h"
 #include "TranslateTransform.h"
+#include "InstanceNode.h"
 #include <sstream>
 using namespace std;
 
@@ -178,6 +179,16 @@ namespace sgraph {
                 }
             }
 
+            /**
+             * @brief An imported node is written out as a copy of the subtree it
+             * shares, under the name the instance would have had
+             * 
+             * @param instanceNode 
+             */
+            void visitInstanceNode(InstanceNode *instanceNode) {
+                instanceNode->getChildren()[0]->accept(this);
+            }
+
         private:
             void append(const string& str) {                
                 output << str << endl;
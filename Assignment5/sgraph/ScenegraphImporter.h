@@ -3,97 +3,215 @@
 
 #include "GroupNode.h"
 #include "IScenegraph.h"
+#include "InstanceNode.h"
 #include "LeafNode.h"
 #include "Light.h"
 #include "Material.h"
-#include "ObjImporter.h"
 #include "PolygonMesh.h"
 #include "RotateTransform.h"
-#include "../PPMImageLoader.h"
 #include "../../include/TextureImage.h"
 #include "ScaleTransform.h"
+#include "SceneAssetLoader.h"
 #include "Scenegraph.h"
+#include "TemplateCache.h"
 #include "TransformNode.h"
 #include "TranslateTransform.h"
 #include "VertexAttrib.h"
+#include "CommandTokenizer.h"
+#include "../ourutils/MappedFile.h"
 
+#include <cctype>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <istream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 using namespace std;
 
 namespace sgraph {
 
 class ScenegraphImporter {
   public:
-    ScenegraphImporter() {}
+    ScenegraphImporter() : root(NULL), verbose(true), lastUses(NULL) {}
 
+    /**
+     * Echo every command as it is read. This is on by default; turn it off when
+     * parsing large generated files
+     */
+    void setVerbose(bool verbose) { this->verbose = verbose; }
+
+    /**
+     * Parse commands from a stream, reading it one chunk at a time
+     */
     IScenegraph* parse(istream& input) {
-        string command;
-        string inputWithOutCommentsString = stripComments(input);
-        istringstream inputWithOutComments(inputWithOutCommentsString);
-        while (inputWithOutComments >> command) {
-            cout << "Read " << command << endl;
-            if (command == "instance") {
+        CommandTokenizer tokens(input);
+        return parse(tokens);
+    }
+
+    /**
+     * Parse a command file by memory-mapping it and tokenizing it in place
+     * \param filepath the path to the command file
+     */
+    IScenegraph* parseFile(const string& filepath) {
+        ourutils::MappedFile file;
+        if (!file.open(filepath))
+            throw runtime_error("Could not open command file: " + filepath);
+        sourceFiles.push_back(filepath);
+        return parse(file.data(), file.end());
+    }
+
+    /**
+     * Parse a command file that may be too large to hold in memory. The file is
+     * read twice, a chunk at a time. The first pass finds where each name is used
+     * for the last time; the second builds the scene graph and forgets each node,
+     * material and light binding after its last use. A node that was never added
+     * to a parent (such as a subtree that was only copied) is deleted when its
+     * binding is forgotten.
+     *
+     * Memory is then bounded by the scene graph being built, the bindings still in
+     * use, and a 64-bit hash per distinct name, instead of the size of the file.
+     * \param filepath the path to the command file
+     * \param chunkSize the number of bytes read at a time
+     */
+    IScenegraph* parseFileStreaming(const string& filepath, size_t chunkSize = 1 << 16) {
+        unordered_map<uint64_t, size_t> uses;
+        {
+            ifstream first(filepath.c_str(), ios::binary);
+            if (!first.is_open())
+                throw runtime_error("Could not open command file: " + filepath);
+            CommandTokenizer tokens(first, chunkSize);
+            const char* token;
+            size_t length;
+            while (tokens.next(token, length)) {
+                if (isName(token, length))
+                    uses[hashName(token, length)] = tokens.getTokenCount() - 1;
+            }
+        }
+
+        ifstream second(filepath.c_str(), ios::binary);
+        if (!second.is_open())
+            throw runtime_error("Could not open command file: " + filepath);
+        sourceFiles.push_back(filepath);
+        CommandTokenizer tokens(second, chunkSize);
+        tokens.recordTokens(&commandTokens);
+        lastUses = &uses;
+        try {
+            IScenegraph* scenegraph = parse(tokens);
+            lastUses = NULL;
+            return scenegraph;
+        } catch (...) {
+            lastUses = NULL;
+            throw;
+        }
+    }
+
+    /**
+     * Get the assets that were declared but left out of the last scene parsed,
+     * because no leaf reachable from its root uses them. Each is described as
+     * its kind, name and path.
+     */
+    vector<string> getSkippedAssets() { return skippedAssets; }
+
+    /**
+     * Get every file read by parseFile so far: the command file and the files it
+     * imports, directly or through other imports
+     */
+    vector<string> getSourceFiles() { return sourceFiles; }
+
+    IScenegraph* parse(const char* begin, const char* end) {
+        CommandTokenizer tokens(begin, end);
+        return parse(tokens);
+    }
+
+    IScenegraph* parse(CommandTokenizer& input) {
+        const char* command;
+        size_t length;
+        while (input.next(command, length)) {
+            if (verbose)
+                cout << "Read " << string(command, length) << endl;
+            switch (lookupCommand(command, length)) {
+            case INSTANCE: {
                 string name, path;
-                inputWithOutComments >> name >> path;
-                cout << "Read " << name << " " << path << endl;
-                meshPaths[name] = path;
-                ifstream in(path);
-                if (in.is_open()) {
-                    util::PolygonMesh<VertexAttrib> mesh =
-                        util::ObjImporter<VertexAttrib>::importFile(in, false);
-                    meshes[name] = mesh;
-                }
-            } else if (command == "image") {
+                input >> name >> path;
+                if (verbose)
+                    cout << "Read " << name << " " << path << endl;
+                assets.declareMesh(name, path);
+                break;
+            }
+            case IMAGE: {
                 string name, path;
-                inputWithOutComments >> name >> path;
-                cout << "Read " << name << " " << path << endl;
-                imagePaths[name] = path;
-                ImageLoader *loader = new PPMImageLoader();
-                loader->load(path);
-                util::TextureImage img =
-                    *(new util::TextureImage(loader->getPixels(), loader->getWidth(), loader->getHeight(), name));
-                images[name] = img;
-            } else if (command == "group") {
-                parseGroup(inputWithOutComments);
-            } else if (command == "leaf") {
-                parseLeaf(inputWithOutComments);
-            } else if (command == "material") {
-                parseMaterial(inputWithOutComments);
-            } else if (command == "light") {
-                parseLight(inputWithOutComments);
-            } else if (command == "scale") {
-                parseScale(inputWithOutComments);
-            } else if (command == "rotate") {
-                parseRotate(inputWithOutComments);
-            } else if (command == "translate") {
-                parseTranslate(inputWithOutComments);
-            } else if (command == "copy") {
-                parseCopy(inputWithOutComments);
-            } else if (command == "import") {
-                parseImport(inputWithOutComments);
-            } else if (command == "assign-material") {
-                parseAssignMaterial(inputWithOutComments);
-            } else if (command == "assign-light") {
-                parseAssignLight(inputWithOutComments);
-            } else if (command == "assign-texture") {
-                parseAssignTexture(inputWithOutComments);
-            } else if (command == "add-child") {
-                parseAddChild(inputWithOutComments);
-            } else if (command == "assign-root") {
-                parseSetRoot(inputWithOutComments);
-            } else {
-                throw runtime_error("Unrecognized or out-of-place command: " + command);
+                input >> name >> path;
+                if (verbose)
+                    cout << "Read " << name << " " << path << endl;
+                assets.declareImage(name, path);
+                break;
             }
+            case GROUP:
+                parseGroup(input);
+                break;
+            case LEAF:
+                parseLeaf(input);
+                break;
+            case MATERIAL:
+                parseMaterial(input);
+                break;
+            case LIGHT:
+                parseLight(input);
+                break;
+            case SCALE:
+                parseScale(input);
+                break;
+            case ROTATE:
+                parseRotate(input);
+                break;
+            case TRANSLATE:
+                parseTranslate(input);
+                break;
+            case COPY:
+                parseCopy(input);
+                break;
+            case IMPORT:
+                parseImport(input);
+                break;
+            case ASSIGN_MATERIAL:
+                parseAssignMaterial(input);
+                break;
+            case ASSIGN_LIGHT:
+                parseAssignLight(input);
+                break;
+            case ASSIGN_TEXTURE:
+                parseAssignTexture(input);
+                break;
+            case ADD_CHILD:
+                parseAddChild(input);
+                break;
+            case ASSIGN_ROOT:
+                parseSetRoot(input);
+                break;
+            default:
+                throw runtime_error("Unrecognized or out-of-place command: " + string(command, length));
+            }
+            if (lastUses != NULL)
+                releaseUnusedBindings();
         }
+        assets.resolve();
+        applyTextures(NULL);
         if (root != NULL) {
+            map<string, string> meshPaths;
+            map<string, string> imagePaths;
+            keepUsedAssets(meshPaths, imagePaths);
             IScenegraph* scenegraph = new Scenegraph();
             scenegraph->makeScenegraph(root);
-            scenegraph->setMeshes(meshes);
+            scenegraph->setMeshes(assets.getMeshes());
             scenegraph->setMeshPaths(meshPaths);
-            scenegraph->setImages(images);
+            scenegraph->setImages(assets.getImages());
+            scenegraph->setImagePixels(assets.getImagePixels());
             scenegraph->setImagePaths(imagePaths);
             return scenegraph;
         } else {
@@ -102,28 +220,32 @@ class ScenegraphImporter {
     }
 
   protected:
-    virtual void parseGroup(istream& input) {
+    virtual void parseGroup(CommandTokenizer& input) {
         string varname, name;
         input >> varname >> name;
 
-        cout << "Read " << varname << " " << name << endl;
+        if (verbose)
+            cout << "Read " << varname << " " << name << endl;
         SGNode* group = new GroupNode(name, NULL);
         nodes[varname] = group;
     }
 
-    virtual void parseLeaf(istream& input) {
+    virtual void parseLeaf(CommandTokenizer& input) {
         string varname, name, command, instanceof;
         input >> varname >> name;
-        cout << "Read " << varname << " " << name << endl;
+        if (verbose)
+            cout << "Read " << varname << " " << name << endl;
         input >> command;
         if (command == "instanceof") {
             input >> instanceof;
         }
         SGNode* leaf = new LeafNode(instanceof, name, NULL);
         nodes[varname] = leaf;
+        // start decoding now, so that it overlaps with the rest of the parse
+        assets.requestMesh(instanceof);
     }
 
-    virtual void parseScale(istream& input) {
+    virtual void parseScale(CommandTokenizer& input) {
         string varname, name;
         input >> varname >> name;
         float sx, sy, sz;
@@ -132,7 +254,7 @@ class ScenegraphImporter {
         nodes[varname] = scaleNode;
     }
 
-    virtual void parseTranslate(istream& input) {
+    virtual void parseTranslate(CommandTokenizer& input) {
         string varname, name;
         input >> varname >> name;
         float tx, ty, tz;
@@ -141,7 +263,7 @@ class ScenegraphImporter {
         nodes[varname] = translateNode;
     }
 
-    virtual void parseRotate(istream& input) {
+    virtual void parseRotate(CommandTokenizer& input) {
         string varname, name;
         input >> varname >> name;
         float angleInDegrees, ax, ay, az;
@@ -150,7 +272,7 @@ class ScenegraphImporter {
         nodes[varname] = rotateNode;
     }
 
-    virtual void parseMaterial(istream& input) {
+    virtual void parseMaterial(CommandTokenizer& input) {
         util::Material mat;
         float r, g, b;
         string name;
@@ -179,7 +301,7 @@ class ScenegraphImporter {
         materials[name] = mat;
     }
 
-    virtual void parseLight(istream& input) {
+    virtual void parseLight(CommandTokenizer& input) {
         util::Light light;
         std::string name;
         std::string command;
@@ -211,41 +333,53 @@ class ScenegraphImporter {
         lights[name] = light;
     }
 
-    virtual void parseCopy(istream& input) {
+    virtual void parseCopy(CommandTokenizer& input) {
         string nodename, copyof;
 
         input >> nodename >> copyof;
         if (nodes.find(copyof) != nodes.end()) {
+            // the copy must carry the textures assigned so far
+            applyTextures(nodes[copyof]);
             SGNode* copy = nodes[copyof]->clone();
             nodes[nodename] = copy;
         }
     }
 
-    virtual void parseImport(istream& input) {
+    /**
+     * Every import of a file shares one template of its nodes, so importing the
+     * same file many times costs one node per import
+     */
+    virtual void parseImport(CommandTokenizer& input) {
         string nodename, filepath;
 
         input >> nodename >> filepath;
-        ifstream external_scenegraph_file(filepath);
-        if (external_scenegraph_file.is_open()) {
-
-            IScenegraph* importedSG = parse(external_scenegraph_file);
-            nodes[nodename] = importedSG->getRoot();
-            /* for (map<string,util::PolygonMesh<VertexAttrib> >::iterator
-            it=importedSG->getMeshes().begin();it!=importedSG->getMeshes().end();it++) {
-                this->meshes[it->first] = it->second;
+        shared_ptr<SubtreeTemplate> subtree = importTemplate(filepath);
+        if (subtree) {
+            nodes[nodename] = new InstanceNode(subtree, subtree->getRoot()->getName(), NULL);
+            sourceFiles.push_back(filepath);
+            vector<string> templateFiles = subtree->getSourceFiles();
+            sourceFiles.insert(sourceFiles.end(), templateFiles.begin() + 1, templateFiles.end());
+
+            map<string, string>& importedMeshPaths = subtree->getMeshPaths();
+            for (map<string, string>::iterator it = importedMeshPaths.begin(); it != importedMeshPaths.end(); it++) {
+                if (!assets.declareImportedMesh(it->first, it->second) &&
+                    (assets.getMeshPaths()[it->first] != it->second)) {
+                    cerr << "Warning: " << filepath << " uses mesh " << it->first << " from " << it->second
+                         << " but it is already " << assets.getMeshPaths()[it->first] << endl;
+                }
             }
-            for (map<string,string>::iterator
-            it=importedSG->getMeshPaths().begin();it!=importedSG->getMeshPaths().end();it++) {
-                this->meshPaths[it->first] = it->second;
+            map<string, string>& importedImagePaths = subtree->getImagePaths();
+            for (map<string, string>::iterator it = importedImagePaths.begin(); it != importedImagePaths.end(); it++) {
+                if (!assets.declareImportedImage(it->first, it->second) &&
+                    (assets.getImagePaths()[it->first] != it->second)) {
+                    cerr << "Warning: " << filepath << " uses image " << it->first << " from " << it->second
+                         << " but it is already " << assets.getImagePaths()[it->first] << endl;
+                }
             }
-            */
-            // delete the imported scene graph but not its nodes!
-            importedSG->makeScenegraph(NULL);
-            delete importedSG;
         }
     }
 
-    virtual void parseAssignMaterial(istream& input) {
+    virtual void parseAssignMaterial(CommandTokenizer& input) {
         string nodename, matname;
         input >> nodename >> matname;
 
@@ -255,7 +389,7 @@ class ScenegraphImporter {
         }
     }
 
-    virtual void parseAssignLight(istream& input) {
+    virtual void parseAssignLight(CommandTokenizer& input) {
         string nodename, lightname;
         input >> nodename >> lightname;
         LeafNode* leafNode = dynamic_cast<LeafNode*>(nodes[nodename]);
@@ -264,16 +398,17 @@ class ScenegraphImporter {
         }
     }
 
-    virtual void parseAssignTexture(istream& input) {
+    virtual void parseAssignTexture(CommandTokenizer& input) {
         string nodename, texturename;
         input >> nodename >> texturename;
         LeafNode* leafNode = dynamic_cast<LeafNode*>(nodes[nodename]);
-        if ((leafNode != NULL) && (images.find(texturename) != images.end())) {
-            leafNode->setTexture(images[texturename]);
+        // the image is decoded in the background and set on the leaf once it is needed
+        if ((leafNode != NULL) && assets.requestImage(texturename)) {
+            pendingTextures[leafNode] = texturename;
         }
     }
 
-    virtual void parseAddChild(istream& input) {
+    virtual void parseAddChild(CommandTokenizer& input) {
         string childname, parentname;
 
         input >> childname >> parentname;
@@ -284,42 +419,272 @@ class ScenegraphImporter {
         }
 
         if ((parentNode != NULL) && (childNode != NULL)) {
+            if (childNode->getParent() != NULL)
+                sharedNodes.insert(childNode);
             parentNode->addChild(childNode);
         }
     }
 
-    virtual void parseSetRoot(istream& input) {
+    virtual void parseSetRoot(CommandTokenizer& input) {
         string rootname;
         input >> rootname;
 
         root = nodes[rootname];
 
-        cout << "Root's name is " << root->getName() << endl;
+        if (verbose)
+            cout << "Root's name is " << root->getName() << endl;
     }
 
-    string stripComments(istream& input) {
-        string line;
-        stringstream clean;
-        while (getline(input, line)) {
-            int i = 0;
-            while ((i < line.length()) && (line[i] != '#')) {
-                clean << line[i];
-                i++;
+  private:
+    /**
+     * Set the textures assigned so far on their leaves, waiting for their images
+     * if needed. Only the leaves below the given node are done, or all of them if
+     * it is null.
+     */
+    void applyTextures(SGNode* below) {
+        if (pendingTextures.empty())
+            return;
+        vector<SGNode*> pending(1, below);
+        if (below == NULL) {
+            pending.clear();
+            for (map<SGNode*, string>::iterator it = pendingTextures.begin(); it != pendingTextures.end(); it++)
+                pending.push_back(it->first);
+        }
+        set<SGNode*> seen;
+        while (!pending.empty()) {
+            SGNode* node = pending.back();
+            pending.pop_back();
+            if (!seen.insert(node).second)
+                continue;
+            map<SGNode*, string>::iterator texture = pendingTextures.find(node);
+            if (texture != pendingTextures.end()) {
+                if (assets.hasImage(texture->second))
+                    dynamic_cast<LeafNode*>(node)->setTexture(Symbol(texture->second),
+                                                              assets.getImagePixels(texture->second));
+                pendingTextures.erase(texture);
+            }
+            ParentSGNode* parent = dynamic_cast<ParentSGNode*>(node);
+            if ((parent != NULL) && (dynamic_cast<InstanceNode*>(node) == NULL)) {
+                vector<SGNode*> children = parent->getChildren();
+                pending.insert(pending.end(), children.begin(), children.end());
             }
-            clean << endl;
         }
-        return clean.str();
     }
 
-  private:
+    /**
+     * Keep only the meshes and images used below the root, and note the rest as
+     * skipped. Everything an imported template uses counts as used.
+     */
+    void keepUsedAssets(map<string, string>& meshPaths, map<string, string>& imagePaths) {
+        map<string, string>& declaredMeshes = assets.getMeshPaths();
+        map<string, string>& declaredImages = assets.getImagePaths();
+        set<SGNode*> seen;
+        vector<SGNode*> pending(1, root);
+        while (!pending.empty()) {
+            SGNode* node = pending.back();
+            pending.pop_back();
+            if (!seen.insert(node).second)
+                continue;
+            LeafNode* leaf = dynamic_cast<LeafNode*>(node);
+            InstanceNode* instance = dynamic_cast<InstanceNode*>(node);
+            ParentSGNode* parent = dynamic_cast<ParentSGNode*>(node);
+            if (leaf != NULL) {
+                const string& mesh = leaf->getInstanceOf();
+                if (declaredMeshes.find(mesh) != declaredMeshes.end())
+                    meshPaths[mesh] = declaredMeshes[mesh];
+                const string& image = leaf->getTextureSymbol().str();
+                if (declaredImages.find(image) != declaredImages.end())
+                    imagePaths[image] = declaredImages[image];
+            } else if (instance != NULL) {
+                map<string, string>& templateMeshes = instance->getTemplate()->getMeshPaths();
+                for (map<string, string>::iterator it = templateMeshes.begin(); it != templateMeshes.end(); it++)
+                    meshPaths[it->first] = declaredMeshes[it->first];
+                map<string, string>& templateImages = instance->getTemplate()->getImagePaths();
+                for (map<string, string>::iterator it = templateImages.begin(); it != templateImages.end(); it++)
+                    imagePaths[it->first] = declaredImages[it->first];
+            } else if (parent != NULL) {
+                vector<SGNode*> children = parent->getChildren();
+                pending.insert(pending.end(), children.begin(), children.end());
+            }
+        }
+
+        skippedAssets.clear();
+        for (map<string, string>::iterator it = declaredMeshes.begin(); it != declaredMeshes.end(); it++) {
+            if (meshPaths.find(it->first) == meshPaths.end()) {
+                assets.getMeshes().erase(it->first);
+                skippedAssets.push_back("mesh " + it->first + " " + it->second);
+            }
+        }
+        for (map<string, string>::iterator it = declaredImages.begin(); it != declaredImages.end(); it++) {
+            if (imagePaths.find(it->first) == imagePaths.end()) {
+                assets.dropImage(it->first);
+                skippedAssets.push_back("image " + it->first + " " + it->second);
+            }
+        }
+        if (verbose && !skippedAssets.empty()) {
+            cout << "Skipped " << skippedAssets.size() << " unused assets:" << endl;
+            for (size_t i = 0; i < skippedAssets.size(); i++)
+                cout << "  " << skippedAssets[i] << endl;
+        }
+    }
+
+    /**
+     * Get the template for an imported file: from this parse if the file was
+     * imported already, from the process-wide cache if it is unchanged since it
+     * was last parsed, and by parsing it otherwise
+     * \return the template, or nothing if the file cannot be read
+     */
+    shared_ptr<SubtreeTemplate> importTemplate(const string& filepath) {
+        map<string, shared_ptr<SubtreeTemplate> >::iterator known = templates.find(filepath);
+        if (known != templates.end())
+            return known->second;
+
+        string key;
+        if (!AssetCache::makeKey(filepath, key))
+            return shared_ptr<SubtreeTemplate>();
+        shared_ptr<SubtreeTemplate> subtree = TemplateCache::shared().find(key);
+        if (!subtree) {
+            ourutils::MappedFile file;
+            if (!file.open(filepath))
+                return shared_ptr<SubtreeTemplate>();
+            // the imported file gets its own names, but shares the asset cache
+            ScenegraphImporter nested;
+            nested.setVerbose(verbose);
+            IScenegraph* importedSG = nested.parse(file.data(), file.end());
+            vector<string> files(1, filepath);
+            vector<string> nestedFiles = nested.getSourceFiles();
+            files.insert(files.end(), nestedFiles.begin(), nestedFiles.end());
+            subtree = shared_ptr<SubtreeTemplate>(new SubtreeTemplate(
+                importedSG->getRoot(), importedSG->getMeshPaths(), importedSG->getImagePaths(), files));
+            // the template owns the nodes now, so only the scene graph object is deleted
+            importedSG->makeScenegraph(NULL);
+            delete importedSG;
+            TemplateCache::shared().store(key, subtree);
+        }
+        templates[filepath] = subtree;
+        return subtree;
+    }
+
+    /**
+     * Forget every binding whose name the last command used for the last time
+     */
+    void releaseUnusedBindings() {
+        for (size_t i = 0; i < commandTokens.size(); i++) {
+            const string& name = commandTokens[i].first;
+            if (!isName(name.data(), name.size()))
+                continue;
+            unordered_map<uint64_t, size_t>::iterator use = lastUses->find(hashName(name.data(), name.size()));
+            if ((use == lastUses->end()) || (use->second != commandTokens[i].second))
+                continue;
+            materials.erase(name);
+            lights.erase(name);
+            map<string, SGNode*>::iterator binding = nodes.find(name);
+            if (binding != nodes.end()) {
+                SGNode* node = binding->second;
+                nodes.erase(binding);
+                deleteIfUnreachable(node);
+            }
+        }
+        commandTokens.clear();
+    }
+
+    /**
+     * Delete a node that is not the root, has no parent and can no longer be
+     * reached through a binding, along with its subtree. A subtree that contains
+     * the root, a bound node or a node with several parents is left alone.
+     */
+    void deleteIfUnreachable(SGNode* node) {
+        if ((node == NULL) || (node == root) || (node->getParent() != NULL))
+            return;
+        set<SGNode*> subtree;
+        vector<SGNode*> pending(1, node);
+        while (!pending.empty()) {
+            SGNode* n = pending.back();
+            pending.pop_back();
+            if ((n == root) || (sharedNodes.find(n) != sharedNodes.end()))
+                return;
+            subtree.insert(n);
+            ParentSGNode* parent = dynamic_cast<ParentSGNode*>(n);
+            // the template below an instance is not part of this scene
+            if ((parent != NULL) && (dynamic_cast<InstanceNode*>(n) == NULL)) {
+                vector<SGNode*> children = parent->getChildren();
+                pending.insert(pending.end(), children.begin(), children.end());
+            }
+        }
+        for (map<string, SGNode*>::iterator it = nodes.begin(); it != nodes.end(); it++) {
+            if (subtree.find(it->second) != subtree.end())
+                return;
+        }
+        for (set<SGNode*>::iterator it = subtree.begin(); it != subtree.end(); it++)
+            pendingTextures.erase(*it);
+        delete node;
+    }
+
+    /**
+     * Numbers cannot be names, so they are not tracked. A name that looks like a
+     * number is then simply never released.
+     */
+    static bool isName(const char* token, size_t length) {
+        return (length > 0) && !isdigit((unsigned char)token[0]) && (token[0] != '-') && (token[0] != '+') &&
+               (token[0] != '.');
+    }
+
+    static uint64_t hashName(const char* token, size_t length) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (unsigned char)token[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    enum Command {
+        UNKNOWN, INSTANCE, IMAGE, GROUP, LEAF, MATERIAL, LIGHT, SCALE, ROTATE, TRANSLATE,
+        COPY, IMPORT, ASSIGN_MATERIAL, ASSIGN_LIGHT, ASSIGN_TEXTURE, ADD_CHILD, ASSIGN_ROOT
+    };
+
+    /**
+     * Find the command for a keyword token. The hash of the length, first and last
+     * character is collision-free over all keywords, so a lookup is one table probe
+     * and one comparison.
+     */
+    static Command lookupCommand(const char* token, size_t length) {
+        struct Keyword {
+            const char* text;
+            Command command;
+        };
+        static const Keyword table[32] = {
+            {"group", GROUP}, {NULL, UNKNOWN}, {NULL, UNKNOWN}, {NULL, UNKNOWN},
+            {"scale", SCALE}, {"light", LIGHT}, {NULL, UNKNOWN}, {"import", IMPORT},
+            {"rotate", ROTATE}, {"instance", INSTANCE}, {NULL, UNKNOWN}, {NULL, UNKNOWN},
+            {"assign-material", ASSIGN_MATERIAL}, {NULL, UNKNOWN}, {"add-child", ADD_CHILD}, {"copy", COPY},
+            {"leaf", LEAF}, {NULL, UNKNOWN}, {NULL, UNKNOWN}, {NULL, UNKNOWN},
+            {NULL, UNKNOWN}, {"material", MATERIAL}, {NULL, UNKNOWN}, {NULL, UNKNOWN},
+            {"assign-root", ASSIGN_ROOT}, {"translate", TRANSLATE}, {"image", IMAGE}, {NULL, UNKNOWN},
+            {NULL, UNKNOWN}, {"assign-light", ASSIGN_LIGHT}, {NULL, UNKNOWN}, {"assign-texture", ASSIGN_TEXTURE},
+        };
+        if (length == 0)
+            return UNKNOWN;
+        unsigned int hash = ((unsigned int)length * 5 + (unsigned char)token[0] + (unsigned char)token[length - 1] * 24) & 31;
+        const Keyword& keyword = table[hash];
+        if ((keyword.text != NULL) && CommandTokenizer::matches(token, length, keyword.text))
+            return keyword.command;
+        return UNKNOWN;
+    }
+
     map<string, SGNode*> nodes;
     map<string, util::Material> materials;
     map<string, util::Light> lights;
-    map<string, util::PolygonMesh<VertexAttrib>> meshes;
-    map<string, util::TextureImage> images;
-    map<string, string> meshPaths;
-    map<string, string> imagePaths;
+    map<SGNode*, string> pendingTextures;
+    vector<string> skippedAssets;
+    vector<string> sourceFiles;
     SGNode* root;
+    bool verbose;
+    unordered_map<uint64_t, size_t>* lastUses;
+    vector<pair<string, size_t> > commandTokens;
+    set<SGNode*> sharedNodes;
+    map<string, shared_ptr<SubtreeTemplate> > templates;
+    SceneAssetLoader assets;
 };
 
 } // namespace sgraph
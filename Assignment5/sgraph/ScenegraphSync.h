@@ -0,0 +1,186 @@
+#ifndef _SCENEGRAPHSYNC_H_
+#define _SCENEGRAPHSYNC_H_
+
+#include "InstanceNode.h"
+#include "LeafNode.h"
+#include "ParentSGNode.h"
+#include "SGNode.h"
+#include "TransformNode.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <typeinfo>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class brings a live scene graph up to date with a freshly parsed copy of
+ * the same scene, so that a command file can be edited while it is displayed.
+ *
+ * Nodes are matched by name, from the root down. A matched node of the same type
+ * and with the same transform is kept, and its children are matched in turn. A
+ * leaf is kept if it still refers to the same object instance; its material, light
+ * and texture are copied from the fresh leaf. A transform whose parameters changed
+ * is taken from the fresh tree, but its matched child is still kept. An instance
+ * of an imported file is kept if it still shares the same template. Anything else
+ * is taken from the fresh tree as it is.
+ *
+ * Nodes of either tree that do not end up in the result are deleted. This is done
+ * node by node, so a node that was added to two parents is only deleted once.
+ */
+class ScenegraphSync {
+  public:
+    ScenegraphSync() : kept(0), added(0), removed(0) {}
+
+    /**
+     * Merge the fresh tree into the live one. Both trees are consumed.
+     * \return the root of the merged tree
+     */
+    SGNode* apply(SGNode* liveRoot, SGNode* freshRoot) {
+        set<SGNode*> liveNodes;
+        set<SGNode*> freshNodes;
+        collect(liveRoot, liveNodes);
+        collect(freshRoot, freshNodes);
+
+        synced.clear();
+        used.clear();
+        SGNode* result = sync(liveRoot, freshRoot);
+
+        set<SGNode*> alive;
+        collect(result, alive);
+        kept = added = removed = 0;
+        for (set<SGNode*>::iterator it = alive.begin(); it != alive.end(); it++) {
+            if (liveNodes.count(*it) > 0)
+                kept++;
+            else
+                added++;
+        }
+        for (set<SGNode*>::iterator it = liveNodes.begin(); it != liveNodes.end(); it++) {
+            if (alive.count(*it) == 0) {
+                removed++;
+                release(*it);
+            }
+        }
+        for (set<SGNode*>::iterator it = freshNodes.begin(); it != freshNodes.end(); it++) {
+            if (alive.count(*it) == 0)
+                release(*it);
+        }
+        return result;
+    }
+
+    /**
+     * \return the number of live nodes kept by the last apply
+     */
+    int getKept() { return kept; }
+
+    /**
+     * \return the number of fresh nodes added by the last apply
+     */
+    int getAdded() { return added; }
+
+    /**
+     * \return the number of live nodes removed by the last apply
+     */
+    int getRemoved() { return removed; }
+
+  private:
+    SGNode* sync(SGNode* live, SGNode* fresh) {
+        // a node added to several parents is merged once and shared again
+        map<SGNode*, SGNode*>::iterator done = synced.find(fresh);
+        if (done != synced.end())
+            return done->second;
+
+        SGNode* result = fresh;
+        if ((live != NULL) && (used.count(live) == 0) && (typeid(*live) == typeid(*fresh)) &&
+            (live->getNameSymbol() == fresh->getNameSymbol())) {
+            LeafNode* liveLeaf = dynamic_cast<LeafNode*>(live);
+            InstanceNode* liveInstance = dynamic_cast<InstanceNode*>(live);
+            ParentSGNode* liveParent = dynamic_cast<ParentSGNode*>(live);
+            if (liveInstance != NULL) {
+                // templates are shared and never changed, so there is nothing to merge below
+                InstanceNode* freshInstance = dynamic_cast<InstanceNode*>(fresh);
+                if ((liveInstance->getTemplate() == freshInstance->getTemplate()) && sameTransform(live, fresh))
+                    result = live;
+            } else if (liveLeaf != NULL) {
+                LeafNode* freshLeaf = dynamic_cast<LeafNode*>(fresh);
+                if (liveLeaf->getInstanceSymbol() == freshLeaf->getInstanceSymbol()) {
+                    liveLeaf->setMaterial(freshLeaf->getMaterial());
+                    liveLeaf->setLight(freshLeaf->getLight());
+                    liveLeaf->setTexture(freshLeaf->getTextureSymbol(), freshLeaf->getTexturePixels());
+                    result = live;
+                }
+            } else if (liveParent != NULL) {
+                ParentSGNode* freshParent = dynamic_cast<ParentSGNode*>(fresh);
+                ParentSGNode* target = sameTransform(live, fresh) ? liveParent : freshParent;
+                syncChildren(liveParent, freshParent, target);
+                result = target;
+            }
+            used.insert(live);
+        }
+        synced[fresh] = result;
+        return result;
+    }
+
+    /**
+     * Match the fresh children to the live children by name, and attach the merged
+     * children to the target
+     */
+    void syncChildren(ParentSGNode* live, ParentSGNode* fresh, ParentSGNode* target) {
+        vector<SGNode*> liveChildren = live->releaseChildren();
+        vector<SGNode*> freshChildren = fresh->releaseChildren();
+        vector<bool> matched(liveChildren.size(), false);
+        for (size_t i = 0; i < freshChildren.size(); i++) {
+            SGNode* match = NULL;
+            for (size_t j = 0; (j < liveChildren.size()) && (match == NULL); j++) {
+                if (!matched[j] && (liveChildren[j]->getNameSymbol() == freshChildren[i]->getNameSymbol())) {
+                    matched[j] = true;
+                    match = liveChildren[j];
+                }
+            }
+            target->addChild(sync(match, freshChildren[i]));
+        }
+    }
+
+    static bool sameTransform(SGNode* live, SGNode* fresh) {
+        TransformNode* liveTransform = dynamic_cast<TransformNode*>(live);
+        TransformNode* freshTransform = dynamic_cast<TransformNode*>(fresh);
+        if ((liveTransform == NULL) || (freshTransform == NULL))
+            return true;
+        return liveTransform->getTransform() == freshTransform->getTransform();
+    }
+
+    static void collect(SGNode* node, set<SGNode*>& found) {
+        if ((node == NULL) || !found.insert(node).second)
+            return;
+        ParentSGNode* parent = dynamic_cast<ParentSGNode*>(node);
+        // the template below an instance belongs to the template cache
+        if ((parent != NULL) && (dynamic_cast<InstanceNode*>(node) == NULL)) {
+            vector<SGNode*> children = parent->getChildren();
+            for (size_t i = 0; i < children.size(); i++)
+                collect(children[i], found);
+        }
+    }
+
+    /**
+     * Delete a single node, leaving whatever is below it alone
+     */
+    static void release(SGNode* node) {
+        ParentSGNode* parent = dynamic_cast<ParentSGNode*>(node);
+        if (parent != NULL)
+            parent->releaseChildren();
+        delete node;
+    }
+
+    map<SGNode*, SGNode*> synced;
+    set<SGNode*> used;
+    int kept;
+    int added;
+    int removed;
+};
+
+} // namespace sgraph
+
+#endif
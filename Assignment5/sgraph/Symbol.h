@@ -0,0 +1,202 @@
+#ifndef _SYMBOL_H_
+#define _SYMBOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class keeps one copy of every name used in the scene graphs of this
+ * process and numbers them. Numbers are never reused, so a number stands for
+ * the same name for as long as the process runs.
+ *
+ * Names are stored in blocks that double in size and never move, so the text
+ * of a name can be read without locking while other names are being added.
+ */
+class SymbolTable {
+  public:
+    /**
+     * The table shared by the whole process
+     */
+    static SymbolTable& shared() {
+        static SymbolTable table;
+        return table;
+    }
+
+    /**
+     * Get the number of a name, adding the name if it is new. Looking up a name
+     * that is already known does not allocate.
+     */
+    uint32_t intern(const char* text, size_t length) {
+        uint64_t hash = hashOf(text, length);
+        lock_guard<mutex> lock(guard);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            if (slots[i] == 0) {
+                uint32_t id = add(text, length);
+                slots[i] = id + 1;
+                if ((count * 2) > slots.size())
+                    rehash(slots.size() * 2);
+                return id;
+            }
+            const string& known = textOf(slots[i] - 1);
+            if ((known.size() == length) && (memcmp(known.data(), text, length) == 0))
+                return slots[i] - 1;
+        }
+    }
+
+    /**
+     * Get the text of a numbered name
+     */
+    const string& textOf(uint32_t id) const {
+        uint32_t index = id + FIRST_BLOCK_SIZE;
+        int block = 0;
+        while ((index >> (block + FIRST_BLOCK_BITS + 1)) != 0)
+            block++;
+        return blocks[block].load(memory_order_acquire)[index - (FIRST_BLOCK_SIZE << block)];
+    }
+
+    /**
+     * \return the number of names known
+     */
+    size_t size() {
+        lock_guard<mutex> lock(guard);
+        return count;
+    }
+
+    /**
+     * \return the bytes used by the table: the name blocks, the text of names too
+     * long to be stored inside a string, and the hash table
+     */
+    size_t memoryUsed() {
+        lock_guard<mutex> lock(guard);
+        size_t bytes = slots.capacity() * sizeof(uint32_t);
+        for (int b = 0; (b < MAX_BLOCKS) && (blocks[b].load() != NULL); b++)
+            bytes += (FIRST_BLOCK_SIZE << b) * sizeof(string);
+        for (uint32_t id = 0; id < count; id++)
+            bytes += heapBytes(textOf(id));
+        return bytes;
+    }
+
+    /**
+     * \return the bytes a string keeps outside itself (nothing if it fits in place)
+     */
+    static size_t heapBytes(const string& text) {
+        string empty;
+        return (text.capacity() > empty.capacity()) ? text.capacity() + 1 : 0;
+    }
+
+  private:
+    static const int FIRST_BLOCK_BITS = 6;
+    static const uint32_t FIRST_BLOCK_SIZE = 1u << FIRST_BLOCK_BITS;
+    static const int MAX_BLOCKS = 32 - FIRST_BLOCK_BITS;
+
+    SymbolTable() : count(0), slots(64, 0) {
+        for (int b = 0; b < MAX_BLOCKS; b++)
+            blocks[b].store(NULL);
+        // the empty name is always number 0
+        add("", 0);
+        slots[hashOf("", 0) & (slots.size() - 1)] = 1;
+    }
+
+    ~SymbolTable() {
+        for (int b = 0; b < MAX_BLOCKS; b++)
+            delete[] blocks[b].load();
+    }
+
+    SymbolTable(const SymbolTable&);
+    SymbolTable& operator=(const SymbolTable&);
+
+    uint32_t add(const char* text, size_t length) {
+        uint32_t id = count;
+        uint32_t index = id + FIRST_BLOCK_SIZE;
+        int block = 0;
+        while ((index >> (block + FIRST_BLOCK_BITS + 1)) != 0)
+            block++;
+        string* names = blocks[block].load(memory_order_relaxed);
+        if (names == NULL) {
+            names = new string[FIRST_BLOCK_SIZE << block];
+            blocks[block].store(names, memory_order_release);
+        }
+        names[index - (FIRST_BLOCK_SIZE << block)].assign(text, length);
+        count++;
+        return id;
+    }
+
+    void rehash(size_t size) {
+        vector<uint32_t> larger(size, 0);
+        for (uint32_t id = 0; id < count; id++) {
+            const string& text = textOf(id);
+            size_t i = hashOf(text.data(), text.size()) & (size - 1);
+            while (larger[i] != 0)
+                i = (i + 1) & (size - 1);
+            larger[i] = id + 1;
+        }
+        slots.swap(larger);
+    }
+
+    static uint64_t hashOf(const char* text, size_t length) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (unsigned char)text[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    mutex guard;
+    uint32_t count;
+    vector<uint32_t> slots;
+    atomic<string*> blocks[MAX_BLOCKS];
+};
+
+/**
+ * A name in the SymbolTable. It is a single number, so copying, comparing and
+ * hashing it cost the same as for an int, whatever the length of the name.
+ */
+class Symbol {
+  public:
+    Symbol() : id(0) {}
+
+    Symbol(const string& text) : id(SymbolTable::shared().intern(text.data(), text.size())) {}
+
+    Symbol(const char* text) : id(SymbolTable::shared().intern(text, strlen(text))) {}
+
+    Symbol(const char* text, size_t length) : id(SymbolTable::shared().intern(text, length)) {}
+
+    const string& str() const { return SymbolTable::shared().textOf(id); }
+
+    uint32_t getId() const { return id; }
+
+    bool empty() const { return id == 0; }
+
+    bool operator==(const Symbol& other) const { return id == other.id; }
+
+    bool operator!=(const Symbol& other) const { return id != other.id; }
+
+    /**
+     * Orders symbols by when they were first seen, not alphabetically
+     */
+    bool operator<(const Symbol& other) const { return id < other.id; }
+
+  private:
+    uint32_t id;
+};
+
+} // namespace sgraph
+
+namespace std {
+template <>
+struct hash<sgraph::Symbol> {
+    size_t operator()(const sgraph::Symbol& symbol) const { return symbol.getId(); }
+};
+} // namespace std
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _TEMPLATECACHE_H_
+#define _TEMPLATECACHE_H_
+
+#include "InstanceNode.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class remembers the subtree parsed from each imported command file, keyed
+ * like AssetCache by the canonical path and content hash of the file. A template
+ * stays in the cache as long as some instance refers to it.
+ */
+class TemplateCache {
+  public:
+    /**
+     * The cache shared by the whole process
+     */
+    static TemplateCache& shared() {
+        static TemplateCache cache;
+        return cache;
+    }
+
+    /**
+     * Get the template for a file key, if there is one and none of the files it
+     * was built from has changed since
+     */
+    shared_ptr<SubtreeTemplate> find(const string& key) {
+        shared_ptr<SubtreeTemplate> found;
+        {
+            lock_guard<mutex> lock(guard);
+            map<string, weak_ptr<SubtreeTemplate> >::iterator it = templates.find(key);
+            if (it != templates.end())
+                found = it->second.lock();
+        }
+        if (found && !found->isCurrent())
+            found.reset();
+        return found;
+    }
+
+    void store(const string& key, shared_ptr<SubtreeTemplate> subtree) {
+        lock_guard<mutex> lock(guard);
+        for (map<string, weak_ptr<SubtreeTemplate> >::iterator it = templates.begin(); it != templates.end();) {
+            if (it->second.expired())
+                it = templates.erase(it);
+            else
+                it++;
+        }
+        templates[key] = subtree;
+    }
+
+    /**
+     * \return the number of templates still in use
+     */
+    size_t size() {
+        lock_guard<mutex> lock(guard);
+        size_t count = 0;
+        for (map<string, weak_ptr<SubtreeTemplate> >::iterator it = templates.begin(); it != templates.end(); it++) {
+            if (!it->second.expired())
+                count++;
+        }
+        return count;
+    }
+
+  private:
+    TemplateCache() {}
+
+    TemplateCache(const TemplateCache&);
+    TemplateCache& operator=(const TemplateCache&);
+
+    mutex guard;
+    map<string, weak_ptr<SubtreeTemplate> > templates;
+};
+
+} // namespace sgraph
+
+#endif
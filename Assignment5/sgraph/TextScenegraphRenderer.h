@@ -10,6 +10,7 @@
 #include "RotateTransform.h"
 #include "ScaleTransform.h"
 #include "TranslateTransform.h"
+#include "InstanceNode.h"
 #include <sstream>
 #include <string>
 
@@ -67,6 +68,11 @@ namespace sgraph {
                 visitTransformNode(rotateNode);
             }
 
+            //an imported node is shown as the subtree it shares
+            void visitInstanceNode(InstanceNode *instanceNode) {
+                instanceNode->getChildren()[0]->accept(this);
+            }
+
         private:
             stringstream output;
             int currentLevel;
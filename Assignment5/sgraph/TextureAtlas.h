@@ -0,0 +1,228 @@
+#ifndef _TEXTUREATLAS_H_
+#define _TEXTUREATLAS_H_
+
+#include "MipChain.h"
+#include "PixelBuffer.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * This class packs small textures into shared pages, so that leaves using
+ * different small textures can be drawn without binding a different texture.
+ * A leaf reaches its image through a texture matrix that maps the unit square
+ * onto the image's place in its page.
+ *
+ * Images are packed with a skyline: the top edge of what has been placed so far,
+ * kept as a list of segments, and each image goes wherever along it sits
+ * lowest. Each image is surrounded by a gutter of padding pixels that repeats
+ * its edges, and is placed on a multiple of padding, so that the first
+ * log2(padding) mip levels of a page do not blend neighbouring images; the
+ * pages have only those levels. Texture coordinates outside [0,1] would read
+ * the neighbours too, so meshes that repeat a texture must use it on its own.
+ */
+class TextureAtlas {
+  public:
+    /**
+     * Where an image was placed
+     */
+    struct Placement {
+        int page;
+        int x;
+        int y;
+        glm::mat4 textureMatrix;
+    };
+
+    /**
+     * \param pageSize width and height of each page, in pixels
+     * \param padding width of the gutter around each image, a power of 2
+     * \param largest images wider or taller than this are left out
+     */
+    explicit TextureAtlas(int pageSize = 1024, int padding = 4, int largest = 256)
+        : pageSize(pageSize), padding(padding), largest(min(largest, pageSize - 2 * padding)), usedArea(0) {}
+
+    /**
+     * \return true if the image is small enough, and uncompressed, to be packed
+     */
+    bool accepts(const PixelHandle& image) const {
+        return (image->getFormat() == ourutils::BlockCompression::NONE) && (image->getWidth() <= largest) &&
+               (image->getHeight() <= largest);
+    }
+
+    /**
+     * Pack every image the atlas accepts into as few pages as it can, replacing
+     * whatever was packed before
+     */
+    void build(const map<string, PixelHandle>& images) {
+        pages.clear();
+        placements.clear();
+        usedArea = 0;
+        vector<pair<string, PixelHandle> > order;
+        for (map<string, PixelHandle>::const_iterator it = images.begin(); it != images.end(); it++) {
+            if (it->second && accepts(it->second))
+                order.push_back(*it);
+        }
+        // tallest first keeps the skyline flat; the map order breaks ties
+        stable_sort(order.begin(), order.end(), tallerFirst);
+
+        vector<vector<Segment> > skylines;
+        vector<GLubyte*> pixels;
+        for (size_t i = 0; i < order.size(); i++) {
+            const PixelHandle& image = order[i].second;
+            int width = cellSize(image->getWidth());
+            int height = cellSize(image->getHeight());
+            Placement placement;
+            placement.page = -1;
+            for (size_t p = 0; (p < skylines.size()) && (placement.page < 0); p++) {
+                if (place(skylines[p], width, height, placement.x, placement.y))
+                    placement.page = (int)p;
+            }
+            if (placement.page < 0) {
+                skylines.push_back(vector<Segment>(1, Segment(0, 0, pageSize)));
+                pixels.push_back(new GLubyte[3 * (size_t)pageSize * pageSize]());
+                place(skylines.back(), width, height, placement.x, placement.y);
+                placement.page = (int)skylines.size() - 1;
+            }
+            copyWithGutter(*image, pixels[placement.page], placement.x, placement.y);
+            float page = (float)pageSize;
+            placement.textureMatrix =
+                glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3((placement.x + padding) / page,
+                                                                     (placement.y + padding) / page, 0)),
+                           glm::vec3(image->getWidth() / page, image->getHeight() / page, 1));
+            placements[order[i].first] = placement;
+            usedArea += (double)image->getWidth() * image->getHeight();
+        }
+
+        int levels = 1;
+        for (int gutter = padding; gutter > 1; gutter /= 2)
+            levels++;
+        for (size_t p = 0; p < pixels.size(); p++)
+            pages.push_back(MipChain::build(PixelBuffer::adopt(pixels[p], pageSize, pageSize), levels));
+    }
+
+    const vector<PixelHandle>& getPages() const { return pages; }
+
+    /**
+     * \return where the named image was placed, or nothing if it was not packed
+     */
+    const Placement* find(const string& name) const {
+        map<string, Placement>::const_iterator it = placements.find(name);
+        return (it != placements.end()) ? &it->second : NULL;
+    }
+
+    size_t size() const { return placements.size(); }
+
+    /**
+     * \return the fraction of the pages covered by images, gutters not included
+     */
+    double getOccupancy() const {
+        return pages.empty() ? 0 : usedArea / ((double)pageSize * pageSize * pages.size());
+    }
+
+  private:
+    /**
+     * A piece of the skyline, from x to x + width at height y
+     */
+    struct Segment {
+        int x;
+        int y;
+        int width;
+
+        Segment(int x, int y, int width) : x(x), y(y), width(width) {}
+    };
+
+    static bool tallerFirst(const pair<string, PixelHandle>& a, const pair<string, PixelHandle>& b) {
+        if (a.second->getHeight() != b.second->getHeight())
+            return a.second->getHeight() > b.second->getHeight();
+        return a.second->getWidth() > b.second->getWidth();
+    }
+
+    /**
+     * \return the space an image takes with its gutter, rounded up to a
+     * multiple of padding
+     */
+    int cellSize(int size) const { return (size + 2 * padding + padding - 1) / padding * padding; }
+
+    /**
+     * Find the lowest place on the skyline, leftmost if there is a tie, where a
+     * cell fits, and raise the skyline over it
+     * \return false if the cell does not fit anywhere on this page
+     */
+    bool place(vector<Segment>& skyline, int width, int height, int& x, int& y) {
+        int best = -1;
+        int bestY = pageSize;
+        for (size_t i = 0; i < skyline.size(); i++) {
+            int left = skyline[i].x;
+            if (left + width > pageSize)
+                break;
+            int top = 0;
+            for (size_t j = i; (j < skyline.size()) && (skyline[j].x < left + width); j++)
+                top = max(top, skyline[j].y);
+            if ((top + height <= pageSize) && (top < bestY)) {
+                best = (int)i;
+                bestY = top;
+            }
+        }
+        if (best < 0)
+            return false;
+        x = skyline[best].x;
+        y = bestY;
+
+        // the new segment covers [x, x + width); cut away what it hides
+        vector<Segment> raised(skyline.begin(), skyline.begin() + best);
+        raised.push_back(Segment(x, y + height, width));
+        for (size_t j = best; j < skyline.size(); j++) {
+            int right = skyline[j].x + skyline[j].width;
+            if (right <= x + width)
+                continue;
+            int left = max(skyline[j].x, x + width);
+            raised.push_back(Segment(left, skyline[j].y, right - left));
+        }
+        skyline.clear();
+        for (size_t j = 0; j < raised.size(); j++) {
+            if (!skyline.empty() && (skyline.back().y == raised[j].y))
+                skyline.back().width += raised[j].width;
+            else
+                skyline.push_back(raised[j]);
+        }
+        return true;
+    }
+
+    /**
+     * Copy an image into a page at the given cell, with its edge pixels
+     * repeated across the gutter
+     */
+    void copyWithGutter(const PixelBuffer& image, GLubyte* page, int x, int y) const {
+        int width = image.getWidth();
+        int height = image.getHeight();
+        for (int row = -padding; row < height + padding; row++) {
+            const GLubyte* source = image.data() + 3 * (size_t)width * min(max(row, 0), height - 1);
+            GLubyte* target = page + 3 * ((size_t)(y + padding + row) * pageSize + x);
+            for (int column = 0; column < padding; column++)
+                memcpy(target + 3 * column, source, 3);
+            memcpy(target + 3 * padding, source, 3 * (size_t)width);
+            for (int column = 0; column < padding; column++)
+                memcpy(target + 3 * (padding + width + column), source + 3 * (width - 1), 3);
+        }
+    }
+
+    int pageSize;
+    int padding;
+    int largest;
+    vector<PixelHandle> pages;
+    map<string, Placement> placements;
+    double usedArea;
+};
+
+} // namespace sgraph
+
+#endif
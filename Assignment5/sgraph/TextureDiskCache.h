@@ -0,0 +1,274 @@
+#ifndef _TEXTUREDISKCACHE_H_
+#define _TEXTUREDISKCACHE_H_
+
+#include "../ourutils/BlockCompression.h"
+#include "../ourutils/MappedFile.h"
+
+#include <glad/glad.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace sgraph {
+
+/**
+ * The layout of a decoded texture in the cache directory: a header followed by
+ * the RGB pixels of each mip level, largest first, bottom row first as
+ * PPMImageLoader returns them, or the blocks of each level in a BlockCompression
+ * format. Each level is half the size of the one before it, rounded down but at
+ * least 1 pixel. The header is 64 bytes, so a memory-mapped entry can be handed
+ * to OpenGL in place.
+ */
+namespace textureformat {
+
+    const char MAGIC[4] = {'S', 'G', 'T', 'X'};
+    const uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        int64_t sourceTime;     // modification time of the source, in nanoseconds
+        uint64_t sourceSize;
+        uint64_t sourceHash;    // as AssetCache::hashFile computes it
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        uint32_t format;        // a BlockCompression::Format, NONE for RGB
+        uint32_t reserved[4];
+    };
+
+    /**
+     * \return the number of bytes in the given number of levels of an image
+     */
+    inline uint64_t pixelBytes(uint32_t width, uint32_t height, uint32_t levels,
+                               uint32_t format = ourutils::BlockCompression::NONE) {
+        uint64_t bytes = 0;
+        for (uint32_t l = 0; l < levels; l++) {
+            if (format == ourutils::BlockCompression::NONE)
+                bytes += 3ULL * width * height;
+            else
+                bytes += ourutils::BlockCompression::compressedSize((ourutils::BlockCompression::Format)format,
+                                                                    (int)width, (int)height);
+            width = (width > 1) ? width / 2 : 1;
+            height = (height > 1) ? height / 2 : 1;
+        }
+        return bytes;
+    }
+
+} // namespace textureformat
+
+/**
+ * A texture found in the cache. The pixels stay mapped while the mapping is
+ * held.
+ */
+struct CachedTexture {
+    GLubyte* pixels;
+    int width;
+    int height;
+    int levels;
+    ourutils::BlockCompression::Format format;
+    uint64_t sourceHash;
+    shared_ptr<ourutils::MappedFile> mapping;
+};
+
+/**
+ * This class keeps decoded textures in a directory, one file per source image,
+ * so that a later run can map them instead of decoding the source again. An
+ * entry is named after the canonical path of its source and records the
+ * modification time, size and content hash of the source it was decoded from.
+ * If the time and size still match, the entry is used without reading the
+ * source at all; if only the time changed, the source is hashed and the entry is
+ * used if the contents are the same.
+ *
+ * Entries are written to a temporary file and renamed into place, even when
+ * only the recorded time changes, so processes sharing a cache directory never
+ * see half an entry and a mapped entry is never written to.
+ */
+class TextureDiskCache {
+  public:
+    TextureDiskCache() {}
+
+    /**
+     * Use the given directory, which is created when the first entry is stored.
+     * An empty path turns the cache off.
+     */
+    void setDirectory(const string& path) {
+        lock_guard<mutex> lock(guard);
+        directory = path;
+    }
+
+    bool isEnabled() {
+        lock_guard<mutex> lock(guard);
+        return !directory.empty();
+    }
+
+    /**
+     * Look for an up to date entry for a source image, given by its canonical
+     * path, in the given format. The hash function is only called if the source
+     * looks modified. The mapping goes when the last copy of found does.
+     * \return true if the entry was found and mapped
+     */
+    template <class Hash>
+    bool find(const string& canonical, ourutils::BlockCompression::Format format, CachedTexture& found,
+              Hash hashSource) {
+        int64_t time;
+        uint64_t size;
+        string entry = entryPath(canonical);
+        if (entry.empty() || !sourceInfo(canonical, time, size))
+            return false;
+        shared_ptr<ourutils::MappedFile> file(new ourutils::MappedFile());
+        if (!file->open(entry) || (file->size() < sizeof(textureformat::Header)))
+            return false;
+        textureformat::Header header;
+        memcpy(&header, file->data(), sizeof(header));
+        if ((memcmp(header.magic, textureformat::MAGIC, 4) != 0) || (header.version != textureformat::VERSION) ||
+            (header.width == 0) || (header.height == 0) || (header.levels == 0) || (header.format != (uint32_t)format) ||
+            (file->size() <
+             sizeof(header) + textureformat::pixelBytes(header.width, header.height, header.levels, header.format)))
+            return false;
+        if ((header.sourceTime != time) || (header.sourceSize != size)) {
+            uint64_t hash;
+            if ((header.sourceSize != size) || !hashSource(hash) || (hash != header.sourceHash))
+                return false;
+            // same contents, touched: remember the new time so the next run skips the hash
+            header.sourceTime = time;
+            writeEntry(entry, header, file->data() + sizeof(header),
+                       (size_t)textureformat::pixelBytes(header.width, header.height, header.levels, header.format));
+        }
+        found.pixels = (GLubyte*)(file->data() + sizeof(header));
+        found.width = (int)header.width;
+        found.height = (int)header.height;
+        found.levels = (int)header.levels;
+        found.format = format;
+        found.sourceHash = header.sourceHash;
+        found.mapping = file;
+        return true;
+    }
+
+    /**
+     * Store the decoded pixels of a source image, with as many mip levels as
+     * the pixels hold, in the format they are in. An entry holds one format, so
+     * this replaces an entry in any other format.
+     * \return true if the entry was written
+     */
+    bool store(const string& canonical, uint64_t sourceHash, const GLubyte* pixels, int width, int height,
+               int levels = 1, ourutils::BlockCompression::Format format = ourutils::BlockCompression::NONE) {
+        int64_t time;
+        uint64_t size;
+        string entry = entryPath(canonical);
+        if (entry.empty() || (width <= 0) || (height <= 0) || (levels <= 0) || !sourceInfo(canonical, time, size))
+            return false;
+        makeDirectory();
+
+        textureformat::Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, textureformat::MAGIC, 4);
+        header.version = textureformat::VERSION;
+        header.sourceTime = time;
+        header.sourceSize = size;
+        header.sourceHash = sourceHash;
+        header.width = (uint32_t)width;
+        header.height = (uint32_t)height;
+        header.levels = (uint32_t)levels;
+        header.format = (uint32_t)format;
+        return writeEntry(entry, header, pixels,
+                          (size_t)textureformat::pixelBytes(header.width, header.height, header.levels, header.format));
+    }
+
+    /**
+     * \return the path of the entry for a source image, or nothing if the cache
+     * is off
+     */
+    string entryPath(const string& canonical) {
+        lock_guard<mutex> lock(guard);
+        if (directory.empty())
+            return "";
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < canonical.size(); i++) {
+            hash ^= (unsigned char)canonical[i];
+            hash *= 1099511628211ULL;
+        }
+        char name[24];
+        snprintf(name, sizeof(name), "%016llx.tex", (unsigned long long)hash);
+        return directory + "/" + name;
+    }
+
+  private:
+    /**
+     * Write an entry to a temporary file and rename it over the entry. The
+     * temporary name is unique to this process and this call, so loader threads
+     * storing the same entry, in two formats say, each write their own.
+     * \return true if the entry was replaced
+     */
+    static bool writeEntry(const string& entry, const textureformat::Header& header, const void* pixels,
+                           size_t bytes) {
+        static atomic<unsigned int> written(0);
+        char suffix[48];
+        snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", (int)getpid(), written++);
+        string temporary = entry + suffix;
+        FILE* out = fopen(temporary.c_str(), "wb");
+        if (out == NULL)
+            return false;
+        bool ok = (fwrite(&header, sizeof(header), 1, out) == 1) && (fwrite(pixels, 1, bytes, out) == bytes);
+        ok = (fclose(out) == 0) && ok;
+#ifdef _WIN32
+        remove(entry.c_str());
+#endif
+        if (!ok || (rename(temporary.c_str(), entry.c_str()) != 0)) {
+            remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Get the modification time, in nanoseconds where the platform records
+     * them, and the size of a file
+     */
+    static bool sourceInfo(const string& path, int64_t& time, uint64_t& size) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return false;
+#if defined(__APPLE__)
+        time = (int64_t)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+        time = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#else
+        time = (int64_t)info.st_mtime * 1000000000LL;
+#endif
+        size = (uint64_t)info.st_size;
+        return true;
+    }
+
+    void makeDirectory() {
+        lock_guard<mutex> lock(guard);
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    TextureDiskCache(const TextureDiskCache&);
+    TextureDiskCache& operator=(const TextureDiskCache&);
+
+    mutex guard;
+    string directory;
+};
+
+} // namespace sgraph
+
+#endif
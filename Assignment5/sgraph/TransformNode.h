@@ -19,15 +19,51 @@ namespace sgraph
   class TransformNode: public ParentSGNode {
     protected:
       glm::mat4 transform;
+      /**
+       * The product of the transforms from the root down to this one, as of the last
+       * update of the world transforms
+       */
+      glm::mat4 world;
+      /**
+       * The matrices that transform normals as transform and world transform points
+       */
+      glm::mat3 normal;
+      glm::mat3 worldNormal;
 
-      void setTransform(glm::mat4& transform) {
+      /**
+       * Change the transform at this node. Only this subtree has to have its world
+       * transforms updated afterwards
+       * \param similarity true if the transform is known to be rigid or to scale
+       * uniformly, so that its normal matrix needs no inverse
+       */
+      void setTransform(const glm::mat4& transform,bool similarity=false) {
         this->transform = transform;
+        this->normal = normalMatrixOf(transform,similarity);
+        invalidateWorld();
       }
 
     public:
-      TransformNode(const string& name,sgraph::IScenegraph *graph)
+      TransformNode(Symbol name,sgraph::IScenegraph *graph)
         :ParentSGNode(name,graph) {
         this->transform = glm::mat4(1.0);
+        this->world = glm::mat4(1.0);
+        this->normal = glm::mat3(1.0);
+        this->worldNormal = glm::mat3(1.0);
+      }
+
+      /**
+       * Work out the matrix that transforms normals as a matrix transforms points: the
+       * inverse transpose of its upper 3x3. A rotation scaled by s is its own inverse
+       * transpose divided by s squared, so for one of those the inverse is skipped.
+       * \param similarity true if the matrix is known to be rigid or to scale uniformly
+       */
+      static glm::mat3 normalMatrixOf(const glm::mat4& matrix,bool similarity) {
+        glm::mat3 linear(matrix);
+        if (!similarity) {
+          return glm::transpose(glm::inverse(linear));
+        }
+        float scaleSquared = glm::dot(linear[0],linear[0]);
+        return (scaleSquared>0) ? linear * (1.0f/scaleSquared) : linear;
       }
     
     ~TransformNode()	{
@@ -60,6 +96,54 @@ namespace sgraph
       return transform;
     }
 
+    /**
+     * Gets the product of the transforms from the root down to and including this one,
+     * as of the last update. It is only meaningful when isWorldCurrent() is true and the
+     * node is not inside a template shared by instance nodes, and only on the way down
+     * through the last parent of any node above it that has several.
+     */
+    const glm::mat4& getWorldTransform() {
+      return world;
+    }
+
+    /**
+     * Gets the matrix that transforms normals as the transform at this node transforms
+     * points
+     */
+    const glm::mat3& getNormalMatrix() {
+      return normal;
+    }
+
+    /**
+     * Gets the matrix that transforms normals as the world transform does, cached with it
+     * and meaningful only where the world transform is
+     */
+    const glm::mat3& getWorldNormalMatrix() {
+      return worldNormal;
+    }
+
+    /**
+     * Recompute the world transform if this node or one above it moved, then update
+     * the subtree below it. The inverse transpose of a product is the product of the
+     * inverse transposes, so the world normal matrix needs no inverse either.
+     */
+    void updateWorldTransforms(const glm::mat4 &parentWorld,const glm::mat3 &parentNormal,bool parentMoved,const MeshBounds &meshBounds) {
+      bool moved = parentMoved || worldMoved;
+      if (!moved && !movedBelow) {
+        return;
+      }
+      if (moved) {
+        world = parentWorld * transform;
+        worldNormal = parentNormal * normal;
+      }
+      worldMoved = movedBelow = false;
+      updateChildren(world,worldNormal,moved,meshBounds);
+    }
+
+    void addBounds(const glm::mat4 &frame,const MeshBounds &meshBounds,BoundingBox &bounds) {
+      ParentSGNode::addBounds(frame * transform,meshBounds,bounds);
+    }
+
     
     /**
      * Sets the scene graph object of which this node is a part, and then recurses to its child
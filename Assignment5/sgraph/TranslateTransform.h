@@ -19,13 +19,13 @@ namespace sgraph {
         }
 
         public:
-            TranslateTransform(float tx,float ty,float tz,const string& name,sgraph::IScenegraph *graph) 
+            TranslateTransform(float tx,float ty,float tz,Symbol name,sgraph::IScenegraph *graph) 
                 :TransformNode(name,graph) {
                     this->tx = tx;
                     this->ty = ty;
                     this->tz = tz;
                     glm::mat4 transform = glm::translate(glm::mat4(1.0),glm::vec3(tx,ty,tz));
-                    setTransform(transform);
+                    setTransform(transform,true);
             }
 
             
@@ -41,6 +41,16 @@ namespace sgraph {
             return glm::vec3(tx,ty,tz);
         }
 
+            /**
+             * Change the translation, which moves this subtree
+             */
+            void setTranslate(float tx,float ty,float tz) {
+                this->tx = tx;
+                this->ty = ty;
+                this->tz = tz;
+                setTransform(glm::translate(glm::mat4(1.0),glm::vec3(tx,ty,tz)),true);
+            }
+
     };
 }
 
@@ -1,28 +1,46 @@
-#version 330
-
-in vec4 vPosition;
-in vec4 vNormal;
-in vec4 vTexCoord;
-
-uniform mat4 projection;
-uniform mat4 modelview;
-uniform mat4 normalmatrix;
-uniform mat4 texturematrix;
-
-out vec3 fNormal;
-out vec4 fPosition;
-out vec4 fTexCoord;
-
-void main()
-{
-    // Transform vertex position to view space
-    fPosition = modelview * vPosition;
-    gl_Position = projection * fPosition;
-
-    // Transform normal to view space
-    vec4 tNormal = normalmatrix * vNormal;
-    fNormal = normalize(tNormal.xyz);
-
-    // Pass texture coordinates
-    fTexCoord = texturematrix * vTexCoord;
+#version 330
+
+in vec4 vPosition;
+in vec4 vNormal;
+in vec4 vTexCoord;
+
+/* per instance, when drawn instanced */
+in mat4 instanceModelview;
+in mat3 instanceNormalMatrix;
+in vec4 instanceTextureTransform;
+in float instanceMaterial;
+
+uniform mat4 projection;
+uniform mat4 modelview;
+uniform mat3 normalmatrix;
+uniform mat4 texturematrix;
+uniform bool instanced;
+
+out vec3 fNormal;
+out vec4 fPosition;
+out vec4 fTexCoord;
+flat out int fMaterial;
+
+void main()
+{
+    if (instanced)
+    {
+        fPosition = instanceModelview * vPosition;
+        fNormal = normalize(instanceNormalMatrix * vNormal.xyz);
+        fTexCoord = vec4(vTexCoord.xy * instanceTextureTransform.xy + instanceTextureTransform.zw * vTexCoord.w, vTexCoord.zw);
+        fMaterial = int(instanceMaterial);
+    }
+    else
+    {
+        // Transform vertex position to view space
+        fPosition = modelview * vPosition;
+
+        // Transform normal to view space
+        fNormal = normalize(normalmatrix * vNormal.xyz);
+
+        // Pass texture coordinates
+        fTexCoord = texturematrix * vTexCoord;
+        fMaterial = 0;
+    }
+    gl_Position = projection * fPosition;
 }
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include <glad/glad.h>
+#include <string>
+using namespace std;
+#include "../PPMImageLoader.h"
+#include "PPMWriter.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+/**
+ * Rewrite PPM images as binary P6 with 8-bit channels, in place. Files that are
+ * already in that form are left alone.
+ *
+ *   PPMConvert <ppm file...>
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cout << "usage: PPMConvert <ppm file...>" << endl;
+        return 1;
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        string path = argv[i];
+        try {
+            ourutils::MappedFile file;
+            if (!file.open(path))
+                throw std::invalid_argument("File not found!");
+            string header(file.data(), file.size() < 64 ? file.size() : 64);
+            istringstream fields(header);
+            string magic;
+            int width, height, maxval;
+            fields >> magic >> width >> height >> maxval;
+            file.close();
+            if ((magic == "P6") && (maxval == 255)) {
+                cout << path << ": already P6" << endl;
+                continue;
+            }
+
+            PPMImageLoader loader;
+            loader.load(path);
+            string converted = path + ".p6";
+            if (!writePPM(converted, loader.getPixels(), loader.getWidth(), loader.getHeight(), true) ||
+                (rename(converted.c_str(), path.c_str()) != 0)) {
+                remove(converted.c_str());
+                throw std::runtime_error("Could not write " + path);
+            }
+            delete[] loader.getPixels();
+            cout << path << ": converted to P6" << endl;
+        } catch (exception& e) {
+            cout << path << ": " << e.what() << endl;
+            failed++;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+#ifndef _PPMWRITER_H_
+#define _PPMWRITER_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+/**
+ * Write RGB pixels, stored bottom row first as PPMImageLoader returns them, to a
+ * PPM file. The file is written top row first, as the format requires.
+ *
+ * \param binary write P6 if true, P3 otherwise
+ * \param maxval 255 for 8-bit channels; a larger value writes 16-bit channels
+ * (in P6) scaled up from the 8-bit pixels
+ * \return true if the whole file was written
+ */
+inline bool writePPM(const string& path, const unsigned char* pixels, int width, int height, bool binary,
+                     int maxval = 255) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == NULL)
+        return false;
+    fprintf(out, "%s\n%d %d\n%d\n", binary ? "P6" : "P3", width, height, maxval);
+    size_t rowBytes = 3 * (size_t)width;
+    vector<unsigned char> row;
+    bool ok = true;
+    for (int i = height - 1; (i >= 0) && ok; i--) {
+        const unsigned char* in = pixels + i * rowBytes;
+        if (!binary) {
+            for (size_t k = 0; k < rowBytes; k++)
+                fprintf(out, (k + 1 < rowBytes) ? "%d " : "%d\n", (in[k] * maxval + 127) / 255);
+        } else if (maxval == 255) {
+            ok = fwrite(in, 1, rowBytes, out) == rowBytes;
+        } else {
+            row.resize(2 * rowBytes);
+            for (size_t k = 0; k < rowBytes; k++) {
+                int v = (in[k] * maxval + 127) / 255;
+                row[2 * k] = (unsigned char)(v >> 8);
+                row[2 * k + 1] = (unsigned char)(v & 0xff);
+            }
+            ok = fwrite(row.data(), 1, row.size(), out) == row.size();
+        }
+    }
+    return (fclose(out) == 0) && ok;
+}
+
+#endif
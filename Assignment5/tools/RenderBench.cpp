@@ -0,0 +1,255 @@
+#include <glad/glad.h>
+#ifndef GLFW_INCLUDE_NONE
+#define GLFW_INCLUDE_NONE
+#endif
+#include <GLFW/glfw3.h>
+#include "../sgraph/ScenegraphImporter.h"
+#include "../sgraph/GLScenegraphRenderer.h"
+#include "../VertexAttrib.h"
+#include "../HeadlessContext.h"
+#include "SceneGenerator.h"
+#include <ShaderProgram.h>
+#include <ShaderLocationsVault.h>
+#include <ObjectInstance.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+/**
+ * Measures how fast the GL renderer draws leaves. For each light count, a
+ * generated scene is parsed and drawn repeatedly into a small hidden window,
+ * and the draws per second are reported twice: for submitting the frame alone,
+ * which is the CPU cost of the traversal, and with glFinish, which includes the
+ * GPU, with the GL draw calls and the nodes culled per frame. The queue
+ * benchmark compares drawing every leaf of a scene, drawing only those whose
+ * subtrees are not culled in scene order, sorted by the render queue, and sorted
+ * with leaves that share a mesh and a texture drawn instanced; the draw call
+ * counts show the instancing at work on any driver, llvmpipe included. Without
+ * a display to open the window on, it draws into a headless EGL context instead.
+ * Run from the Assignment5 folder so that the shaders and models resolve.
+ *
+ *   RenderBench [nodes] [light count...]
+ *   RenderBench queue [command file]
+ */
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static GLFWwindow* createHiddenWindow() {
+    if (!glfwInit())
+        return NULL;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(256, 256, "RenderBench", NULL, NULL);
+    if (window == NULL) {
+        glfwTerminate();
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    glfwSwapInterval(0);
+    return window;
+}
+
+/**
+ * Make an object instance for each mesh of a scene, as the View does
+ */
+static map<string, util::ObjectInstance*> createObjects(sgraph::IScenegraph* scenegraph,
+                                                        util::ShaderLocationsVault& shaderLocations) {
+    map<string, util::PolygonMesh<VertexAttrib> > meshes = scenegraph->getMeshes();
+    map<string, util::ObjectInstance*> objects;
+    map<string, string> shaderVarsToVertexAttribs;
+    shaderVarsToVertexAttribs["vPosition"] = "position";
+    shaderVarsToVertexAttribs["vNormal"] = "normal";
+    shaderVarsToVertexAttribs["vTexCoord"] = "texcoord";
+    for (map<string, util::PolygonMesh<VertexAttrib> >::iterator it = meshes.begin(); it != meshes.end(); it++) {
+        util::ObjectInstance* object = new util::ObjectInstance(it->first);
+        object->initPolygonMesh(shaderLocations, shaderVarsToVertexAttribs, it->second);
+        objects[it->first] = object;
+    }
+    return objects;
+}
+
+static void deleteObjects(map<string, util::ObjectInstance*>& objects) {
+    for (map<string, util::ObjectInstance*>::iterator it = objects.begin(); it != objects.end(); it++) {
+        it->second->cleanup();
+        delete it->second;
+    }
+    objects.clear();
+}
+
+/**
+ * The time taken to draw a scene repeatedly for about a second
+ */
+struct FrameTimes {
+    int frames;
+    // the time to walk the scene and submit its draws
+    double submitSeconds;
+    // the time including glFinish
+    double seconds;
+};
+
+static FrameTimes drawFrames(sgraph::GLScenegraphRenderer& renderer, sgraph::IScenegraph* scenegraph,
+                             stack<glm::mat4>& modelview) {
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 300, 500), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    FrameTimes times;
+    times.frames = 0;
+    times.submitSeconds = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    do {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        chrono::steady_clock::time_point submit = chrono::steady_clock::now();
+        modelview.push(view);
+        scenegraph->updateWorldTransforms();
+        renderer.setLights(scenegraph->getAllLightsInViewSpace(view));
+        scenegraph->getRoot()->accept(&renderer);
+        renderer.flush();
+        modelview.pop();
+        times.submitSeconds += secondsSince(submit);
+        glFinish();
+        times.frames++;
+    } while (secondsSince(start) < 1.0);
+    times.seconds = secondsSince(start);
+    return times;
+}
+
+/**
+ * Draw a generated scene with the given number of lights and print one row of
+ * the table
+ */
+static void measureLights(long long nodes, int lights, util::ShaderLocationsVault& shaderLocations,
+                          const glm::mat4& projection) {
+    SceneGeneratorOptions options;
+    options.nodes = nodes;
+    options.lights = lights;
+    string path = "bench-render-commands.txt";
+    {
+        ofstream out(path);
+        SceneGenerator(options).write(out);
+    }
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(path);
+    remove(path.c_str());
+    map<string, util::ObjectInstance*> objects = createObjects(scenegraph, shaderLocations);
+
+    map<string, sgraph::PixelHandle> images;
+    stack<glm::mat4> modelview;
+    streambuf* console = cout.rdbuf();
+    ostringstream discard;
+    cout.rdbuf(discard.rdbuf());
+    sgraph::GLScenegraphRenderer renderer(modelview, objects, images, shaderLocations);
+    cout.rdbuf(console);
+    map<string, util::PolygonMesh<VertexAttrib> > meshes = scenegraph->getMeshes();
+    renderer.setMeshes(meshes, set<string>());
+    renderer.setProjection(projection);
+
+    FrameTimes times = drawFrames(renderer, scenegraph, modelview);
+    long long draws = renderer.getStats().draws;
+    printf("%6d %10lld %8d %12lld %8lld %16.0f %16.0f\n", lights, draws / times.frames, times.frames,
+           renderer.getStats().drawCalls / times.frames, renderer.getStats().culled / times.frames,
+           draws / times.submitSeconds, draws / times.seconds);
+
+    deleteObjects(objects);
+    delete scenegraph;
+}
+
+/**
+ * Draw a scene without culling, then culled with its leaves in scene order and
+ * sorted by the render queue, and print the draws, the state changes, the nodes
+ * culled and the submit time per frame for each
+ */
+static void measureQueue(const string& path, util::ShaderLocationsVault& shaderLocations,
+                         const glm::mat4& projection) {
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(path);
+    map<string, util::ObjectInstance*> objects = createObjects(scenegraph, shaderLocations);
+    map<string, sgraph::PixelHandle> images = scenegraph->getImagePixels();
+    stack<glm::mat4> modelview;
+    streambuf* console = cout.rdbuf();
+    ostringstream discard;
+    cout.rdbuf(discard.rdbuf());
+    sgraph::GLScenegraphRenderer renderer(modelview, objects, images, shaderLocations);
+    cout.rdbuf(console);
+    map<string, util::PolygonMesh<VertexAttrib> > meshes = scenegraph->getMeshes();
+    renderer.setMeshes(meshes, set<string>());
+    renderer.setProjection(projection);
+
+    printf("%-10s %8s %10s %14s %12s %16s %8s %12s\n", "order", "draws", "draw calls", "texture binds",
+           "mesh changes", "material changes", "culled", "submit us");
+    const char* orders[] = {"unculled", "scene", "sorted", "instanced"};
+    for (int o = 0; o < 4; o++) {
+        renderer.setCulling(o > 0);
+        renderer.setQueued(o > 1);
+        renderer.setInstancing(o == 3);
+        renderer.resetStats();
+        FrameTimes times = drawFrames(renderer, scenegraph, modelview);
+        const sgraph::GLScenegraphRenderer::RenderStats& stats = renderer.getStats();
+        printf("%-10s %8.1f %10.1f %14.1f %12.1f %16.1f %8.1f %12.1f\n", orders[o], (double)stats.draws / times.frames,
+               (double)stats.drawCalls / times.frames, (double)stats.textureBinds / times.frames,
+               (double)stats.meshChanges / times.frames, (double)stats.materialChanges / times.frames,
+               (double)stats.culled / times.frames, 1e6 * times.submitSeconds / times.frames);
+    }
+
+    deleteObjects(objects);
+    delete scenegraph;
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+    bool queue = !args.empty() && (args[0] == "queue");
+    long long nodes = (!args.empty() && !queue) ? atoll(args[0].c_str()) : 20000;
+    vector<int> lightCounts;
+    for (size_t i = 1; (i < args.size()) && !queue; i++)
+        lightCounts.push_back(atoi(args[i].c_str()));
+    if (lightCounts.empty()) {
+        lightCounts.push_back(1);
+        lightCounts.push_back(10);
+        lightCounts.push_back(64);
+    }
+
+    GLFWwindow* window = createHiddenWindow();
+    HeadlessContext headless;
+    string error;
+    if ((window == NULL) && !headless.create(256, 256, error)) {
+        cout << "Could not create an OpenGL 3.3 context: " << error << endl;
+        return 1;
+    }
+    util::ShaderProgram program;
+    program.createProgram(string("shaders/phong-multiple.vert"), string("shaders/phong-multiple.frag"));
+    program.enable();
+    util::ShaderLocationsVault shaderLocations = program.getAllShaderVariables();
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 10000.0f);
+    glUniformMatrix4fv(shaderLocations.getLocation("projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    if (queue) {
+        measureQueue(args.size() > 1 ? args[1] : "scenegraphmodels/courtyard-scene-commands.txt", shaderLocations,
+                     projection);
+    } else {
+        printf("%6s %10s %8s %12s %8s %16s %16s\n", "lights", "leaves", "frames", "draw calls", "culled",
+               "submit draws/s", "draws/s");
+        for (size_t i = 0; i < lightCounts.size(); i++)
+            measureLights(nodes, lightCounts[i], shaderLocations, projection);
+    }
+
+    program.disable();
+    if (window != NULL) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    return 0;
+}
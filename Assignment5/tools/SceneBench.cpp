@@ -0,0 +1,1440 @@
+#include <glad/glad.h>
+#include "../sgraph/ScenegraphImporter.h"
+#include "../sgraph/BinaryScenegraphExporter.h"
+#include "../sgraph/BinaryScenegraphImporter.h"
+#include "../sgraph/SGNodeVisitor.h"
+#include "../sgraph/TextureAtlas.h"
+#include "PPMWriter.h"
+#include "SceneGenerator.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stack>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+using namespace std;
+
+/**
+ * Benchmarks for the scene graph loading path. Run from the Assignment5 folder
+ * so that the relative paths inside the command files resolve.
+ *
+ *   SceneBench parse [command file] [scale]
+ *   SceneBench binary [command file...]
+ *   SceneBench memory [blocks]
+ *   SceneBench imports [command file]
+ *   SceneBench names [command file...]
+ *   SceneBench scaling [max nodes]
+ *   SceneBench transforms [nodes] [moved]
+ *   SceneBench normals [leaves]
+ *   SceneBench shared
+ *   SceneBench images [ppm file | synthetic:size ...]
+ *   SceneBench textures [command file]
+ *   SceneBench png [image path without extension...]
+ *   SceneBench pixels [leaves]
+ *   SceneBench mips [image file | synthetic:size ...]
+ *   SceneBench atlas [command file]
+ */
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const string& label, size_t bytes, double seconds) {
+    printf("%-32s %10.3f s %10.1f MB/s\n", label.c_str(), seconds, (bytes / (1024.0 * 1024.0)) / seconds);
+}
+
+/**
+ * Write the command file repeated scale times. Asset declarations and imports
+ * are dropped so that only command parsing is measured.
+ */
+static size_t writeScaledFile(const string& source, int scale, const string& target) {
+    ifstream in(source);
+    if (!in.is_open())
+        throw runtime_error("Could not open " + source);
+    stringstream commands;
+    string line;
+    while (getline(in, line)) {
+        string command;
+        istringstream(line) >> command;
+        if ((command != "instance") && (command != "image") && (command != "import"))
+            commands << line << "\n";
+    }
+    string text = commands.str();
+    ofstream out(target, ios::binary);
+    for (int i = 0; i < scale; i++)
+        out << text;
+    return text.size() * scale;
+}
+
+/**
+ * The tokenizing scheme the importer used before it was memory-mapped: strip the
+ * comments into a stringstream, then re-read it with operator>>.
+ */
+static size_t tokenizeWithStreams(const string& path) {
+    ifstream input(path);
+    string line;
+    stringstream clean;
+    while (getline(input, line)) {
+        size_t i = 0;
+        while ((i < line.length()) && (line[i] != '#')) {
+            clean << line[i];
+            i++;
+        }
+        clean << endl;
+    }
+    istringstream tokens(clean.str());
+    string token;
+    size_t count = 0;
+    while (tokens >> token)
+        count++;
+    return count;
+}
+
+static size_t tokenizeMapped(const string& path) {
+    ourutils::MappedFile file;
+    file.open(path);
+    sgraph::CommandTokenizer tokens(file.data(), file.end());
+    const char* token;
+    size_t length;
+    size_t count = 0;
+    while (tokens.next(token, length))
+        count++;
+    return count;
+}
+
+static void benchParse(const string& source, int scale) {
+    string scaled = "bench-scaled-commands.txt";
+    size_t bytes = writeScaledFile(source, scale, scaled);
+    printf("%s x%d = %.1f MB\n", source.c_str(), scale, bytes / (1024.0 * 1024.0));
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t streamTokens = tokenizeWithStreams(scaled);
+    report("tokenize: strip + istringstream", bytes, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    size_t mappedTokens = tokenizeMapped(scaled);
+    report("tokenize: mapped", bytes, secondsSince(start));
+    if (streamTokens != mappedTokens)
+        printf("warning: token counts differ (%zu vs %zu)\n", streamTokens, mappedTokens);
+
+    {
+        start = chrono::steady_clock::now();
+        ifstream in(scaled);
+        sgraph::ScenegraphImporter importer;
+        importer.setVerbose(false);
+        delete importer.parse(in);
+        report("parse: istream", bytes, secondsSince(start));
+    }
+    {
+        start = chrono::steady_clock::now();
+        sgraph::ScenegraphImporter importer;
+        importer.setVerbose(false);
+        delete importer.parseFile(scaled);
+        report("parse: mapped file", bytes, secondsSince(start));
+    }
+    remove(scaled.c_str());
+}
+
+/**
+ * Compare the time to build each scene from its command file and from its
+ * compiled form. Both include decoding the meshes and images the scene uses.
+ *
+ * The scene graphs are not deleted: the humanoid models add g-torso to two
+ * parents, so deleting them would free it twice.
+ */
+static void benchBinary(const vector<string>& sources, int repeats) {
+    for (size_t i = 0; i < sources.size(); i++) {
+        string compiled = "bench-compiled.sgb";
+        {
+            sgraph::ScenegraphImporter importer;
+            importer.setVerbose(false);
+            sgraph::IScenegraph* scenegraph = importer.parseFile(sources[i]);
+            map<string, string> meshPaths = scenegraph->getMeshPaths();
+            map<string, string> imagePaths = scenegraph->getImagePaths();
+            sgraph::BinaryScenegraphExporter exporter(meshPaths, imagePaths);
+            scenegraph->getRoot()->accept(&exporter);
+            string output = exporter.getOutput();
+            ofstream out(compiled, ios::binary);
+            out.write(output.data(), output.size());
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            sgraph::ScenegraphImporter importer;
+            importer.setVerbose(false);
+            importer.parseFile(sources[i]);
+        }
+        double text = secondsSince(start) / repeats;
+
+        start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            sgraph::BinaryScenegraphImporter importer;
+            importer.parseFile(compiled);
+        }
+        double binary = secondsSince(start) / repeats;
+
+        printf("%-48s text %8.2f ms   binary %8.2f ms\n", sources[i].c_str(), text * 1000, binary * 1000);
+        remove(compiled.c_str());
+    }
+}
+
+/**
+ * Write a generated city: one block per translate, each with its own leaf and a
+ * copy of a shared tree subtree. Every name is used for the last time within a
+ * few commands of its definition, except the city group itself.
+ */
+static void writeCity(const string& target, int blocks) {
+    ofstream out(target);
+    out << "instance box models/box.obj\n";
+    out << "material grey\nambient 0.5 0.5 0.5\ndiffuse 0.5 0.5 0.5\nend-material\n";
+    out << "group city city\n";
+    out << "group tree-template tree\n";
+    out << "leaf trunk trunk instanceof box\n";
+    out << "scale s-trunk s-trunk 1 5 1\n";
+    out << "add-child trunk s-trunk\nadd-child s-trunk tree-template\n";
+    for (int i = 0; i < blocks; i++) {
+        out << "# block " << i << "\n";
+        out << "leaf house-" << i << " house-" << i << " instanceof box\n";
+        out << "assign-material house-" << i << " grey\n";
+        out << "group block-" << i << " block-" << i << "\n";
+        out << "copy tree-" << i << " tree-template\n";
+        out << "add-child house-" << i << " block-" << i << "\n";
+        out << "add-child tree-" << i << " block-" << i << "\n";
+        out << "translate t-block-" << i << " t-block-" << i << " " << (i % 1000) * 20 << " 0 " << (i / 1000) * 20 << "\n";
+        out << "add-child block-" << i << " t-block-" << i << "\n";
+        out << "add-child t-block-" << i << " city\n";
+    }
+    out << "assign-root city\n";
+}
+
+static double peakMegabytes() {
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Parse one file in one way and report the high-water mark of this process. Each
+ * way runs in its own process so that the marks do not include each other.
+ */
+static void measurePeak(const string& mode, const string& path) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph;
+    if (mode == "stream") {
+        scenegraph = importer.parseFileStreaming(path);
+    } else if (mode == "istream") {
+        ifstream in(path);
+        scenegraph = importer.parse(in);
+    } else {
+        scenegraph = importer.parseFile(path);
+    }
+    double seconds = secondsSince(start);
+    printf("%-10s %8zu nodes %10.3f s   peak %8.1f MB\n", mode.c_str(), scenegraph->getNodes().size(), seconds,
+           peakMegabytes());
+}
+
+static void benchMemory(const string& self, int blocks) {
+    string city = "bench-city-commands.txt";
+    writeCity(city, blocks);
+    ifstream in(city, ios::binary | ios::ate);
+    printf("%d blocks, %.1f MB of commands\n", blocks, in.tellg() / (1024.0 * 1024.0));
+    fflush(stdout);
+    const char* modes[] = {"mapped", "istream", "stream"};
+    for (int i = 0; i < 3; i++) {
+        string command = "\"" + self + "\" peak " + modes[i] + " " + city;
+        if (system(command.c_str()) != 0)
+            printf("%s failed\n", modes[i]);
+    }
+    remove(city.c_str());
+}
+
+/**
+ * Parse scenes that import the same file more and more times. Each count runs in
+ * its own process, so the peaks are comparable.
+ */
+static void benchImports(const string& self, const string& imported) {
+    string scene = "bench-import-commands.txt";
+    int counts[] = {1, 10, 100, 1000};
+    for (int c = 0; c < 4; c++) {
+        {
+            ofstream out(scene);
+            out << "group scene scene\n";
+            for (int i = 0; i < counts[c]; i++) {
+                out << "import model-" << i << " " << imported << "\n";
+                out << "translate t-" << i << " t-" << i << " " << (i % 32) * 50 << " 0 " << (i / 32) * 50 << "\n";
+                out << "add-child model-" << i << " t-" << i << "\n";
+                out << "add-child t-" << i << " scene\n";
+            }
+            out << "assign-root scene\n";
+        }
+        printf("%5d imports: ", counts[c]);
+        fflush(stdout);
+        string command = "\"" + self + "\" peak mapped " + scene;
+        if (system(command.c_str()) != 0)
+            printf("failed\n");
+    }
+    remove(scene.c_str());
+}
+
+static void collectNodes(sgraph::SGNode* node, set<sgraph::SGNode*>& found) {
+    if ((node == NULL) || !found.insert(node).second)
+        return;
+    sgraph::ParentSGNode* parent = dynamic_cast<sgraph::ParentSGNode*>(node);
+    if (parent != NULL) {
+        vector<sgraph::SGNode*> children = parent->getChildren();
+        for (size_t i = 0; i < children.size(); i++)
+            collectNodes(children[i], found);
+    }
+}
+
+static size_t stringBytes(const string& text) {
+    return sizeof(string) + sgraph::SymbolTable::heapBytes(text);
+}
+
+/**
+ * Compare the memory taken by names when every node, leaf and scene graph entry
+ * keeps its own string with the memory taken by symbols and the shared table,
+ * and time the per-draw lookup of object instances both ways. The scene graphs
+ * are not deleted, for the reason given for the binary benchmark.
+ */
+static void benchNames(const vector<string>& sources) {
+    size_t before = sgraph::SymbolTable::shared().memoryUsed();
+    size_t stringTotal = 0;
+    size_t symbolTotal = 0;
+    vector<string> instanceNames;
+    for (size_t s = 0; s < sources.size(); s++) {
+        sgraph::ScenegraphImporter importer;
+        importer.setVerbose(false);
+        sgraph::IScenegraph* scenegraph = importer.parseFile(sources[s]);
+        set<sgraph::SGNode*> nodes;
+        collectNodes(scenegraph->getRoot(), nodes);
+
+        size_t strings = 0;
+        size_t symbols = 0;
+        for (set<sgraph::SGNode*>::iterator it = nodes.begin(); it != nodes.end(); it++) {
+            strings += stringBytes((*it)->getName());
+            symbols += sizeof(sgraph::Symbol);
+            sgraph::LeafNode* leaf = dynamic_cast<sgraph::LeafNode*>(*it);
+            if (leaf != NULL) {
+                strings += stringBytes(leaf->getInstanceOf());
+                symbols += 2 * sizeof(sgraph::Symbol);
+                instanceNames.push_back(leaf->getInstanceOf());
+            }
+        }
+        // the keys of the scene graph's own table of nodes
+        map<string, sgraph::SGNode*> named = scenegraph->getNodes();
+        for (map<string, sgraph::SGNode*>::iterator it = named.begin(); it != named.end(); it++) {
+            strings += stringBytes(it->first);
+            symbols += sizeof(sgraph::Symbol);
+        }
+        printf("%-48s %4zu nodes  strings %7zu B  symbols %6zu B\n", sources[s].c_str(), nodes.size(), strings,
+               symbols);
+        stringTotal += strings;
+        symbolTotal += symbols;
+    }
+    size_t table = sgraph::SymbolTable::shared().memoryUsed() - before;
+    printf("%-48s %4s        strings %7zu B  symbols %6zu B + table %zu B = %zu B (%.0f%% saved)\n", "total", "",
+           stringTotal, symbolTotal, table, symbolTotal + table,
+           100.0 * (1.0 - (double)(symbolTotal + table) / stringTotal));
+
+    if (instanceNames.empty())
+        return;
+    map<string, int> byString;
+    unordered_map<sgraph::Symbol, int> bySymbol;
+    vector<sgraph::Symbol> instanceSymbols;
+    for (size_t i = 0; i < instanceNames.size(); i++) {
+        byString[instanceNames[i]] = (int)i;
+        bySymbol[sgraph::Symbol(instanceNames[i])] = (int)i;
+        instanceSymbols.push_back(sgraph::Symbol(instanceNames[i]));
+    }
+    const int draws = 2000000;
+    long long sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < draws; i++)
+        sum += byString[instanceNames[i % instanceNames.size()]];
+    double stringSeconds = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < draws; i++)
+        sum += bySymbol.find(instanceSymbols[i % instanceSymbols.size()])->second;
+    double symbolSeconds = secondsSince(start);
+    printf("%d instance lookups: by string %.1f ns, by symbol %.1f ns (%lld)\n", draws, 1e9 * stringSeconds / draws,
+           1e9 * symbolSeconds / draws, sum);
+}
+
+/**
+ * Walks a scene graph the way the GL renderer does, multiplying transforms on a
+ * stack, without drawing anything
+ */
+class TraversalVisitor : public sgraph::SGNodeVisitor {
+  public:
+    TraversalVisitor() : leaves(0), checksum(0) { modelview.push(glm::mat4(1.0f)); }
+
+    void visitGroupNode(sgraph::GroupNode* node) {
+        vector<sgraph::SGNode*> children = node->getChildren();
+        for (size_t i = 0; i < children.size(); i++)
+            children[i]->accept(this);
+    }
+
+    void visitLeafNode(sgraph::LeafNode* node) {
+        leaves++;
+        checksum += modelview.top()[3][0];
+    }
+
+    void visitTransformNode(sgraph::TransformNode* node) {
+        modelview.push(modelview.top() * node->getTransform());
+        vector<sgraph::SGNode*> children = node->getChildren();
+        if (!children.empty())
+            children[0]->accept(this);
+        modelview.pop();
+    }
+
+    void visitScaleTransform(sgraph::ScaleTransform* node) { visitTransformNode(node); }
+
+    void visitTranslateTransform(sgraph::TranslateTransform* node) { visitTransformNode(node); }
+
+    void visitRotateTransform(sgraph::RotateTransform* node) { visitTransformNode(node); }
+
+    void visitInstanceNode(sgraph::InstanceNode* node) { visitTransformNode(node); }
+
+    long long leaves;
+    double checksum;
+
+  private:
+    stack<glm::mat4> modelview;
+};
+
+/**
+ * Parse a generated scene and time a traversal and a light collection over it,
+ * repeated so that each takes a measurable time. Reports one row of the scaling
+ * table, with the high-water mark of this process.
+ */
+static void measureScaling(const string& path, long long nodes) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(path);
+    double importSeconds = secondsSince(start);
+
+    int repeats = (int)max(1LL, 1000000LL / nodes);
+    long long leaves = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        TraversalVisitor traversal;
+        scenegraph->getRoot()->accept(&traversal);
+        leaves = traversal.leaves;
+    }
+    double traversalSeconds = secondsSince(start) / repeats;
+
+    size_t lights = 0;
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 100, 300), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+        lights = scenegraph->getAllLightsInViewSpace(view).size();
+    double lightSeconds = secondsSince(start) / repeats;
+
+    printf("%10lld %10lld %6zu %10.3f %10.1f %12.3f %12.3f\n", nodes, leaves, lights, importSeconds, peakMegabytes(),
+           1000 * traversalSeconds, 1000 * lightSeconds);
+}
+
+/**
+ * Generate scenes of 1k to max nodes, ten times larger each time, and measure
+ * each one in its own process
+ */
+static void benchScaling(const string& self, long long maxNodes) {
+    string scene = "bench-scaling-commands.txt";
+    printf("%10s %10s %6s %10s %10s %12s %12s\n", "nodes", "leaves", "lights", "import s", "peak MB",
+           "traverse ms", "lights ms");
+    fflush(stdout);
+    for (long long nodes = 1000; nodes <= maxNodes; nodes *= 10) {
+        SceneGeneratorOptions options;
+        options.nodes = nodes;
+        options.depth = 5;
+        options.fanout = 4;
+        options.instancing = 0.5;
+        options.lights = 8;
+        SceneGenerator generator(options);
+        {
+            ofstream out(scene);
+            generator.write(out);
+        }
+        ostringstream command;
+        command << "\"" << self << "\" scale-one " << scene << " " << generator.getNodeCount();
+        if (system(command.str().c_str()) != 0)
+            printf("%10lld failed\n", nodes);
+        fflush(stdout);
+    }
+    remove(scene.c_str());
+}
+
+/**
+ * Count the transform nodes whose cached world transform differs from the product
+ * of the transforms on the way up to the root
+ */
+static int countStaleWorlds(const vector<sgraph::TransformNode*>& transforms) {
+    int stale = 0;
+    for (size_t i = 0; i < transforms.size(); i++) {
+        glm::mat4 world(1.0f);
+        for (sgraph::SGNode* node = transforms[i]; node != NULL; node = node->getParent()) {
+            sgraph::TransformNode* transform = dynamic_cast<sgraph::TransformNode*>(node);
+            if (transform != NULL)
+                world = transform->getTransform() * world;
+        }
+        const glm::mat4& cached = transforms[i]->getWorldTransform();
+        float largest = 0;
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                largest = max(largest, fabs(world[c][r] - cached[c][r]));
+        if (largest > 1e-3f * (1 + fabs(world[3][0]) + fabs(world[3][1]) + fabs(world[3][2])))
+            stale++;
+    }
+    return stale;
+}
+
+/**
+ * Time the work done per frame on the transforms of a generated scene: a walk
+ * that multiplies every transform on a stack, as drawing did before the world
+ * transforms were cached, then the update of the cached world transforms when
+ * nothing moved, and when a number of translates moved
+ */
+static void benchTransforms(long long nodes, int moved) {
+    SceneGeneratorOptions options;
+    options.nodes = nodes;
+    options.depth = 5;
+    options.fanout = 4;
+    options.lights = 8;
+    string path = "bench-transforms-commands.txt";
+    {
+        ofstream out(path);
+        SceneGenerator(options).write(out);
+    }
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(path);
+    remove(path.c_str());
+
+    vector<sgraph::TransformNode*> transforms;
+    vector<sgraph::TranslateTransform*> translates;
+    map<string, sgraph::SGNode*> named = scenegraph->getNodes();
+    for (map<string, sgraph::SGNode*>::iterator it = named.begin(); it != named.end(); it++) {
+        sgraph::TransformNode* transform = dynamic_cast<sgraph::TransformNode*>(it->second);
+        if (transform != NULL)
+            transforms.push_back(transform);
+        sgraph::TranslateTransform* translate = dynamic_cast<sgraph::TranslateTransform*>(it->second);
+        if (translate != NULL)
+            translates.push_back(translate);
+    }
+    printf("%zu nodes, %zu transforms, %d moved per frame\n", named.size(), transforms.size(), moved);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    TraversalVisitor traversal;
+    scenegraph->getRoot()->accept(&traversal);
+    printf("%-28s %12.3f ms\n", "stack walk", 1000 * secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    scenegraph->updateWorldTransforms();
+    printf("%-28s %12.3f ms\n", "first update", 1000 * secondsSince(start));
+
+    int repeats = 1000;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+        scenegraph->updateWorldTransforms();
+    printf("%-28s %12.3f us\n", "update, nothing moved", 1e6 * secondsSince(start) / repeats);
+
+    repeats = 100;
+    unsigned int seed = 12345;
+    double updateSeconds = 0;
+    for (int r = 0; r < repeats; r++) {
+        for (int m = 0; (m < moved) && !translates.empty(); m++) {
+            seed = seed * 1103515245u + 12345u;
+            sgraph::TranslateTransform* translate = translates[(seed >> 8) % translates.size()];
+            glm::vec3 t = translate->getTranslate();
+            translate->setTranslate(t.x + 1, t.y, t.z);
+        }
+        start = chrono::steady_clock::now();
+        scenegraph->updateWorldTransforms();
+        updateSeconds += secondsSince(start);
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "update, %d moved", moved);
+    printf("%-28s %12.3f us\n", label, 1e6 * updateSeconds / repeats);
+    printf("stale world transforms: %d\n", countStaleWorlds(transforms));
+    delete scenegraph;
+}
+
+/**
+ * Works out the normal matrix of every leaf, as the GL renderer does, either
+ * from the inverse of each leaf's modelview or from the normal matrices cached
+ * with the world transforms
+ */
+class NormalVisitor : public sgraph::SGNodeVisitor {
+  public:
+    NormalVisitor(const glm::mat4& view, bool cached)
+        : view(view), viewNormal(sgraph::TransformNode::normalMatrixOf(view, false)), cached(cached), above(NULL),
+          leaves(0) {}
+
+    void visitGroupNode(sgraph::GroupNode* node) {
+        const vector<sgraph::SGNode*>& children = node->getChildren();
+        for (size_t i = 0; i < children.size(); i++)
+            children[i]->accept(this);
+    }
+
+    void visitLeafNode(sgraph::LeafNode* node) {
+        glm::mat4 world = (above != NULL) ? above->getWorldTransform() : glm::mat4(1.0f);
+        if (cached) {
+            normals.push_back((above != NULL) ? viewNormal * above->getWorldNormalMatrix() : viewNormal);
+        } else {
+            normals.push_back(glm::transpose(glm::inverse(glm::mat3(view * world))));
+        }
+        leaves++;
+    }
+
+    void visitTransformNode(sgraph::TransformNode* node) {
+        sgraph::TransformNode* outer = above;
+        above = node;
+        const vector<sgraph::SGNode*>& children = node->getChildren();
+        if (!children.empty())
+            children[0]->accept(this);
+        above = outer;
+    }
+
+    void visitScaleTransform(sgraph::ScaleTransform* node) { visitTransformNode(node); }
+
+    void visitTranslateTransform(sgraph::TranslateTransform* node) { visitTransformNode(node); }
+
+    void visitRotateTransform(sgraph::RotateTransform* node) { visitTransformNode(node); }
+
+    void visitInstanceNode(sgraph::InstanceNode* node) { visitTransformNode(node); }
+
+    vector<glm::mat3> normals;
+    long long leaves;
+
+  private:
+    glm::mat4 view;
+    glm::mat3 viewNormal;
+    bool cached;
+    sgraph::TransformNode* above;
+};
+
+/**
+ * Time working out the normal matrices of the leaves of a generated scene, with
+ * an inverse per leaf and from the cached normal matrices, and report the time
+ * saved per 10k leaves. The scene is rotated and scaled uniformly at the root,
+ * and a second copy of it non-uniformly, so that both kinds of cached matrix are
+ * checked against the inverse.
+ */
+static void benchNormals(long long leaves) {
+    SceneGeneratorOptions options;
+    // about 5 leaves in 13 nodes at this depth and fanout
+    options.nodes = leaves * 13 / 5;
+    options.depth = 5;
+    options.fanout = 4;
+    string path = "bench-normals-commands.txt";
+    {
+        ofstream out(path);
+        SceneGenerator(options).write(out);
+    }
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(path);
+    remove(path.c_str());
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 100, 300), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    const char* labels[] = {"rigid and uniform", "non-uniform scale"};
+    printf("%-20s %10s %14s %14s %16s %12s\n", "root transform", "leaves", "inverse ns", "cached ns",
+           "saved per 10k us", "max error");
+    for (int kind = 0; kind < 2; kind++) {
+        // put the scene below a rotate and a scale, uniform or not
+        sgraph::SGNode* root = scenegraph->getRoot();
+        sgraph::RotateTransform* rotate =
+            new sgraph::RotateTransform(0.7f, 1, 2, 3, sgraph::Symbol("bench-rotate"), scenegraph);
+        sgraph::ScaleTransform* scale = new sgraph::ScaleTransform(
+            2, kind == 0 ? 2 : 0.5f, kind == 0 ? -2 : 3, sgraph::Symbol("bench-scale"), scenegraph);
+        scale->addChild(root);
+        rotate->addChild(scale);
+        scenegraph->makeScenegraph(rotate);
+        scenegraph->updateWorldTransforms();
+
+        double seconds[2];
+        vector<glm::mat3> results[2];
+        long long counted = 0;
+        for (int cached = 0; cached < 2; cached++) {
+            int repeats = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            do {
+                NormalVisitor visitor(view, cached == 1);
+                visitor.normals.reserve(leaves);
+                rotate->accept(&visitor);
+                counted = visitor.leaves;
+                results[cached].swap(visitor.normals);
+                repeats++;
+            } while (secondsSince(start) < 0.2);
+            seconds[cached] = secondsSince(start) / repeats;
+        }
+
+        // the normals are normalized in the shader, so only the directions must agree
+        float error = 0;
+        glm::vec3 probe = glm::normalize(glm::vec3(1, 2, 3));
+        for (size_t i = 0; i < results[0].size(); i++) {
+            glm::vec3 expected = glm::normalize(results[0][i] * probe);
+            glm::vec3 found = glm::normalize(results[1][i] * probe);
+            for (int c = 0; c < 3; c++)
+                error = max(error, fabs(expected[c] - found[c]));
+        }
+        printf("%-20s %10lld %14.1f %14.1f %16.1f %12.2g\n", labels[kind], counted, 1e9 * seconds[0] / counted,
+               1e9 * seconds[1] / counted, 1e6 * (seconds[0] - seconds[1]) * 10000 / counted, error);
+
+        // take the scene back out, to be put below the next pair
+        scale->releaseChildren();
+        rotate->releaseChildren();
+        delete rotate;
+        delete scale;
+        root->setParent(NULL);
+        scenegraph->makeScenegraph(root);
+    }
+    delete scenegraph;
+}
+
+/**
+ * Finds the world transform and normal matrix of every leaf, either by multiplying
+ * every transform on a stack and inverting at each leaf, as drawing did before the
+ * world transforms were cached, or from the cached world transforms and normal
+ * matrices the way the GL renderer uses them, which is with the stack below a
+ * template or a child that was added to another parent after the one being walked
+ */
+class LeafWorldVisitor : public sgraph::SGNodeVisitor {
+  public:
+    LeafWorldVisitor(bool cached) : cached(cached), above(NULL), uncached(cached ? 0 : 1) {
+        modelview.push(glm::mat4(1.0f));
+        normalStack.push_back(glm::mat3(1.0f));
+    }
+
+    void visitGroupNode(sgraph::GroupNode* node) {
+        const vector<sgraph::SGNode*>& children = node->getChildren();
+        for (size_t i = 0; i < children.size(); i++)
+            visitChild(node, children[i]);
+    }
+
+    void visitLeafNode(sgraph::LeafNode* node) {
+        if (!cached) {
+            worlds.push_back(modelview.top());
+            normals.push_back(glm::transpose(glm::inverse(glm::mat3(modelview.top()))));
+        } else if (uncached > 0) {
+            worlds.push_back(modelview.top());
+            normals.push_back(normalStack.back());
+        } else {
+            worlds.push_back((above != NULL) ? above->getWorldTransform() : glm::mat4(1.0f));
+            normals.push_back((above != NULL) ? above->getWorldNormalMatrix() : glm::mat3(1.0f));
+        }
+    }
+
+    void visitTransformNode(sgraph::TransformNode* node) {
+        const vector<sgraph::SGNode*>& children = node->getChildren();
+        if (children.empty())
+            return;
+        if (uncached == 0) {
+            sgraph::TransformNode* outer = above;
+            above = node;
+            visitChild(node, children[0]);
+            above = outer;
+        } else {
+            push(node->getTransform(), node->getNormalMatrix());
+            children[0]->accept(this);
+            pop();
+        }
+    }
+
+    void visitScaleTransform(sgraph::ScaleTransform* node) { visitTransformNode(node); }
+
+    void visitTranslateTransform(sgraph::TranslateTransform* node) { visitTransformNode(node); }
+
+    void visitRotateTransform(sgraph::RotateTransform* node) { visitTransformNode(node); }
+
+    void visitInstanceNode(sgraph::InstanceNode* node) {
+        push(node->getTransform(), node->getNormalMatrix());
+        const vector<sgraph::SGNode*>& children = node->getChildren();
+        if (!children.empty())
+            children[0]->accept(this);
+        pop();
+    }
+
+    vector<glm::mat4> worlds;
+    vector<glm::mat3> normals;
+
+  private:
+    void visitChild(sgraph::ParentSGNode* parent, sgraph::SGNode* child) {
+        bool shared = (uncached == 0) && parent->isSharedChild(child);
+        if (shared)
+            push(glm::mat4(1.0f), glm::mat3(1.0f));
+        child->accept(this);
+        if (shared)
+            pop();
+    }
+
+    void push(const glm::mat4& transform, const glm::mat3& normal) {
+        if (uncached > 0) {
+            modelview.push(modelview.top() * transform);
+            normalStack.push_back(normalStack.back() * normal);
+        } else {
+            modelview.push(((above != NULL) ? above->getWorldTransform() : glm::mat4(1.0f)) * transform);
+            normalStack.push_back(((above != NULL) ? above->getWorldNormalMatrix() : glm::mat3(1.0f)) * normal);
+        }
+        uncached++;
+    }
+
+    void pop() {
+        modelview.pop();
+        normalStack.pop_back();
+        uncached--;
+    }
+
+    bool cached;
+    sgraph::TransformNode* above;
+    int uncached;
+    stack<glm::mat4> modelview;
+    vector<glm::mat3> normalStack;
+};
+
+static float largestDifference(const glm::mat4& a, const glm::mat4& b) {
+    float largest = 0;
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            largest = max(largest, fabs(a[c][r] - b[c][r]));
+    return largest;
+}
+
+/**
+ * Compare the leaves of a cached walk with those of a stack walk, and the lights
+ * collected from the cached world transforms with the lights at those leaves.
+ * Normals are normalized in the shader, so only the directions of the normal
+ * matrices must agree.
+ * \return the number of leaves or lights that differ
+ */
+static int compareWalks(sgraph::IScenegraph* scenegraph, const glm::vec4& lightPosition) {
+    LeafWorldVisitor stackWalk(false);
+    LeafWorldVisitor cachedWalk(true);
+    scenegraph->getRoot()->accept(&stackWalk);
+    scenegraph->getRoot()->accept(&cachedWalk);
+    vector<util::Light> lights = scenegraph->getAllLightsInViewSpace(glm::mat4(1.0f));
+    int wrong = 0;
+    for (size_t i = 0; i < stackWalk.worlds.size(); i++) {
+        const glm::mat4& expected = stackWalk.worlds[i];
+        if ((i >= cachedWalk.worlds.size()) || (largestDifference(expected, cachedWalk.worlds[i]) > 1e-4f))
+            wrong++;
+        glm::vec3 probe = glm::normalize(glm::vec3(1, 2, 3));
+        if ((i >= cachedWalk.normals.size()) ||
+            (glm::length(glm::normalize(stackWalk.normals[i] * probe) - glm::normalize(cachedWalk.normals[i] * probe)) > 1e-4f))
+            wrong++;
+        if ((i >= lights.size()) || (glm::length(glm::vec3(lights[i].getPosition() - expected * lightPosition)) > 1e-4f))
+            wrong++;
+    }
+    return wrong;
+}
+
+/**
+ * Count the named nodes whose world bounds would let them be culled while part
+ * of what a stack walk draws below them lies outside those bounds. The nodes
+ * must be at the root or just below it, where the stack starts at the identity.
+ */
+static int countUncoveredBounds(sgraph::IScenegraph* scenegraph, const vector<string>& names) {
+    map<string, util::PolygonMesh<VertexAttrib> > meshes = scenegraph->getMeshes();
+    sgraph::BoundingBox box;
+    vector<VertexAttrib> vertices = meshes["box"].getVertexAttributes();
+    for (size_t i = 0; i < vertices.size(); i++) {
+        vector<float> position = vertices[i].getData("position");
+        box.add(glm::vec3(position[0], position[1], position[2]));
+    }
+    map<string, sgraph::SGNode*> named = scenegraph->getNodes();
+    int uncovered = 0;
+    for (size_t n = 0; n < names.size(); n++) {
+        sgraph::SGNode* node = named[names[n]];
+        LeafWorldVisitor stackWalk(false);
+        node->accept(&stackWalk);
+        sgraph::BoundingBox drawn;
+        for (size_t i = 0; i < stackWalk.worlds.size(); i++)
+            drawn.add(box.transformed(stackWalk.worlds[i]));
+        const sgraph::BoundingBox& bounds = node->getWorldBounds();
+        if (bounds.isUnbounded() || drawn.isEmpty())
+            continue;
+        glm::vec3 center = drawn.getCenter() - bounds.getCenter();
+        glm::vec3 excess = drawn.getExtent() - bounds.getExtent();
+        bool covered = true;
+        for (int axis = 0; axis < 3; axis++)
+            covered = covered && (fabs(center[axis]) + excess[axis] <= 1e-3f);
+        if (!covered)
+            uncovered++;
+    }
+    return uncovered;
+}
+
+/**
+ * Check the cached world transforms, normal matrices and bounds against a stack
+ * walk on a scene whose lit subtree is added to two translates, as the humanoid
+ * scenes add a group to two parents, before and after each part of the scene
+ * moves
+ * \return true if every check passed
+ */
+static bool benchShared() {
+    string path = "bench-shared-commands.txt";
+    {
+        ofstream out(path);
+        out << "instance box models/box.obj" << endl
+            << "light lamp" << endl
+            << "ambient 1 1 1" << endl
+            << "position 0 1 0" << endl
+            << "end-light" << endl
+            << "group root root" << endl
+            << "translate left left 10 0 0" << endl
+            << "translate right right -10 0 5" << endl
+            << "scale squash squash 1 2 3" << endl
+            << "rotate turn turn 30 0 1 0" << endl
+            << "leaf lamp-box lamp-box instanceof box" << endl
+            << "assign-light lamp-box lamp" << endl
+            << "add-child lamp-box turn" << endl
+            << "add-child turn squash" << endl
+            << "add-child squash left" << endl
+            << "add-child squash right" << endl
+            << "add-child left root" << endl
+            << "add-child right root" << endl
+            << "assign-root root" << endl;
+    }
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(path);
+    remove(path.c_str());
+    map<string, sgraph::SGNode*> named = scenegraph->getNodes();
+    sgraph::TranslateTransform* left = dynamic_cast<sgraph::TranslateTransform*>(named["left"]);
+    sgraph::ScaleTransform* squash = dynamic_cast<sgraph::ScaleTransform*>(named["squash"]);
+    sgraph::RotateTransform* turn = dynamic_cast<sgraph::RotateTransform*>(named["turn"]);
+    if ((left == NULL) || (squash == NULL) || (turn == NULL)) {
+        printf("the shared scene could not be built\n");
+        delete scenegraph;
+        return false;
+    }
+
+    vector<string> bounded;
+    bounded.push_back("root");
+    bounded.push_back("left");
+    bounded.push_back("right");
+    const char* steps[] = {"first update", "moved a parent", "moved the shared subtree", "moved inside it"};
+    glm::vec4 lightPosition(0, 1, 0, 1);
+    bool passed = true;
+    for (int step = 0; step < 4; step++) {
+        if (step == 1)
+            left->setTranslate(20, 5, 0);
+        else if (step == 2)
+            squash->setScale(2, 1, 0.5f);
+        else if (step == 3)
+            turn->setRotation(glm::radians(75.0f), 1, 0, 0);
+        scenegraph->updateWorldTransforms();
+        int wrong = compareWalks(scenegraph, lightPosition) + countUncoveredBounds(scenegraph, bounded);
+        printf("%-28s %s\n", steps[step], wrong == 0 ? "ok" : "cached walk or bounds differ from stack walk");
+        passed = passed && (wrong == 0);
+    }
+    // the shared subtree is deleted with its last parent only
+    left->releaseChildren();
+    delete scenegraph;
+    return passed;
+}
+
+/**
+ * Load an image file repeatedly for about a fifth of a second
+ * \return the average seconds per load
+ */
+template <class Loader = PPMImageLoader>
+static double timeImageLoad(const string& path) {
+    // the loader announces every file it opens
+    ostringstream discard;
+    streambuf* console = cout.rdbuf(discard.rdbuf());
+    int loads = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double seconds = 0;
+    do {
+        Loader loader;
+        loader.load(path);
+        delete[] loader.getPixels();
+        loads++;
+        seconds = secondsSince(start);
+    } while (seconds < 0.2);
+    cout.rdbuf(console);
+    return seconds / loads;
+}
+
+/**
+ * Write each image as ASCII P3, 8-bit P6 and 16-bit P6, and time loading each.
+ * A source named synthetic:N is an N by N image of noise.
+ */
+static void benchImages(const vector<string>& sources) {
+    printf("%-28s %11s %12s %12s %12s\n", "image", "size", "P3 ms", "P6 ms", "P6/16 ms");
+    for (size_t s = 0; s < sources.size(); s++) {
+        vector<GLubyte> pixels;
+        int width, height;
+        if (sources[s].compare(0, 10, "synthetic:") == 0) {
+            width = height = atoi(sources[s].c_str() + 10);
+            pixels.resize(3 * (size_t)width * height);
+            unsigned int seed = 12345;
+            for (size_t i = 0; i < pixels.size(); i++) {
+                seed = seed * 1103515245u + 12345u;
+                pixels[i] = (GLubyte)(seed >> 24);
+            }
+        } else {
+            PPMImageLoader loader;
+            ostringstream discard;
+            streambuf* console = cout.rdbuf(discard.rdbuf());
+            try {
+                loader.load(sources[s]);
+            } catch (exception& e) {
+                cout.rdbuf(console);
+                printf("%-28s %s\n", sources[s].c_str(), e.what());
+                continue;
+            }
+            cout.rdbuf(console);
+            width = loader.getWidth();
+            height = loader.getHeight();
+            pixels.assign(loader.getPixels(), loader.getPixels() + 3 * (size_t)width * height);
+            delete[] loader.getPixels();
+        }
+        const char* names[] = {"bench-image-p3.ppm", "bench-image-p6.ppm", "bench-image-p6-16.ppm"};
+        writePPM(names[0], pixels.data(), width, height, false);
+        writePPM(names[1], pixels.data(), width, height, true);
+        writePPM(names[2], pixels.data(), width, height, true, 65535);
+        pixels.clear();
+        pixels.shrink_to_fit();
+
+        double times[3];
+        for (int f = 0; f < 3; f++) {
+            times[f] = timeImageLoad(names[f]);
+            remove(names[f]);
+        }
+        string base = sources[s].substr(sources[s].find_last_of("/\\") + 1);
+        printf("%-28s %5dx%-5d %12.2f %12.2f %12.2f\n", base.c_str(), width, height,
+               1000 * times[0], 1000 * times[1], 1000 * times[2]);
+    }
+}
+
+/**
+ * Build the mip levels of each image repeatedly for about a fifth of a second
+ * and report the average time. A source named synthetic:N is an N by N image of
+ * noise.
+ */
+static void benchMips(const vector<string>& sources) {
+    printf("%-28s %11s %7s %10s %10s\n", "image", "size", "levels", "chain MB", "build ms");
+    for (size_t s = 0; s < sources.size(); s++) {
+        sgraph::PixelHandle image;
+        if (sources[s].compare(0, 10, "synthetic:") == 0) {
+            int size = atoi(sources[s].c_str() + 10);
+            GLubyte* pixels = new GLubyte[3 * (size_t)size * size];
+            unsigned int seed = 12345;
+            for (size_t i = 0; i < 3 * (size_t)size * size; i++) {
+                seed = seed * 1103515245u + 12345u;
+                pixels[i] = (GLubyte)(seed >> 24);
+            }
+            image = sgraph::PixelBuffer::adopt(pixels, size, size);
+        } else {
+            ostringstream discard;
+            streambuf* console = cout.rdbuf(discard.rdbuf());
+            try {
+                image = sgraph::AssetCache::decodeImage(sources[s]).pixels;
+            } catch (exception& e) {
+                cout.rdbuf(console);
+                printf("%-28s %s\n", sources[s].c_str(), e.what());
+                continue;
+            }
+            cout.rdbuf(console);
+        }
+
+        sgraph::PixelHandle chain;
+        int builds = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            chain = sgraph::MipChain::build(image);
+            builds++;
+            seconds = secondsSince(start);
+        } while (seconds < 0.2);
+        double bytes = (double)sgraph::textureformat::pixelBytes(chain->getWidth(), chain->getHeight(),
+                                                                 chain->getLevels());
+        string base = sources[s].substr(sources[s].find_last_of("/\\") + 1);
+        printf("%-28s %5dx%-5d %7d %10.2f %10.2f\n", base.c_str(), chain->getWidth(), chain->getHeight(),
+               chain->getLevels(), bytes / (1024.0 * 1024.0), 1000 * seconds / builds);
+    }
+}
+
+static long fileSize(const string& path) {
+    ifstream in(path, ios::binary | ios::ate);
+    return in.is_open() ? (long)in.tellg() : -1;
+}
+
+/**
+ * Compare loading the PNG and the PPM version of each image, given by its path
+ * without the extension
+ */
+static void benchPNG(const vector<string>& images) {
+    printf("%-24s %10s %10s %10s %10s\n", "image", "PNG KB", "PNG ms", "PPM KB", "PPM ms");
+    for (size_t i = 0; i < images.size(); i++) {
+        string png = images[i] + ".png";
+        string ppm = images[i] + ".ppm";
+        string base = images[i].substr(images[i].find_last_of("/\\") + 1);
+        try {
+            double pngTime = timeImageLoad<PNGImageLoader>(png);
+            double ppmTime = timeImageLoad<PPMImageLoader>(ppm);
+            printf("%-24s %10.1f %10.2f %10.1f %10.2f\n", base.c_str(), fileSize(png) / 1024.0, 1000 * pngTime,
+                   fileSize(ppm) / 1024.0, 1000 * ppmTime);
+        } catch (exception& e) {
+            printf("%-24s %s\n", base.c_str(), e.what());
+        }
+    }
+}
+
+/**
+ * \return the paths of the images a command file declares
+ */
+static vector<string> declaredImages(const string& source) {
+    ifstream in(source);
+    if (!in.is_open())
+        throw runtime_error("Could not open " + source);
+    vector<string> paths;
+    string line;
+    while (getline(in, line)) {
+        string command, name, path;
+        istringstream(line) >> command >> name >> path;
+        if ((command == "image") && !path.empty())
+            paths.push_back(path);
+    }
+    return paths;
+}
+
+/**
+ * Load the images of a command file through the asset cache, with the given
+ * texture cache directory ("none" for no directory), and report the time
+ */
+static void measureTextures(const string& directory, const string& source) {
+    sgraph::AssetCache::shared().setTextureCacheDirectory(directory == "none" ? "" : directory);
+    vector<string> paths = declaredImages(source);
+    ostringstream discard;
+    streambuf* console = cout.rdbuf(discard.rdbuf());
+    int loaded = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    unsigned int touched = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        try {
+            sgraph::LoadedImage image = sgraph::AssetCache::shared().loadImage(paths[i]);
+            // read every page, as uploading the texture would
+            size_t bytes = image.pixels->size();
+            for (size_t b = 0; b < bytes; b += 4096)
+                touched += image.pixels->data()[b];
+            loaded++;
+        } catch (exception&) {
+        }
+    }
+    double seconds = secondsSince(start);
+    cout.rdbuf(console);
+    printf("%d of %d images in %.2f ms (%u)\n", loaded, (int)paths.size(), 1000 * seconds, touched);
+}
+
+/**
+ * Load the images of a command file without a texture cache directory, then
+ * with an empty one and again with the one the first run filled. Each start runs
+ * in its own process, as the application would.
+ */
+static void benchTextures(const string& self, const string& source) {
+    string directory = "bench-texture-cache";
+    const char* runs[] = {"none", "cold", "warm"};
+    for (int r = 0; r < 3; r++) {
+        printf("%-6s ", runs[r]);
+        fflush(stdout);
+        string command = "\"" + self + "\" texture-load " + (r == 0 ? "none" : directory) + " " + source;
+        if (system(command.c_str()) != 0)
+            printf("failed\n");
+    }
+    sgraph::TextureDiskCache cache;
+    cache.setDirectory(directory);
+    vector<string> paths = declaredImages(source);
+    for (size_t i = 0; i < paths.size(); i++) {
+        string canonical = sgraph::AssetCache::canonicalPath(paths[i]);
+        if (!canonical.empty())
+            remove(cache.entryPath(canonical).c_str());
+    }
+#ifndef _WIN32
+    rmdir(directory.c_str());
+#endif
+}
+
+/**
+ * Write a scene with the given number of boxes, each textured with one of the
+ * images in turn
+ */
+static void writeTexturedBoxes(const string& target, int leaves, const vector<string>& images) {
+    ofstream out(target);
+    out << "instance box models/box.obj\n";
+    for (size_t t = 0; t < images.size(); t++)
+        out << "image texture-" << t << " " << images[t] << "\n";
+    out << "group boxes boxes\n";
+    for (int i = 0; i < leaves; i++) {
+        out << "leaf box-" << i << " box-" << i << " instanceof box\n";
+        out << "assign-texture box-" << i << " texture-" << (i % images.size()) << "\n";
+        out << "add-child box-" << i << " boxes\n";
+    }
+    out << "assign-root boxes\n";
+}
+
+/**
+ * Parse a scene of textured leaves twice, count the pixel buffers alive and the
+ * bytes they hold, then delete both scenes and check that every buffer went
+ * with them.
+ * \return true if nothing was left behind
+ */
+static bool benchPixels(int leaves) {
+    string scene = "bench-pixels-commands.txt";
+    vector<string> images;
+    images.push_back("textures/checkerboard.ppm");
+    images.push_back("textures/earthmap.ppm");
+    images.push_back("textures/brick.ppm");
+    writeTexturedBoxes(scene, leaves, images);
+    sgraph::AssetCache::shared().setTextureCacheDirectory("");
+    long before = sgraph::PixelBuffer::liveCount();
+    vector<sgraph::IScenegraph*> scenes;
+    for (int copy = 0; copy < 2; copy++) {
+        sgraph::ScenegraphImporter importer;
+        importer.setVerbose(false);
+        scenes.push_back(importer.parseFile(scene));
+    }
+    remove(scene.c_str());
+
+    set<sgraph::SGNode*> nodes;
+    collectNodes(scenes[0]->getRoot(), nodes);
+    collectNodes(scenes[1]->getRoot(), nodes);
+    set<const sgraph::PixelBuffer*> distinct;
+    int textured = 0;
+    for (set<sgraph::SGNode*>::iterator it = nodes.begin(); it != nodes.end(); it++) {
+        sgraph::LeafNode* leaf = dynamic_cast<sgraph::LeafNode*>(*it);
+        if ((leaf != NULL) && leaf->getTexturePixels()) {
+            distinct.insert(leaf->getTexturePixels().get());
+            textured++;
+        }
+    }
+    size_t bytes = 0;
+    for (set<const sgraph::PixelBuffer*>::iterator it = distinct.begin(); it != distinct.end(); it++)
+        bytes += (*it)->size();
+    long live = sgraph::PixelBuffer::liveCount() - before;
+    printf("%d textured leaves in 2 scenes: %ld pixel buffers, %.1f MB, %.1f bytes per leaf\n", textured, live,
+           bytes / (1024.0 * 1024.0), textured > 0 ? (double)bytes / textured : 0.0);
+
+    for (size_t i = 0; i < scenes.size(); i++)
+        delete scenes[i];
+    long left = sgraph::PixelBuffer::liveCount() - before;
+    printf("after deleting the scenes: %ld pixel buffers left\n", left);
+    bool ok = (live == (long)distinct.size()) && (left == 0);
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/**
+ * Collects the texture and mesh of each leaf in the order the renderer draws
+ * them
+ */
+class DrawOrderVisitor : public TraversalVisitor {
+  public:
+    void visitLeafNode(sgraph::LeafNode* node) {
+        TraversalVisitor::visitLeafNode(node);
+        textures.push_back(node->getTextureSymbol());
+        meshes.push_back(node->getInstanceSymbol());
+    }
+
+    vector<sgraph::Symbol> textures;
+    vector<sgraph::Symbol> meshes;
+};
+
+/**
+ * Count the texture binds a draw of the scene needs when each image is a
+ * texture of its own and when small images share atlas pages, as the GL
+ * renderer packs them. Meshes with texture coordinates outside [0,1] keep
+ * their own textures, as they do in the renderer. Without a command file the
+ * scene is a row of boxes over the small textures that ship with the
+ * assignment, and one large one.
+ */
+static void benchAtlas(const string& source) {
+    string path = source;
+    if (path.empty()) {
+        path = "bench-atlas-commands.txt";
+        vector<string> images;
+        images.push_back("textures/boxes_1.ppm");
+        images.push_back("textures/sign_1.ppm");
+        images.push_back("textures/tree_1.ppm");
+        images.push_back("textures/house_2.ppm");
+        images.push_back("textures/west_1.ppm");
+        images.push_back("textures/checkerboard.png");
+        images.push_back("textures/brick.ppm");
+        writeTexturedBoxes(path, 1000, images);
+    }
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(path);
+    if (source.empty())
+        remove(path.c_str());
+
+    map<string, sgraph::PixelHandle> images = scenegraph->getImagePixels();
+    sgraph::TextureAtlas atlas;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    atlas.build(images);
+    double seconds = secondsSince(start);
+    printf("%zu images, %zu packed into %zu pages of 1024x1024, %.1f%% occupied, built in %.1f ms\n", images.size(),
+           atlas.size(), atlas.getPages().size(), 100 * atlas.getOccupancy(), 1000 * seconds);
+
+    set<sgraph::Symbol> repeating;
+    map<string, util::PolygonMesh<VertexAttrib> > meshes = scenegraph->getMeshes();
+    for (map<string, util::PolygonMesh<VertexAttrib> >::iterator it = meshes.begin(); it != meshes.end(); it++) {
+        vector<VertexAttrib> vertices = it->second.getVertexAttributes();
+        for (size_t i = 0; i < vertices.size(); i++) {
+            vector<float> texcoord = vertices[i].hasData("texcoord") ? vertices[i].getData("texcoord") : vector<float>();
+            for (size_t j = 0; (j < texcoord.size()) && (j < 2); j++) {
+                if ((texcoord[j] < -1e-3f) || (texcoord[j] > 1 + 1e-3f))
+                    repeating.insert(sgraph::Symbol(it->first));
+            }
+        }
+    }
+
+    DrawOrderVisitor order;
+    scenegraph->getRoot()->accept(&order);
+    int textured = 0;
+    int alone = 0;
+    int shared = 0;
+    string lastAlone;
+    string lastShared;
+    for (size_t i = 0; i < order.textures.size(); i++) {
+        string name = order.textures[i].str();
+        if (name.empty() || (images.find(name) == images.end()))
+            continue;
+        textured++;
+        string bound = name;
+        const sgraph::TextureAtlas::Placement* placement = atlas.find(name);
+        if ((placement != NULL) && (repeating.count(order.meshes[i]) == 0)) {
+            ostringstream page;
+            page << "page " << placement->page;
+            bound = page.str();
+        }
+        if (name != lastAlone)
+            alone++;
+        if (bound != lastShared)
+            shared++;
+        lastAlone = name;
+        lastShared = bound;
+    }
+    printf("%d textured leaves: %d texture binds on their own, %d with the atlas\n", textured, alone, shared);
+    delete scenegraph;
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+    if (args.empty()) {
+        cout << "usage: SceneBench parse [command file] [scale]" << endl;
+        cout << "       SceneBench binary [command file...]" << endl;
+        cout << "       SceneBench memory [blocks]" << endl;
+        cout << "       SceneBench imports [command file]" << endl;
+        cout << "       SceneBench names [command file...]" << endl;
+        cout << "       SceneBench scaling [max nodes]" << endl;
+        cout << "       SceneBench transforms [nodes] [moved]" << endl;
+        cout << "       SceneBench normals [leaves]" << endl;
+        cout << "       SceneBench shared" << endl;
+        cout << "       SceneBench images [ppm file | synthetic:size ...]" << endl;
+        cout << "       SceneBench textures [command file]" << endl;
+        cout << "       SceneBench png [image path without extension...]" << endl;
+        cout << "       SceneBench pixels [leaves]" << endl;
+        cout << "       SceneBench mips [image file | synthetic:size ...]" << endl;
+        cout << "       SceneBench atlas [command file]" << endl;
+        return 1;
+    }
+
+    if (args[0] == "parse") {
+        string source = args.size() > 1 ? args[1] : "scenegraphmodels/courtyard-scene-commands.txt";
+        int scale = args.size() > 2 ? atoi(args[2].c_str()) : 1000;
+        benchParse(source, scale);
+    } else if (args[0] == "binary") {
+        vector<string> sources(args.begin() + 1, args.end());
+        if (sources.empty()) {
+            sources.push_back("scenegraphmodels/looking-humanoid-commands.txt");
+            sources.push_back("scenegraphmodels/sitting-humanoid-commands.txt");
+            sources.push_back("scenegraphmodels/courtyard-scene-commands.txt");
+        }
+        benchBinary(sources, 10);
+    } else if (args[0] == "memory") {
+        benchMemory(argv[0], args.size() > 1 ? atoi(args[1].c_str()) : 200000);
+    } else if (args[0] == "imports") {
+        benchImports(argv[0], args.size() > 1 ? args[1] : "scenegraphmodels/looking-humanoid-commands.txt");
+    } else if (args[0] == "names") {
+        vector<string> sources(args.begin() + 1, args.end());
+        if (sources.empty()) {
+            sources.push_back("scenegraphmodels/looking-humanoid-commands.txt");
+            sources.push_back("scenegraphmodels/sitting-humanoid-commands.txt");
+        }
+        benchNames(sources);
+    } else if (args[0] == "scaling") {
+        benchScaling(argv[0], args.size() > 1 ? atoll(args[1].c_str()) : 10000000LL);
+    } else if (args[0] == "transforms") {
+        benchTransforms(args.size() > 1 ? atoll(args[1].c_str()) : 1000000LL, args.size() > 2 ? atoi(args[2].c_str()) : 100);
+    } else if (args[0] == "normals") {
+        benchNormals(args.size() > 1 ? atoll(args[1].c_str()) : 10000LL);
+    } else if (args[0] == "shared") {
+        if (!benchShared())
+            return 1;
+    } else if ((args[0] == "scale-one") && (args.size() > 2)) {
+        measureScaling(args[1], atoll(args[2].c_str()));
+    } else if (args[0] == "images") {
+        vector<string> sources(args.begin() + 1, args.end());
+        if (sources.empty()) {
+            sources.push_back("textures/checkerboard.ppm");
+            sources.push_back("textures/earthmap.ppm");
+            sources.push_back("textures/brick.ppm");
+            sources.push_back("synthetic:8192");
+        }
+        benchImages(sources);
+    } else if (args[0] == "textures") {
+        benchTextures(argv[0], args.size() > 1 ? args[1] : "scenegraphmodels/courtyard-scene-commands.txt");
+    } else if (args[0] == "png") {
+        vector<string> images(args.begin() + 1, args.end());
+        if (images.empty()) {
+            images.push_back("textures/checkerboard");
+            images.push_back("textures/earthmap");
+        }
+        benchPNG(images);
+    } else if (args[0] == "mips") {
+        vector<string> sources(args.begin() + 1, args.end());
+        if (sources.empty()) {
+            sources.push_back("textures/checkerboard.png");
+            sources.push_back("textures/earthmap.png");
+            sources.push_back("synthetic:4096");
+        }
+        benchMips(sources);
+    } else if (args[0] == "atlas") {
+        benchAtlas(args.size() > 1 ? args[1] : "");
+    } else if (args[0] == "pixels") {
+        if (!benchPixels(args.size() > 1 ? atoi(args[1].c_str()) : 10000))
+            return 1;
+    } else if ((args[0] == "texture-load") && (args.size() > 2)) {
+        measureTextures(args[1], args[2]);
+    } else if ((args[0] == "peak") && (args.size() > 2)) {
+        measurePeak(args[1], args[2]);
+    } else {
+        cout << "Unknown benchmark: " << args[0] << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <glad/glad.h>
+#include "../sgraph/ScenegraphImporter.h"
+#include "../sgraph/BinaryScenegraphExporter.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+
+/**
+ * Compile a scene graph command file into the binary format that
+ * BinaryScenegraphImporter loads.
+ *
+ *   SceneCompiler <command file> <output file>
+ */
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cout << "usage: SceneCompiler <command file> <output file>" << endl;
+        return 1;
+    }
+
+    sgraph::ScenegraphImporter importer;
+    importer.setVerbose(false);
+    sgraph::IScenegraph* scenegraph = importer.parseFile(argv[1]);
+
+    map<string, string> meshPaths = scenegraph->getMeshPaths();
+    map<string, string> imagePaths = scenegraph->getImagePaths();
+    sgraph::BinaryScenegraphExporter exporter(meshPaths, imagePaths);
+    scenegraph->getRoot()->accept(&exporter);
+    string output = exporter.getOutput();
+
+    ofstream out(argv[2], ios::binary);
+    if (!out.is_open()) {
+        cout << "Could not write " << argv[2] << endl;
+        return 1;
+    }
+    out.write(output.data(), output.size());
+    cout << "Wrote " << output.size() << " bytes to " << argv[2] << endl;
+    return 0;
+}
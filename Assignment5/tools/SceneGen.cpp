@@ -0,0 +1,86 @@
+#include "SceneGenerator.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+
+/**
+ * Write a synthetic scene graph command file. Run it from the Assignment5 folder
+ * (or load the file from there) so that the mesh paths inside it resolve.
+ *
+ *   SceneGen [-n nodes] [-d depth] [-f fanout] [-i instancing ratio] [-l lights] [-import] <output file>
+ *
+ * With -import, instanced blocks import a prototype file written next to the
+ * output file instead of copying a prototype block.
+ */
+int main(int argc, char* argv[]) {
+    SceneGeneratorOptions options;
+    bool useImport = false;
+    string output;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-import") {
+            useImport = true;
+        } else if ((arg.size() == 2) && (arg[0] == '-') && (i + 1 < argc)) {
+            const char* value = argv[++i];
+            switch (arg[1]) {
+            case 'n':
+                options.nodes = atoll(value);
+                break;
+            case 'd':
+                options.depth = atoi(value);
+                break;
+            case 'f':
+                options.fanout = atoi(value);
+                break;
+            case 'i':
+                options.instancing = atof(value);
+                break;
+            case 'l':
+                options.lights = atoi(value);
+                break;
+            default:
+                output.clear();
+                i = argc;
+                break;
+            }
+        } else if (output.empty() && (arg[0] != '-')) {
+            output = arg;
+        } else {
+            output.clear();
+            break;
+        }
+    }
+    if (output.empty()) {
+        cout << "usage: SceneGen [-n nodes] [-d depth] [-f fanout] [-i instancing ratio] [-l lights] [-import] "
+                "<output file>"
+             << endl;
+        return 1;
+    }
+
+    try {
+        if (useImport) {
+            string base = output;
+            if ((base.size() > 4) && (base.compare(base.size() - 4, 4, ".txt") == 0))
+                base = base.substr(0, base.size() - 4);
+            options.importFile = base + "-prototype.txt";
+        }
+        SceneGenerator generator(options);
+        if (useImport) {
+            ofstream prototype(options.importFile.c_str());
+            generator.writePrototype(prototype);
+        }
+        ofstream out(output.c_str());
+        if (!out.is_open()) {
+            cout << "Could not write " << output << endl;
+            return 1;
+        }
+        generator.write(out);
+        cout << "Wrote " << generator.getNodeCount() << " nodes to " << output << endl;
+    } catch (exception& e) {
+        cout << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
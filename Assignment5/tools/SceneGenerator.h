@@ -0,0 +1,177 @@
+#ifndef _SCENEGENERATOR_H_
+#define _SCENEGENERATOR_H_
+
+#include <algorithm>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+/**
+ * The shape of a generated scene. The scene is a root group holding blocks; each
+ * block is a translate above a tree of the given depth, where every group has
+ * fanout children, each under its own translate, and the bottom level is leaves.
+ * Blocks are added until the scene has at least the requested number of nodes.
+ *
+ * A fraction of the blocks, the instancing ratio, are not written out but made
+ * from a prototype block: with copy, or with import of a separate prototype file
+ * if importFile is set. The lights are spread over the leaves of the other blocks.
+ */
+struct SceneGeneratorOptions {
+    long long nodes;
+    int depth;
+    int fanout;
+    double instancing;
+    int lights;
+    string importFile;
+
+    SceneGeneratorOptions() : nodes(1000), depth(4), fanout(4), instancing(0.0), lights(1) {}
+};
+
+/**
+ * This class writes synthetic scene graph command files, using only commands the
+ * ScenegraphImporter understands. The same options always give the same file.
+ */
+class SceneGenerator {
+  public:
+    SceneGenerator(const SceneGeneratorOptions& options) : options(options), names(0) {
+        if ((options.depth < 1) || (options.fanout < 1))
+            throw invalid_argument("depth and fanout must be at least 1");
+        if ((options.instancing < 0.0) || (options.instancing > 1.0))
+            throw invalid_argument("instancing ratio must be between 0 and 1");
+        blockSize = 1;
+        for (int d = 1; d < options.depth; d++)
+            blockSize = 1 + options.fanout * (1 + blockSize);
+        // each block also has its own translate
+        blockSize++;
+        blocks = (options.nodes - 1 + blockSize - 1) / blockSize;
+        if (blocks < 1)
+            blocks = 1;
+        leavesPerBlock = 1;
+        for (int d = 1; d < options.depth; d++)
+            leavesPerBlock *= options.fanout;
+    }
+
+    /**
+     * \return the number of nodes in the scene, counting every copy and import
+     */
+    long long getNodeCount() { return 1 + blocks * blockSize; }
+
+    /**
+     * Write the scene to a stream. If prototypes are imported, the prototype file
+     * must also be written, with writePrototype.
+     */
+    void write(ostream& out) {
+        names = 0;
+        lightsPlaced = 0;
+        leavesSeen = 0;
+        long long litBlocks = 0;
+        for (long long b = 0; b < blocks; b++) {
+            if (!isInstanced(b))
+                litBlocks++;
+        }
+        lightStride = (options.lights > 0) ? max(1LL, (litBlocks * leavesPerBlock) / options.lights) : 0;
+
+        out << "# generated: " << getNodeCount() << " nodes, depth " << options.depth << ", fanout "
+            << options.fanout << ", instancing " << options.instancing << ", " << options.lights << " lights\n";
+        writeHeader(out);
+        for (int l = 0; l < options.lights; l++) {
+            out << "light light-" << l << "\n";
+            out << "ambient 0.1 0.1 0.1\ndiffuse 0.6 0.6 0.6\nspecular 0.4 0.4 0.4\n";
+            out << "position " << (l % 8) * 100 << " 200 " << (l / 8) * 100 << "\n";
+            out << "end-light\n";
+        }
+
+        string prototype;
+        out << "group scene scene\n";
+        for (long long b = 0; b < blocks; b++) {
+            string block;
+            if (isInstanced(b) && options.importFile.empty()) {
+                // built once, and only ever copied
+                if (prototype.empty())
+                    prototype = writeTree(out, options.depth - 1, false);
+                block = nextName("block");
+                out << "copy " << block << " " << prototype << "\n";
+            } else if (isInstanced(b)) {
+                block = nextName("block");
+                out << "import " << block << " " << options.importFile << "\n";
+            } else {
+                block = writeTree(out, options.depth - 1, true);
+            }
+            string translate = nextName("t-block");
+            out << "translate " << translate << " " << translate << " " << (b % 100) * 20 << " 0 " << (b / 100) * 20
+                << "\n";
+            out << "add-child " << block << " " << translate << "\n";
+            out << "add-child " << translate << " scene\n";
+        }
+        out << "assign-root scene\n";
+    }
+
+    /**
+     * Write the prototype block on its own, to be imported
+     */
+    void writePrototype(ostream& out) {
+        names = 0;
+        writeHeader(out);
+        string root = writeTree(out, options.depth - 1, false);
+        out << "assign-root " << root << "\n";
+    }
+
+  private:
+    bool isInstanced(long long block) {
+        return (long long)((block + 1) * options.instancing) > (long long)(block * options.instancing);
+    }
+
+    void writeHeader(ostream& out) {
+        out << "instance box models/box.obj\n";
+        out << "instance sphere models/sphere.obj\n";
+        const char* colors[] = {"1 0 0", "0 1 0", "0 0 1", "1 1 0"};
+        for (int m = 0; m < 4; m++)
+            out << "material material-" << m << "\nambient " << colors[m] << "\ndiffuse " << colors[m]
+                << "\nend-material\n";
+    }
+
+    string nextName(const char* prefix) {
+        ostringstream name;
+        name << prefix << "-" << names++;
+        return name.str();
+    }
+
+    /**
+     * Write a tree with the given number of levels above its leaves
+     * \return the name of its root
+     */
+    string writeTree(ostream& out, int levels, bool lit) {
+        if (levels == 0) {
+            string leaf = nextName("leaf");
+            out << "leaf " << leaf << " " << leaf << " instanceof " << (((names / 2) % 2 == 0) ? "box" : "sphere")
+                << "\n";
+            out << "assign-material " << leaf << " material-" << names % 4 << "\n";
+            if (lit && (lightStride > 0) && (leavesSeen++ % lightStride == 0) && (lightsPlaced < options.lights))
+                out << "assign-light " << leaf << " light-" << lightsPlaced++ << "\n";
+            return leaf;
+        }
+        string group = nextName("group");
+        out << "group " << group << " " << group << "\n";
+        for (int f = 0; f < options.fanout; f++) {
+            string child = writeTree(out, levels - 1, lit);
+            string translate = nextName("t");
+            out << "translate " << translate << " " << translate << " " << f * 2 << " " << levels << " 0\n";
+            out << "add-child " << child << " " << translate << "\n";
+            out << "add-child " << translate << " " << group << "\n";
+        }
+        return group;
+    }
+
+    SceneGeneratorOptions options;
+    long long blockSize;
+    long long blocks;
+    long long leavesPerBlock;
+    long long names;
+    long long lightStride;
+    long long leavesSeen;
+    int lightsPlaced;
+};
+
+#endif
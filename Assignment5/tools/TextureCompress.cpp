@@ -0,0 +1,102 @@
+#include <glad/glad.h>
+#include <string>
+using namespace std;
+#include "../sgraph/AssetCache.h"
+#include "PPMWriter.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+static double psnr(const unsigned char* a, const unsigned char* b, size_t count) {
+    double error = 0;
+    for (size_t i = 0; i < count; i++) {
+        double d = (double)a[i] - b[i];
+        error += d * d;
+    }
+    error /= count;
+    return (error == 0) ? INFINITY : 10 * log10(255.0 * 255.0 / error);
+}
+
+/**
+ * Block compress images ahead of time. Each image is encoded, decoded again and
+ * compared with the original, and the time, size and PSNR are reported. With
+ * -t, the images are also loaded into that texture cache directory, compressed
+ * with all their mip levels, so the application maps them instead of encoding
+ * them at startup. With -o, the decoded images are written next to the
+ * originals as <image>.<format>.ppm to look at.
+ *
+ *   TextureCompress [-t <texture cache directory>] [-o] bc1|bc7 <image file...>
+ */
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+    string cache;
+    bool writeDecoded = false;
+    size_t next = 0;
+    while (next < args.size()) {
+        if ((args[next] == "-t") && (next + 1 < args.size())) {
+            cache = args[next + 1];
+            next += 2;
+        } else if (args[next] == "-o") {
+            writeDecoded = true;
+            next++;
+        } else {
+            break;
+        }
+    }
+    if ((next + 1 >= args.size()) || ((args[next] != "bc1") && (args[next] != "bc7"))) {
+        cout << "usage: TextureCompress [-t <texture cache directory>] [-o] bc1|bc7 <image file...>" << endl;
+        return 1;
+    }
+    ourutils::BlockCompression::Format format =
+        (args[next] == "bc1") ? ourutils::BlockCompression::BC1 : ourutils::BlockCompression::BC7;
+    string name = args[next];
+    if (!cache.empty()) {
+        sgraph::AssetCache::shared().setTextureCacheDirectory(cache);
+        sgraph::AssetCache::shared().setTextureCompression(format);
+    }
+
+    int failed = 0;
+    printf("%-28s %11s %10s %10s %8s\n", "image", "size", "encode ms", "ratio", "PSNR dB");
+    for (size_t i = next + 1; i < args.size(); i++) {
+        string path = args[i];
+        string base = path.substr(path.find_last_of("/\\") + 1);
+        try {
+            // the loaders announce every file they open
+            ostringstream discard;
+            streambuf* console = cout.rdbuf(discard.rdbuf());
+            sgraph::PixelHandle image;
+            try {
+                image = sgraph::AssetCache::decodeImage(path).pixels;
+            } catch (...) {
+                cout.rdbuf(console);
+                throw;
+            }
+            cout.rdbuf(console);
+            int width = image->getWidth();
+            int height = image->getHeight();
+
+            vector<unsigned char> blocks(ourutils::BlockCompression::compressedSize(format, width, height));
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            ourutils::BlockCompression::encode(format, image->data(), width, height, blocks.data());
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            vector<unsigned char> decoded(image->size());
+            ourutils::BlockCompression::decode(format, blocks.data(), width, height, decoded.data());
+            printf("%-28s %5dx%-5d %10.2f %9.1f:1 %8.2f\n", base.c_str(), width, height, 1000 * seconds,
+                   (double)image->size() / blocks.size(), psnr(image->data(), decoded.data(), decoded.size()));
+            if (writeDecoded && !writePPM(path + "." + name + ".ppm", decoded.data(), width, height, true))
+                throw std::runtime_error("Could not write " + path + "." + name + ".ppm");
+
+            if (!cache.empty()) {
+                streambuf* console = cout.rdbuf(discard.rdbuf());
+                sgraph::AssetCache::shared().loadImage(path);
+                cout.rdbuf(console);
+            }
+        } catch (exception& e) {
+            printf("%-28s %s\n", base.c_str(), e.what());
+            failed++;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
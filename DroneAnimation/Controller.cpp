@@ -8,7 +8,9 @@ Controller *currentController = nullptr;
 Controller::Controller()
     : cameraMode(GLOBAL_CAMERA),
       globalCameraYaw(0.0f),
-      chopperCameraAngle(0.0f)
+      chopperCameraAngle(0.0f),
+      pathCameraPosition(0.0f, 0.0f, 20.0f),
+      pathCameraUp(0.0f, 1.0f, 0.0f)
 {
     // initialize the drone
     drone = std::unique_ptr<Model>(new Model());
@@ -32,7 +34,11 @@ Controller::~Controller()
 
 void Controller::init(GLFWwindow *window)
 {
-    glfwSetKeyCallback(window, key_callback_wrapper);
+    // there are no keys to listen to when recording without a window
+    if (window)
+    {
+        glfwSetKeyCallback(window, key_callback_wrapper);
+    }
 
     // reset position
     drone->resetPosition();
@@ -167,11 +173,26 @@ glm::mat4 Controller::getViewMatrix() const
         cameraPos = getFirstPersonCameraPosition();
         cameraTarget = getFirstPersonCameraTarget();
         break;
+    case PATH_CAMERA:
+        cameraPos = pathCameraPosition;
+        cameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
+        upVector = pathCameraUp;
+        break;
     }
 
     return glm::lookAt(cameraPos, cameraTarget, upVector);
 }
 
+void Controller::setPathCamera(float thetaX, float thetaY, float radius)
+{
+    // placed as the Scenegraphs trackball places its camera, with up flipped past the poles
+    cameraMode = PATH_CAMERA;
+    pathCameraPosition = glm::vec3(radius * cos(thetaY) * sin(thetaX),
+                                   radius * sin(thetaY),
+                                   radius * cos(thetaY) * cos(thetaX));
+    pathCameraUp = glm::vec3(0.0f, (cos(thetaY) < 0.0f) ? -1.0f : 1.0f, 0.0f);
+}
+
 glm::mat4 Controller::getProjectionMatrix(float aspectRatio) const
 {
     // perspective projection
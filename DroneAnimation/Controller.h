@@ -10,7 +10,8 @@ enum CameraMode
 {
     GLOBAL_CAMERA = 0,
     CHOPPER_CAMERA = 1,
-    FIRST_PERSON_CAMERA = 2
+    FIRST_PERSON_CAMERA = 2,
+    PATH_CAMERA = 3
 };
 
 class Controller
@@ -28,6 +29,8 @@ public:
     // control cam.
     void setCameraMode(CameraMode mode) { cameraMode = mode; }
     CameraMode getCameraMode() const { return cameraMode; }
+    // orbit the origin at the given angles, in radians, and distance, for recordings
+    void setPathCamera(float thetaX, float thetaY, float radius);
 
     // get matricies for rendering
     glm::mat4 getViewMatrix() const;
@@ -41,6 +44,8 @@ private:
     CameraMode cameraMode;
     float globalCameraYaw;
     float chopperCameraAngle;
+    glm::vec3 pathCameraPosition;
+    glm::vec3 pathCameraUp;
 
     bool keys[348];
     void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
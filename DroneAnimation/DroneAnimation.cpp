@@ -2,16 +2,69 @@
 #include "View.h"
 #include "Model.h"
 #include "Controller.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 int main(int argc, char *argv[])
 {
     // DEBUG: std::cout << "Starting program..." << std::endl;
+    std::vector<std::string> args(argv + 1, argv + argc);
 
     // Create view
     // DEBUG: std::cout << "Creating view..." << std::endl;
     View view;
 
+    /** optional arg [ --frames <n> ] draws n frames without a window, writes them out with a timing report, and exits */
+    int frames = 0;
+    auto it = std::find(args.begin(), args.end(), "--frames");
+    if (it != args.end() && it + 1 != args.end())
+        frames = std::max(atoi((it + 1)->c_str()), 0);
+    if (frames > 0)
+    {
+        /** optional arg [ --camera-path <filepath> ] orbits the camera along keyframes around the origin (see ourutils/CameraPath.h); the global camera is used otherwise */
+        ourutils::CameraPath cameraPath(20.0f);
+        bool followPath = false;
+        std::string error;
+        it = std::find(args.begin(), args.end(), "--camera-path");
+        if (it != args.end() && it + 1 != args.end())
+        {
+            if (!cameraPath.load(*(it + 1), error))
+            {
+                std::cerr << "Could not load the camera path: " << error << std::endl;
+                return -1;
+            }
+            followPath = true;
+        }
+        /** optional arg [ --size <width>x<height> ] sets the size of the recorded frames, 800x600 by default */
+        int width = 800, height = 600;
+        it = std::find(args.begin(), args.end(), "--size");
+        if (it != args.end() && it + 1 != args.end())
+        {
+            int w, h;
+            if (sscanf((it + 1)->c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0)
+            {
+                width = w;
+                height = h;
+            }
+        }
+        /** optional arg [ --out <directory> ] puts the recorded frames and timing.txt in an existing directory; "--out none" only prints the timing */
+        std::string directory = ".";
+        it = std::find(args.begin(), args.end(), "--out");
+        if (it != args.end() && it + 1 != args.end())
+            directory = (*(it + 1) == "none") ? "" : *(it + 1);
+
+        if (!view.initHeadless(width, height, error))
+        {
+            std::cerr << "Could not draw headless: " << error << std::endl;
+            return -1;
+        }
+        return view.record(frames, followPath ? &cameraPath : nullptr, directory) ? 0 : -1;
+    }
+
     // Initialize view (creates window, sets up OpenGL)
     // DEBUG: std::cout << "Initializing view..." << std::endl;
     if (!view.init())
@@ -0,0 +1,196 @@
+#ifndef __HEADLESSCONTEXT_H__
+#define __HEADLESSCONTEXT_H__
+
+#include <glad/glad.h>
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <cstring>
+#include <string>
+using namespace std;
+
+/**
+ * An OpenGL 3.3 core context without a window, drawing into a framebuffer object
+ * of a fixed size. The context is made through EGL on Mesa's surfaceless
+ * platform when it is there, so it needs neither a display server nor a GPU:
+ * llvmpipe draws on the CPU. Other EGL displays are tried after it, with a
+ * pbuffer if they cannot make a context current without a surface.
+ *
+ * EGL is only used if the build defines HAVE_EGL, as the Makefile does on Linux;
+ * elsewhere create always fails.
+ */
+class HeadlessContext
+{
+public:
+    HeadlessContext() : width(0), height(0), framebuffer(0), colorBuffer(0), depthBuffer(0)
+    {
+#ifdef HAVE_EGL
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+        surface = EGL_NO_SURFACE;
+#endif
+    }
+
+    ~HeadlessContext() { destroy(); }
+
+    /**
+     * Make the context current, load GL through glad and bind a framebuffer
+     * object of the given size, with a color and a depth buffer, for drawing.
+     * \return false, with the reason in error, if any step failed
+     */
+    bool create(int width, int height, string &error)
+    {
+#ifdef HAVE_EGL
+        if (!makeCurrent(width, height, error))
+        {
+            destroy();
+            return false;
+        }
+        gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            error = "the framebuffer object is incomplete";
+            destroy();
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        this->width = width;
+        this->height = height;
+        return true;
+#else
+        error = "this build has no EGL; rebuild with HAVE_EGL defined";
+        return false;
+#endif
+    }
+
+    void destroy()
+    {
+#ifdef HAVE_EGL
+        if (context != EGL_NO_CONTEXT)
+        {
+            if (framebuffer != 0)
+            {
+                glDeleteFramebuffers(1, &framebuffer);
+                glDeleteRenderbuffers(1, &colorBuffer);
+                glDeleteRenderbuffers(1, &depthBuffer);
+            }
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if (surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        if (display != EGL_NO_DISPLAY)
+            eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+        surface = EGL_NO_SURFACE;
+#endif
+        framebuffer = colorBuffer = depthBuffer = 0;
+        width = height = 0;
+    }
+
+    bool isCreated() const { return framebuffer != 0; }
+
+    int getWidth() const { return width; }
+
+    int getHeight() const { return height; }
+
+private:
+#ifdef HAVE_EGL
+    static bool hasExtension(const char *extensions, const char *name)
+    {
+        if (extensions == NULL)
+            return false;
+        size_t length = strlen(name);
+        for (const char *at = strstr(extensions, name); at != NULL; at = strstr(at + length, name))
+        {
+            if (((at == extensions) || (at[-1] == ' ')) && ((at[length] == ' ') || (at[length] == '\0')))
+                return true;
+        }
+        return false;
+    }
+
+    bool makeCurrent(int width, int height, string &error)
+    {
+        const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if ((getPlatformDisplay != NULL) && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if ((display == EGL_NO_DISPLAY) || !eglInitialize(display, &major, &minor))
+        {
+            display = EGL_NO_DISPLAY;
+            error = "no EGL display could be initialized";
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            error = "the EGL display does not offer desktop OpenGL";
+            return false;
+        }
+
+        const EGLint configAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                           EGL_NONE};
+        EGLConfig config = NULL;
+        EGLint configs = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || (configs == 0))
+            config = NULL;
+        const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if ((config == NULL) && !hasExtension(extensions, "EGL_KHR_no_config_context"))
+        {
+            error = "the EGL display has no configuration for OpenGL";
+            return false;
+        }
+
+        const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                            EGL_NONE};
+        context = eglCreateContext(display, (config != NULL) ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT,
+                                   contextAttributes);
+        if (context == EGL_NO_CONTEXT)
+        {
+            error = "no OpenGL 3.3 core context could be made";
+            return false;
+        }
+        // everything is drawn into the framebuffer object, so a surface is only made if EGL insists on one
+        if (hasExtension(extensions, "EGL_KHR_surfaceless_context") &&
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+            return true;
+        if (config != NULL)
+        {
+            const EGLint surfaceAttributes[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+            surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+            if ((surface != EGL_NO_SURFACE) && eglMakeCurrent(display, surface, surface, context))
+                return true;
+        }
+        error = "the OpenGL context could not be made current";
+        return false;
+    }
+
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+#endif
+    int width;
+    int height;
+    GLuint framebuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+};
+
+#endif
@@ -1,4 +1,8 @@
 #include "View.h"
+#include "ourutils/FrameTimings.h"
+#include "tools/PPMWriter.h"
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -34,6 +38,25 @@ bool View::init()
             return false;
         }
 
+        return initScene();
+}
+
+bool View::initHeadless(int width, int height, std::string &error)
+{
+        if (!headless.create(width, height, error))
+        {
+            return false;
+        }
+        if (!initScene())
+        {
+            error = "the shaders did not build";
+            return false;
+        }
+        return true;
+}
+
+bool View::initScene()
+{
         // DEBUG: std::cout << "Initializing shaders..." << std::endl;
         if (!initShaders())
         {
@@ -322,6 +345,63 @@ void View::run()
     // DEBUG: std::cout << "Main loop ended" << std::endl;
 }
 
+/**
+ * Draw frames into the headless framebuffer, with the animation moving on by a
+ * sixtieth of a second each frame so that a recording is the same every time,
+ * and write each frame as a PPM with a timing report (see
+ * ourutils/FrameTimings.h). The camera follows the path if there is one and
+ * stays the global camera otherwise. An empty directory writes no files and only
+ * prints the timing.
+ * \return false if a frame or the report could not be written
+ */
+bool View::record(int frames, const ourutils::CameraPath *cameraPath, const std::string &directory)
+{
+    const float deltaTime = 1.0f / 60.0f;
+    ourutils::FrameTimings timings;
+    std::vector<unsigned char> pixels;
+    bool written = true;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (cameraPath)
+        {
+            ourutils::CameraPath::Pose pose = cameraPath->at(frame, frames);
+            controller->setPathCamera(glm::radians(pose.thetaX), glm::radians(pose.thetaY), pose.radius);
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        controller->update(deltaTime);
+        render(deltaTime);
+        glFlush();
+        double submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glFinish();
+        timings.add(submitMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (!directory.empty())
+        {
+            int width = headless.getWidth(), height = headless.getHeight();
+            pixels.resize(3 * (size_t)width * height);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+            char name[32];
+            snprintf(name, sizeof(name), "/frame-%04d.ppm", frame);
+            if (!writePPM(directory + name, pixels.data(), width, height, true))
+            {
+                std::cerr << "Could not write " << directory + name << std::endl;
+                written = false;
+                break;
+            }
+        }
+    }
+
+    std::string report = timings.report((const char *)glGetString(GL_RENDERER), headless.getWidth(), headless.getHeight());
+    std::cout << report;
+    if (!directory.empty())
+    {
+        std::ofstream out(directory + "/timing.txt");
+        out << report;
+        written = written && out.good();
+    }
+    return written;
+}
+
 void View::render(float deltaTime)
 {
     // clear screen
@@ -330,8 +410,11 @@ void View::render(float deltaTime)
     glUseProgram(shaderProgram);
 
     // get window size
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
+    int width = headless.getWidth(), height = headless.getHeight();
+    if (window)
+    {
+        glfwGetFramebufferSize(window, &width, &height);
+    }
     float aspectRatio = (float)width / (float)height;
 
     // view / projection matrices from controller
@@ -374,7 +457,8 @@ void View::cleanup()
     if (window)
     {
         glfwDestroyWindow(window);
+        glfwTerminate();
     }
-    glfwTerminate();
+    headless.destroy();
     // DEBUG: std::cout << "Cleanup complete" << std::endl;
 }
\ No newline at end of file
@@ -4,7 +4,10 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "Controller.h"
+#include "HeadlessContext.h"
+#include "ourutils/CameraPath.h"
 #include <memory>
+#include <string>
 
 class View
 {
@@ -13,13 +16,16 @@ public:
     ~View();
 
     bool init();
+    bool initHeadless(int width, int height, std::string &error);
     void run();
+    bool record(int frames, const ourutils::CameraPath *cameraPath, const std::string &directory);
     void render(float deltaTime);
     GLFWwindow *getWindow() { return window; }
 
 private:
-    // window
+    // window, or nullptr when drawing headless
     GLFWwindow *window;
+    HeadlessContext headless;
 
     // controller
     std::unique_ptr<Controller> controller;
@@ -33,6 +39,7 @@ private:
     // helpers
     bool initGLFW();
     bool initGLAD();
+    bool initScene();
     bool initShaders();
     void initGround();
     void cleanup();
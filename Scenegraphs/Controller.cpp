@@ -12,12 +12,45 @@ using namespace std;
 #include "sgraph/TextScenegraphRenderer.h"
 #include "sgraph/ScenegraphExporter.h"
 #include "sgraph/ScenegraphImporter.h"
+#include "ourutils/CameraPath.h"
+#include "ourutils/FrameTimings.h"
+#include "tools/PPMWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 
-Controller::Controller(Model& m,View& v) {
+Controller::Controller(Model& m,View& v,vector<string>& argv) {
     model = m;
     view = v;
 
     initScenegraph();
+    initRecording(argv);
+}
+
+void Controller::initRecording(vector<string>& argv) {
+    /** optional arg [ --frames <n> ] draws n frames without a window, writes them out with a timing report, and exits */
+    auto it = std::find(argv.begin(), argv.end(), "--frames");
+    if (it != argv.end() && it + 1 != argv.end())
+        recordFrames = max(atoi((it + 1)->c_str()), 0);
+    /** optional arg [ --camera-path <filepath> ] moves the camera along keyframes while recording (see ourutils/CameraPath.h) */
+    it = std::find(argv.begin(), argv.end(), "--camera-path");
+    if (it != argv.end() && it + 1 != argv.end())
+        cameraPathFile = *(it + 1);
+    /** optional arg [ --size <width>x<height> ] sets the size of the recorded frames, 800x800 by default */
+    it = std::find(argv.begin(), argv.end(), "--size");
+    if (it != argv.end() && it + 1 != argv.end()) {
+        int width, height;
+        if (sscanf((it + 1)->c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+            recordWidth = width;
+            recordHeight = height;
+        }
+    }
+    /** optional arg [ --out <directory> ] puts the recorded frames and timing.txt in an existing directory; "--out none" only prints the timing */
+    it = std::find(argv.begin(), argv.end(), "--out");
+    if (it != argv.end() && it + 1 != argv.end())
+        recordDirectory = (*(it + 1) == "none") ? "" : *(it + 1);
 }
 
 //edited to use the new text renderer (TextScenegraphRenderer.h)
@@ -47,6 +80,8 @@ Controller::~Controller()
 
 void Controller::run()
 {
+    if (recordFrames > 0)
+        runHeadless();
     sgraph::IScenegraph * scenegraph = model.getScenegraph();
     map<string,util::PolygonMesh<VertexAttrib> > meshes = scenegraph->getMeshes();
     view.init(this,meshes);
@@ -58,6 +93,64 @@ void Controller::run()
     exit(EXIT_SUCCESS);
 }
 
+/**
+ * Draw the scene into an offscreen framebuffer for the requested number of
+ * frames, moving the camera along its path, and write each frame as a PPM with a
+ * timing report (see ourutils/FrameTimings.h). Reading the frames back and
+ * writing them out is not timed. Exits with a failure status if there is no
+ * context to draw with or a frame could not be written.
+ */
+void Controller::runHeadless()
+{
+    ourutils::CameraPath cameraPath;
+    string error;
+    if (!cameraPathFile.empty() && !cameraPath.load(cameraPathFile, error)) {
+        cerr << "Could not load the camera path: " << error << endl;
+        exit(EXIT_FAILURE);
+    }
+    sgraph::IScenegraph * scenegraph = model.getScenegraph();
+    map<string,util::PolygonMesh<VertexAttrib> > meshes = scenegraph->getMeshes();
+    if (!view.initHeadless(recordWidth, recordHeight, meshes, error)) {
+        cerr << "Could not draw headless: " << error << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    ourutils::FrameTimings timings;
+    vector<unsigned char> pixels;
+    bool written = true;
+    for (int frame = 0; frame < recordFrames; frame++) {
+        ourutils::CameraPath::Pose pose = cameraPath.at(frame, recordFrames);
+        view.setCamera(glm::radians(pose.thetaX), glm::radians(pose.thetaY), pose.radius);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        view.display(scenegraph);
+        double submitMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        glFinish();
+        timings.add(submitMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        if (!recordDirectory.empty()) {
+            int width, height;
+            view.readPixels(pixels, &width, &height);
+            char name[32];
+            snprintf(name, sizeof(name), "/frame-%04d.ppm", frame);
+            if (!writePPM(recordDirectory + name, pixels.data(), width, height, true)) {
+                cerr << "Could not write " << recordDirectory + name << endl;
+                written = false;
+                break;
+            }
+        }
+    }
+
+    string report = timings.report((const char *)glGetString(GL_RENDERER), recordWidth, recordHeight);
+    cout << report;
+    if (!recordDirectory.empty()) {
+        ofstream out(recordDirectory + "/timing.txt");
+        out << report;
+        written = written && out.good();
+    }
+
+    view.closeWindow();
+    exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
 void Controller::onkey(int key, int scancode, int action, int mods)
 {
     // cout << (char)key << " pressed" << endl;
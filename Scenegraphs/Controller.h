@@ -4,13 +4,16 @@
 #include "View.h"
 #include "Model.h"
 #include "Callbacks.h"
+#include <string>
+#include <vector>
 
 class Controller: public Callbacks
 {
 public:
-    Controller(Model& m,View& v);
+    Controller(Model& m,View& v,vector<string>& argv);
     ~Controller();
     void run();
+    void runHeadless();
     void promptAdjustRotation();
 
     virtual void reshape(int width, int height);
@@ -20,12 +23,21 @@ public:
     virtual void error_callback(int error, const char* description);
 private:
     void initScenegraph();
+    void initRecording(vector<string>& argv);
 
     View view;
     Model model;
     bool lbutton_down = false;
     double cursorPosnX;
     double cursorPosnY;
+
+    // with --frames, the number of frames to draw headless; 0 opens a window
+    int recordFrames = 0;
+    int recordWidth = 800;
+    int recordHeight = 800;
+    string cameraPathFile;
+    // where the frames and the timing report go, or empty for neither
+    string recordDirectory = ".";
 };
 
 #endif
\ No newline at end of file
@@ -8,7 +8,8 @@
 int main(int argc,char *argv[]) {
     Model model;
     View view;
-    Controller controller(model,view);
+    vector<string> args(argv + 1, argv + argc);
+    Controller controller(model,view,args);
     controller.run();
 
 
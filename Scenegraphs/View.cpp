@@ -65,6 +65,31 @@ void View::init(Callbacks *callbacks,map<string,util::PolygonMesh<VertexAttrib>>
     gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
     glfwSwapInterval(1);
 
+	int window_width,window_height;
+    glfwGetFramebufferSize(window,&window_width,&window_height);
+    initScene(meshes,window_width,window_height);
+
+    frames = 0;
+    time = glfwGetTime();
+}
+
+/**
+ * Set up to draw without a window, into a framebuffer object of the given size,
+ * for recording frames on machines with no display.
+ * \return false, with the reason in error, if there is no OpenGL context to draw with
+ */
+bool View::initHeadless(int width,int height,map<string,util::PolygonMesh<VertexAttrib>>& meshes,string& error)
+{
+    if (!headless.create(width,height,error))
+        return false;
+    this->thetaX = 0.0f;
+    this->thetaY = glm::radians(30.0f);
+    initScene(meshes,width,height);
+    return true;
+}
+
+void View::initScene(map<string,util::PolygonMesh<VertexAttrib>>& meshes,int width,int height)
+{
     // create the shader program
     program.createProgram(string("shaders/default.vert"),
                           string("shaders/default.frag"));
@@ -99,15 +124,9 @@ void View::init(Callbacks *callbacks,map<string,util::PolygonMesh<VertexAttrib>>
         objects[it->first] = obj;
     }
     
-	int window_width,window_height;
-    glfwGetFramebufferSize(window,&window_width,&window_height);
-
     //prepare the projection matrix for perspective projection
-	projection = glm::perspective(glm::radians(60.0f),(float)window_width/window_height,0.1f,10000.0f);
-    glViewport(0, 0, window_width,window_height);
-
-    frames = 0;
-    time = glfwGetTime();
+	projection = glm::perspective(glm::radians(60.0f),(float)width/height,0.1f,10000.0f);
+    glViewport(0, 0, width,height);
 
     renderer = new sgraph::GLScenegraphRenderer(modelview,objects,shaderLocations);
     
@@ -158,6 +177,26 @@ void View::adjustRotation(char axis, float delta) {
     return;
 }
 
+// puts the camera at the given trackball angles, in radians, and distance from
+// the origin, with up flipped past the poles as adjustRotation does
+void View::setCamera(float thetaX, float thetaY, float radius) {
+    this->thetaX = thetaX;
+    this->thetaY = thetaY;
+    this->radiusView = radius;
+    this->upVal = (cos(thetaY) < 0.0f) ? -1 : 1;
+}
+
+// reads back the last frame drawn, as RGB rows from the bottom up
+void View::readPixels(vector<unsigned char>& pixels, int *width, int *height) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    *width = viewport[2];
+    *height = viewport[3];
+    pixels.resize(3 * (size_t)(*width) * (*height));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(viewport[0], viewport[1], *width, *height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+}
+
 void View::display(sgraph::IScenegraph *scenegraph) {
     
     program.enable();
@@ -171,7 +210,6 @@ void View::display(sgraph::IScenegraph *scenegraph) {
     
     
     modelview.push(glm::mat4(1.0));
-    float radiusView = 500.0f;
     // rotating our trackball
     glm::vec3 vRotated = {0, 0, 0};
     vRotated.x = radiusView * cos(this->thetaY) * sin(this->thetaX);
@@ -195,6 +233,10 @@ void View::display(sgraph::IScenegraph *scenegraph) {
     modelview.pop();
     glFlush();
     program.disable();
+
+    // without a window the frame stays in the framebuffer object, to be read back
+    if (window == NULL)
+        return;
     
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -220,6 +262,10 @@ void View::closeWindow() {
           it->second->cleanup();
           delete it->second;
     } 
+    if (window == NULL) {
+        headless.destroy();
+        return;
+    }
     glfwDestroyWindow(window);
 
     glfwTerminate();
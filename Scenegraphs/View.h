@@ -14,8 +14,10 @@
 #include "VertexAttrib.h"
 #include "Callbacks.h"
 #include "sgraph/IScenegraph.h"
+#include "HeadlessContext.h"
 
 #include <stack>
+#include <vector>
 using namespace std;
 
 
@@ -25,17 +27,23 @@ public:
     View();
     ~View();
     void init(Callbacks* callbacks,map<string,util::PolygonMesh<VertexAttrib>>& meshes);
+    bool initHeadless(int width,int height,map<string,util::PolygonMesh<VertexAttrib>>& meshes,string& error);
     void display(sgraph::IScenegraph *scenegraph);
     bool shouldWindowClose();
     void closeWindow();
     void resetRotation();
     void adjustRotation(char axis, float delta);
+    void setCamera(float thetaX, float thetaY, float radius);
+    void readPixels(vector<unsigned char>& pixels, int *width, int *height);
     void getCursorPosn(double *xpos, double *ypos);
     void getWindowScalars(float *scaleX, float *scaleY);
 
 private: 
+    void initScene(map<string,util::PolygonMesh<VertexAttrib>>& meshes,int width,int height);
 
-    GLFWwindow* window;
+    // NULL when drawing headless
+    GLFWwindow* window = NULL;
+    HeadlessContext headless;
     util::ShaderProgram program;
     util::ShaderLocationsVault shaderLocations;
     map<string,util::ObjectInstance *> objects;
@@ -46,6 +54,7 @@ private:
     double time;
     float thetaX;
     float thetaY;
+    float radiusView = 500.0f;
     int upVal = 1;
 };
 
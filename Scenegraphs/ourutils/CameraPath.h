@@ -0,0 +1,110 @@
+#ifndef _CAMERAPATH_H_
+#define _CAMERAPATH_H_
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ourutils {
+
+/**
+ * Where the trackball camera of the View is on each frame of a recording, as
+ * keyframes read from a file with one keyframe a line:
+ *
+ *   thetaX thetaY [radius]
+ *
+ * The angles are in degrees, as the trackball turns them, and the radius is the
+ * distance from the origin, or the path's default radius if left out. Blank
+ * lines and lines starting with # are skipped. The camera moves between
+ * keyframes at an even pace, on the first keyframe on the first frame and on the
+ * last keyframe on the last.
+ */
+class CameraPath {
+    public:
+        struct Pose {
+            float thetaX;
+            float thetaY;
+            float radius;
+        };
+
+        /**
+         * A path that stays where the View starts
+         * \param radius the distance of the camera when a keyframe leaves it out
+         */
+        explicit CameraPath(float radius = 500) : defaultRadius(radius) {
+            Pose start;
+            start.thetaX = 0;
+            start.thetaY = 30;
+            start.radius = radius;
+            keys.push_back(start);
+        }
+
+        /**
+         * Replace the keyframes with those of a file
+         * \return false, with the reason in error, if the file could not be
+         * read or a line is not a keyframe; the path is unchanged then
+         */
+        bool load(const std::string& path, std::string& error) {
+            std::ifstream in(path);
+            if (!in) {
+                error = "could not open " + path;
+                return false;
+            }
+            std::vector<Pose> loaded;
+            std::string line;
+            for (int number = 1; std::getline(in, line); number++) {
+                std::istringstream words(line);
+                std::string first;
+                if (!(words >> first) || (first[0] == '#'))
+                    continue;
+                Pose pose;
+                pose.radius = defaultRadius;
+                std::string radius, rest;
+                bool ok = (std::istringstream(first) >> pose.thetaX) && (words >> pose.thetaY);
+                if (ok && (words >> radius))
+                    ok = (std::istringstream(radius) >> pose.radius) && !(words >> rest);
+                if (!ok) {
+                    error = path + " line " + std::to_string(number) + ": expected thetaX thetaY [radius]";
+                    return false;
+                }
+                loaded.push_back(pose);
+            }
+            if (loaded.empty()) {
+                error = path + " has no keyframes";
+                return false;
+            }
+            keys = loaded;
+            return true;
+        }
+
+        /**
+         * \return the pose on a frame of a recording that is frames long
+         */
+        Pose at(int frame, int frames) const {
+            if ((keys.size() == 1) || (frames < 2))
+                return keys.front();
+            float t = (float)frame / (frames - 1) * (keys.size() - 1);
+            size_t key = (size_t)t;
+            if (key + 1 >= keys.size())
+                return keys.back();
+            float f = t - key;
+            const Pose& a = keys[key];
+            const Pose& b = keys[key + 1];
+            Pose pose;
+            pose.thetaX = a.thetaX + f * (b.thetaX - a.thetaX);
+            pose.thetaY = a.thetaY + f * (b.thetaY - a.thetaY);
+            pose.radius = a.radius + f * (b.radius - a.radius);
+            return pose;
+        }
+
+        int getKeyframes() const { return (int)keys.size(); }
+
+    private:
+        float defaultRadius;
+        std::vector<Pose> keys;
+};
+
+}
+
+#endif
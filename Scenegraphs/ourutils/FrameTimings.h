@@ -0,0 +1,62 @@
+#ifndef _FRAMETIMINGS_H_
+#define _FRAMETIMINGS_H_
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ourutils {
+
+/**
+ * The time each frame of a headless recording took, twice over: up to the end
+ * of submitting it, which is the CPU cost, and after glFinish, which includes
+ * drawing it. The report lists every frame and then statistics over all but the
+ * first, which also pays for whatever is built on first use, one "name value"
+ * line each so that scripts can compare runs.
+ */
+class FrameTimings {
+    public:
+        void add(double submitMs, double frameMs) {
+            submit.push_back(submitMs);
+            frame.push_back(frameMs);
+        }
+
+        size_t size() const { return frame.size(); }
+
+        std::string report(const std::string& renderer, int width, int height) const {
+            std::ostringstream out;
+            out << "# frame submit_ms frame_ms" << std::endl;
+            for (size_t i = 0; i < frame.size(); i++)
+                out << i << " " << submit[i] << " " << frame[i] << std::endl;
+            out << "renderer " << renderer << std::endl;
+            out << "size " << width << "x" << height << std::endl;
+            out << "frames " << frame.size() << std::endl;
+            if (!frame.empty())
+                out << "first_frame_ms " << frame[0] << std::endl;
+            if (frame.size() > 1) {
+                std::vector<double> sorted(frame.begin() + 1, frame.end());
+                double total = 0, submitTotal = 0;
+                for (size_t i = 1; i < frame.size(); i++) {
+                    total += frame[i];
+                    submitTotal += submit[i];
+                }
+                std::sort(sorted.begin(), sorted.end());
+                out << "mean_submit_ms " << submitTotal / sorted.size() << std::endl;
+                out << "mean_frame_ms " << total / sorted.size() << std::endl;
+                out << "median_frame_ms " << sorted[sorted.size() / 2] << std::endl;
+                out << "p95_frame_ms " << sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)] << std::endl;
+                out << "max_frame_ms " << sorted.back() << std::endl;
+                out << "fps " << 1000.0 * sorted.size() / total << std::endl;
+            }
+            return out.str();
+        }
+
+    private:
+        std::vector<double> submit;
+        std::vector<double> frame;
+};
+
+}
+
+#endif